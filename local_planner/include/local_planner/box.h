@@ -30,6 +30,17 @@ class Box {
            z > zmin_;
   }
 
+  /**
+  * @brief     corners of the bounding box, used by vectorized point tests
+  * @returns   minimum (maximum) x, y and z coordinate of the box
+  **/
+  inline Eigen::Vector3f getMinCorner() const {
+    return Eigen::Vector3f(xmin_, ymin_, zmin_);
+  }
+  inline Eigen::Vector3f getMaxCorner() const {
+    return Eigen::Vector3f(xmax_, ymax_, zmax_);
+  }
+
   float radius_;
   float box_dist_to_ground_ = 2.0;
   float zmin_;
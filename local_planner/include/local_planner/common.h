@@ -5,6 +5,7 @@
 #include <geometry_msgs/PoseStamped.h>
 #include <geometry_msgs/Twist.h>
 #include <geometry_msgs/Vector3Stamped.h>
+#include <tf/transform_datatypes.h>
 #include <Eigen/Core>
 #include <Eigen/Dense>
 
@@ -52,6 +53,20 @@ float indexAngleDifference(float a, float b);
 **/
 PolarPoint histogramIndexToPolar(int e, int z, int res, float radius);
 
+/**
+* @brief     polynomial approximation of atan2 (Abramowitz and Stegun 4.4.49)
+* @param[in] y, ordinate
+* @param[in] x, abscissa
+* @returns   angle in rad [-PI, PI], within ATAN2_APPROX_MAX_ERROR_RAD of
+*            std::atan2(y, x)
+**/
+float approxAtan2(float y, float x);
+const float ATAN2_APPROX_MAX_ERROR_RAD = 1.2e-5f;  // 0.0007 deg
+// odd polynomial coefficients of atan(a) for a in [0, 1], shared with the
+// vectorized kernels
+const float ATAN2_COEFFS[5] = {0.9998660f, -0.3302995f, 0.1801410f,
+                               -0.0851330f, 0.0208351f};
+
 /**
 * @brief     Compute a cartesian point to polar CS
 * @param[in] position Position of the location to which to compute the bearing
@@ -128,6 +143,7 @@ Eigen::Vector3f toEigen(const geometry_msgs::Point& p);
 Eigen::Vector3f toEigen(const geometry_msgs::Vector3& v3);
 Eigen::Vector3f toEigen(const pcl::PointXYZ& xyz);
 Eigen::Quaternionf toEigen(const geometry_msgs::Quaternion& gmq);
+Eigen::Affine3f toEigen(const tf::Transform& tf_transform);
 
 geometry_msgs::Point toPoint(const Eigen::Vector3f& ev3);
 geometry_msgs::Vector3 toVector3(const Eigen::Vector3f& ev3);
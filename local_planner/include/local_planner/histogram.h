@@ -3,6 +3,7 @@
 
 #include <math.h>
 #include <Eigen/Dense>
+#include <array>
 #include <vector>
 
 namespace avoidance {
@@ -14,28 +15,63 @@ const int ALPHA_RES = 6;
 const int GRID_LENGTH_Z = 360 / ALPHA_RES;
 const int GRID_LENGTH_E = 180 / ALPHA_RES;
 
-class Histogram {
-  int resolution_;
-  int z_dim_;
-  int e_dim_;
-  Eigen::MatrixXi age_;
-  Eigen::MatrixXf dist_;
+// Bin sizes the planner pipeline is compiled for besides ALPHA_RES. The bin
+// size is selected at runtime with the histogram_resolution_ parameter: coarse
+// bins lower the CPU load, fine bins resolve narrower gaps between obstacles.
+const int ALPHA_RES_FINE = 3;
+const int ALPHA_RES_COARSE = 10;
+
+/**
+* @brief     checks if the planner pipeline is compiled for a bin size
+* @param[in] res, bin size [deg]
+* @returns   true for ALPHA_RES_FINE, ALPHA_RES and ALPHA_RES_COARSE
+**/
+inline bool isSupportedResolution(int res) {
+  return res == ALPHA_RES_FINE || res == ALPHA_RES || res == ALPHA_RES_COARSE;
+}
+
+/**
+* @brief     polar histogram with a bin size of RES degrees. The dimensions
+*            are known at compile time, histograms of different bin sizes are
+*            distinct types.
+**/
+template <int RES>
+class PolarHistogram {
+  static_assert(RES > 0 && 180 % RES == 0,
+                "the bin size must divide 180 degrees");
+
+ public:
+  static constexpr int RESOLUTION = RES;
+  static constexpr int E_DIM = 180 / RES;
+  static constexpr int Z_DIM = 360 / RES;
+
+ private:
+  // Row major storage: the bin loops iterate the azimuth index in the inner
+  // loop. The storage is left unaligned, so that the classes holding
+  // histograms don't need an aligned operator new.
+  typedef Eigen::Matrix<int, E_DIM, Z_DIM, Eigen::RowMajor | Eigen::DontAlign>
+      AgeMatrix;
+  typedef Eigen::Matrix<float, E_DIM, Z_DIM, Eigen::RowMajor | Eigen::DontAlign>
+      DistMatrix;
+
+  AgeMatrix age_;
+  DistMatrix dist_;
 
   /**
   * @brief     wraps elevation and azimuth indeces around the histogram
   * @param     x, elevation angle index
   * @param     y, azimuth angle index
   **/
-  inline void wrapIndex(int &x, int &y) const {
-    x = x % e_dim_;
-    if (x < 0) x += e_dim_;
-    y = y % z_dim_;
-    if (y < 0) y += z_dim_;
+  static inline void wrapIndex(int &x, int &y) {
+    x = x % E_DIM;
+    if (x < 0) x += E_DIM;
+    y = y % Z_DIM;
+    if (y < 0) y += Z_DIM;
   }
 
  public:
-  Histogram(const int res);
-  ~Histogram() = default;
+  PolarHistogram();
+  ~PolarHistogram() = default;
 
   /**
   * @brief     getter method for histogram cell age
@@ -59,6 +95,23 @@ class Histogram {
     return dist_(x, y);
   }
 
+  /**
+  * @brief     getter method for histogram cell age without index wrapping
+  * @param[in] x, elevation angle index in [0, E_DIM)
+  * @param[in] y, azimuth angle index in [0, Z_DIM)
+  * @returns   cell age
+  **/
+  inline int age(int x, int y) const { return age_(x, y); }
+
+  /**
+  * @brief     getter method for histogram cell distance without index
+  *            wrapping
+  * @param[in] x, elevation angle index in [0, E_DIM)
+  * @param[in] y, azimuth angle index in [0, Z_DIM)
+  * @returns   distance to the vehicle of obstacle mapped to (x, y) cell [m]
+  **/
+  inline float dist(int x, int y) const { return dist_(x, y); }
+
   /**
   * @brief     setter method for histogram cell age
   * @param[in] x, elevation angle index
@@ -77,36 +130,120 @@ class Histogram {
   inline void set_dist(int x, int y, float value) { dist_(x, y) = value; }
 
   /**
-  * @brief     Compute the upsampled version of the histogram
-  * @param[in] This object. Needs to be a histogram the larger bin size
-  *(ALPHA_RES * 2)
-  * @details   The histogram is upsampled to get the same histogram at regular
-  *bin size (ALPHA_RES).
-  *            This means the histogram matrix will be double the size in each
-  *dimension
-  * @returns   Modifies the object it is called from to have regular resolution
-  * @warning   Can only be called from a large bin size histogram
+  * @brief     resets all histogram cells age and distance to zero
   **/
-  void upsample();
+  void setZero();
+};
+
+template <int RES>
+constexpr int PolarHistogram<RES>::RESOLUTION;
+template <int RES>
+constexpr int PolarHistogram<RES>::E_DIM;
+template <int RES>
+constexpr int PolarHistogram<RES>::Z_DIM;
+
+/**
+* @brief     histogram at the regular bin size used by the planner
+**/
+typedef PolarHistogram<ALPHA_RES> Histogram;
+
+/**
+* @brief      Compute the upsampled version of a histogram
+* @param[in]  low_res_histogram, histogram with the larger bin size (2 * RES)
+* @param[out] histogram, histogram at bin size RES. Every cell of the input is
+*             split into four cells
+**/
+template <int RES>
+void upsample(const PolarHistogram<2 * RES> &low_res_histogram,
+              PolarHistogram<RES> &histogram);
+
+/**
+* @brief      Compute the downsampled version of a histogram
+* @param[in]  histogram, histogram at bin size RES
+* @param[out] low_res_histogram, histogram with the larger bin size (2 * RES).
+*             Every cell is the mean of four cells of the input
+**/
+template <int RES>
+void downsample(const PolarHistogram<RES> &histogram,
+                PolarHistogram<2 * RES> &low_res_histogram);
+
+/**
+* @brief     unit vectors of the bin centers and bin corners of a histogram
+*            with bin size RES. The table is built once on first use and
+*            replaces the trigonometric functions in the per bin loops
+**/
+template <int RES>
+class HistogramLookupTable {
+ public:
+  static constexpr int E_DIM = PolarHistogram<RES>::E_DIM;
+  static constexpr int Z_DIM = PolarHistogram<RES>::Z_DIM;
 
   /**
-  * @brief     Compute the downsampled version of the histogram
-  * @param[in] this object. Needs to be a histogram with regular bin size
-  *(ALPHA_RES)
-  * @details   The histogram is downsampled to get the same histogram at larger
-  *bin size (ALPHA_RES/2).
-  *            This means the histogram matrix will be half the size in each
-  *dimension
-  * @returns   Modifies the object it is called from to have larger bins
-  * @warning   Can only be called from a regular bin size histogram
+  * @brief     getter method for the table of the bin size RES
+  * @returns   lookup table, built at the first call
   **/
-  void downsample();
+  static const HistogramLookupTable &get();
 
   /**
-  * @brief     resets all histogram cells age and distance to zero
+  * @brief     getter method for the direction to the bin center
+  * @param[in] e, elevation angle index in [0, E_DIM)
+  * @param[in] z, azimuth angle index in [0, Z_DIM)
+  * @returns   unit vector, same as polarToCartesian of the bin center
   **/
-  void setZero();
+  inline const Eigen::Vector3f &binCenter(int e, int z) const {
+    return center_[e * Z_DIM + z];
+  }
+
+  /**
+  * @brief     getter methods for the x and y components of the bin center
+  *            directions of an elevation row, stored contiguously for the row
+  *            wise array expressions
+  * @param[in] e, elevation angle index in [0, E_DIM)
+  * @returns   pointer to the Z_DIM components of the row
+  **/
+  inline const float *binCenterXRow(int e) const {
+    return &center_x_[e * Z_DIM];
+  }
+  inline const float *binCenterYRow(int e) const {
+    return &center_y_[e * Z_DIM];
+  }
+
+  /**
+  * @brief     getter method for the direction to a bin corner
+  * @param[in] e_edge, elevation edge index in [0, E_DIM], edge e_edge is the
+  *            lower elevation border of bin e_edge
+  * @param[in] z_edge, azimuth edge index in [0, Z_DIM], edge z_edge is the
+  *            lower azimuth border of bin z_edge
+  * @returns   unit vector pointing to the corner
+  **/
+  inline const Eigen::Vector3f &binCorner(int e_edge, int z_edge) const {
+    return corner_[e_edge * (Z_DIM + 1) + z_edge];
+  }
+
+  /**
+  * @brief     getter method for the horizontal width of an elevation row
+  *            relative to the bins at zero elevation
+  * @param[in] e, elevation angle index in [0, E_DIM)
+  * @returns   cosine of the bin center elevation
+  **/
+  inline float elevationBinWidth(int e) const {
+    return elevation_bin_width_[e];
+  }
+
+ private:
+  HistogramLookupTable();
+
+  std::array<Eigen::Vector3f, E_DIM * Z_DIM> center_;
+  std::array<float, E_DIM * Z_DIM> center_x_;
+  std::array<float, E_DIM * Z_DIM> center_y_;
+  std::array<Eigen::Vector3f, (E_DIM + 1) * (Z_DIM + 1)> corner_;
+  std::array<float, E_DIM> elevation_bin_width_;
 };
+
+template <int RES>
+constexpr int HistogramLookupTable<RES>::E_DIM;
+template <int RES>
+constexpr int HistogramLookupTable<RES>::Z_DIM;
 }
 
 #endif  // HISTOGRAM_H
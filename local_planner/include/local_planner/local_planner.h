@@ -7,6 +7,7 @@
 #include "candidate_direction.h"
 #include "cost_parameters.h"
 #include "histogram.h"
+#include "planner_functions.h"
 
 #include <dynamic_reconfigure/server.h>
 #include <local_planner/LocalPlannerNodeConfig.h>
@@ -25,20 +26,31 @@
 #include <nav_msgs/Path.h>
 
 #include <ros/time.h>
-#include <deque>
 #include <string>
 #include <vector>
 
 namespace avoidance {
 
 class StarPlanner;
-class TreeNode;
+struct Tree;
+
+/**
+* @brief     viewing direction of a camera and whether its cloud is new, used
+*to update the histogram per camera in the asynchronous mode
+**/
+struct CameraSlice {
+  // optical axis in histogram angle convention [deg]
+  PolarPoint direction;
+  // the cloud of the camera in complete_cloud_ is new since the last update
+  bool updated = false;
+};
 
 class LocalPlanner {
  private:
   bool use_back_off_;
   bool use_VFH_star_;
   bool adapt_cost_params_;
+  bool downsample_cloud_ = false;
   bool stop_in_front_;
 
   bool reach_altitude_ = false;
@@ -74,23 +86,30 @@ class LocalPlanner {
   float costmap_direction_e_;
   float costmap_direction_z_;
   float smoothing_margin_degrees_ = 30.f;
+  float voxel_leaf_size_ = 0.1f;
+  float voxel_leaf_size_growth_ = 0.05f;
+  int max_cloud_points_ = 20000;
+  int histogram_resolution_ = ALPHA_RES;
+  size_t cropped_cloud_size_ = 0;  ///< number of points before downsampling
 
   waypoint_choice waypoint_type_;
   ros::Time last_path_time_;
 
   std::vector<int> e_FOV_idx_;
-  std::vector<int> z_FOV_idx_;
-  std::deque<float> goal_dist_incline_;
+  FOVMask z_FOV_mask_;
+  std::vector<float> goal_dist_incline_;
   std::vector<float> cost_path_candidates_;
   std::vector<int> cost_idx_sorted_;
   std::vector<int> closed_set_;
-  std::vector<int> reprojected_points_age_;
-
-  std::vector<TreeNode> tree_;
   std::unique_ptr<StarPlanner> star_planner_;
   costParameters cost_params_;
 
-  pcl::PointCloud<pcl::PointXYZ> reprojected_points_, final_cloud_;
+  // filtered cloud of the current cycle. It is shared read only with the
+  // star planner and the publisher and never modified once it is built
+  pcl::PointCloud<pcl::PointXYZ>::Ptr final_cloud_;
+  // cloud of the previous cycle, the next cycle reuses its storage if no
+  // reader holds it anymore
+  pcl::PointCloud<pcl::PointXYZ>::Ptr previous_final_cloud_;
 
   Eigen::Vector3f position_ = Eigen::Vector3f::Zero();
   Eigen::Vector3f velocity_ = Eigen::Vector3f::Zero();
@@ -100,17 +119,27 @@ class LocalPlanner {
   Eigen::Vector3f position_old_ = Eigen::Vector3f::Zero();
   Eigen::Vector3f closest_point_ = Eigen::Vector3f::Zero();
 
-  Histogram polar_histogram_ = Histogram(ALPHA_RES);
-  Histogram to_fcu_histogram_ = Histogram(ALPHA_RES);
+  // obstacle memory for every supported bin size, only the one of the active
+  // histogram_resolution_ is updated
+  PolarHistogram<ALPHA_RES_FINE> polar_histogram_fine_;
+  Histogram polar_histogram_;
+  PolarHistogram<ALPHA_RES_COARSE> polar_histogram_coarse_;
   Eigen::MatrixXf cost_matrix_;
   std::vector<candidateDirection> candidate_vector_;
 
+  // workspaces of the planning cycle, reused such that the cycle doesn't
+  // allocate once they have grown to their steady state size
+  CostMatrixBuffers cost_matrix_buffers_;
+  CandidateSelectionBuffers candidate_selection_buffers_;
+  VoxelGridBuffers voxel_grid_buffers_;
+
   /**
-  * @brief     reprojectes the histogram from the previous algorithm iteration
-  *around the current vehicle position
-  * @param     histogram, histogram from the previous algorith iteration
+  * @brief     reprojects the obstacle memory of the bin size RES into 3D space
+  * @param     reprojected_points, occupied bin corners of the obstacle memory
   **/
-  void reprojectPoints(Histogram histogram);
+  template <int RES>
+  void reprojectObstacleMemory(
+      pcl::PointCloud<pcl::PointXYZ> &reprojected_points);
   /**
   * @brief     calculates the cost function weights to fly around or over
   *obstacles based on the progress towards the goal over time
@@ -123,7 +152,8 @@ class LocalPlanner {
   /**
   * @brief     fills message to send histogram to the FCU
   **/
-  void updateObstacleDistanceMsg(Histogram hist);
+  template <int RES>
+  void updateObstacleDistanceMsg(const PolarHistogram<RES> &hist);
   /**
   * @brief      fills message to send empty histogram to the FCU
   **/
@@ -132,13 +162,26 @@ class LocalPlanner {
   * @brief      creates a polar histogram representation of the pointcloud
   * @params[in] send_to_fcu, true if the histogram is sent to the FCU
   **/
+  template <int RES>
   void create2DObstacleRepresentation(const bool send_to_fcu);
   /**
   * @brief     generates an image represention of the polar histogram
   * @param     histogram, polar histogram representing obstacles
   * @returns   histogram image
   **/
-  void generateHistogramImage(Histogram &histogram);
+  template <int RES>
+  void generateHistogramImage(const PolarHistogram<RES> &histogram);
+  /**
+  * @brief     getter method for the obstacle memory of a bin size
+  * @returns   polar histogram of the bin size RES
+  **/
+  template <int RES>
+  PolarHistogram<RES> &polarHistogram();
+  /**
+  * @brief     determineStrategy for the histogram bin size RES [deg]
+  **/
+  template <int RES>
+  void determineStrategyImpl();
 
  public:
   float h_FOV_ = 59.0f;
@@ -146,6 +189,9 @@ class LocalPlanner {
   Box histogram_box_;
   std::vector<uint8_t> histogram_image_data_;
   std::vector<uint8_t> cost_image_data_;
+  // the debug images are only generated if requested, otherwise they are empty
+  bool generate_histogram_image_ = true;
+  bool generate_cost_image_ = true;
   bool use_vel_setpoints_;
   bool currently_armed_ = false;
   bool offboard_ = false;
@@ -167,6 +213,11 @@ class LocalPlanner {
 
   // complete_cloud_ contains n complete clouds from the cameras
   std::vector<pcl::PointCloud<pcl::PointXYZ>> complete_cloud_;
+  // asynchronous mode: one slice per cloud in complete_cloud_. Only the
+  // histogram slices of the cameras with a new cloud are built from the
+  // clouds, each camera sees h_FOV_ divided by the number of cameras. Empty if
+  // every cloud is new
+  std::vector<CameraSlice> camera_slices_;
 
   LocalPlanner();
   ~LocalPlanner();
@@ -205,13 +256,18 @@ class LocalPlanner {
   Eigen::Vector3f getPosition();
 
   /**
-  * @brief     getter method to visualize pointcloud in rviz
-  * @param     final_cloud, filtered pointcloud from the current camera frame
-  * @param     reprojected_points, pointcloud saved from previous frames
+  * @brief     getter method to visualize the pointcloud in rviz
+  * @returns   filtered pointcloud from the current camera frame, shared with
+  *            the planner without a copy. It is not modified by later cycles
   **/
-  void getCloudsForVisualization(
-      pcl::PointCloud<pcl::PointXYZ> &final_cloud,
-      pcl::PointCloud<pcl::PointXYZ> &reprojected_points);
+  pcl::PointCloud<pcl::PointXYZ>::ConstPtr getFinalCloud() const;
+
+  /**
+  * @brief     getter method to visualize the obstacle memory in rviz, the
+  *            points are only generated on request
+  * @param     reprojected_points, obstacle memory reprojected into 3D space
+  **/
+  void getReprojectedPoints(pcl::PointCloud<pcl::PointXYZ> &reprojected_points);
   /**
   * @brief     setter method for vehicle velocity
   * @param[in]     vel, velocity message coming from the FCU
@@ -220,11 +276,14 @@ class LocalPlanner {
 
   /**
   * @brief     getter method to visualize the tree in rviz
-  * @param[in]     closed_set, velocity message coming from the FCU
-  * @param[in]     path_node_positions, velocity message coming from the FCU
+  * @param[out]    closed_set, indices of the expanded nodes
+  * @param[out]    path_node_positions, nodes of the path from its end to the
+  *                vehicle
+  * @returns   search tree of the last cycle, it is not copied and valid until
+  *            the next cycle
   **/
-  void getTree(std::vector<TreeNode> &tree, std::vector<int> &closed_set,
-               std::vector<Eigen::Vector3f> &path_node_positions);
+  const Tree &getTree(std::vector<int> &closed_set,
+                      std::vector<Eigen::Vector3f> &path_node_positions) const;
   /**
   * @brief     setter method to send obstacle distance information to FCU
   * @param[in]     obstacle_distance, obstacle distance message
@@ -237,6 +296,12 @@ class LocalPlanner {
   **/
   avoidanceOutput getAvoidanceOutput();
 
+  /**
+  * @brief     getter method for the bin size of the histograms and images
+  * @returns   histogram bin size [deg]
+  **/
+  int getHistogramResolution() const;
+
   /**
   * @brief     determines the way the obstacle is avoided and the algorithm to
   *use
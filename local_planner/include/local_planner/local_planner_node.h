@@ -2,6 +2,8 @@
 #define LOCAL_PLANNER_LOCAL_PLANNER_NODE_H
 
 #include "local_planner/avoidance_output.h"
+#include "local_planner/common.h"
+#include "local_planner/thread_pool.h"
 
 #ifndef DISABLE_SIMULATION
 // include simulation
@@ -20,12 +22,10 @@
 #include <mavros_msgs/Trajectory.h>
 #include <nav_msgs/GridCells.h>
 #include <nav_msgs/Path.h>
-#include <pcl/filters/filter.h>
-#include <pcl_conversions/pcl_conversions.h>  // fromROSMsg
 #include <pcl_ros/point_cloud.h>
-#include <pcl_ros/transforms.h>  // transformPointCloud
 #include <ros/ros.h>
 #include <sensor_msgs/CameraInfo.h>
+#include <sensor_msgs/Image.h>
 #include <sensor_msgs/PointCloud2.h>
 #include <sensor_msgs/Range.h>
 #include <std_msgs/Bool.h>
@@ -55,8 +55,49 @@ struct cameraData {
   std::string topic_;
   ros::Subscriber pointcloud_sub_;
   ros::Subscriber camera_info_sub_;
-  sensor_msgs::PointCloud2 newest_cloud_msg_;
+  sensor_msgs::PointCloud2::ConstPtr newest_cloud_msg_;
   bool received_;
+
+  // depth image input, used instead of the pointcloud if depth image topics
+  // are configured
+  sensor_msgs::Image::ConstPtr newest_depth_msg_;
+  std::vector<Eigen::Vector3f> pixel_rays_;  ///< from the camera intrinsics
+  sensor_msgs::CameraInfo::ConstPtr pixel_rays_info_;  ///< of pixel_rays_
+  std_msgs::Header newest_header_;           ///< of the newest cloud or image
+
+  tf::StampedTransform transform_;  ///< to /local_origin at the cloud stamp
+  bool transform_valid_ = false;
+  ros::WallDuration preprocessing_time_;  ///< decoding and transformation
+
+  // asynchronous mode: the cloud is converted when it arrives and handed to
+  // the planner at its next update
+  pcl::PointCloud<pcl::PointXYZ> cloud_;  ///< in /local_origin frame
+  ros::Time cloud_stamp_;
+  PolarPoint direction_;  ///< optical axis at the cloud stamp, histogram angles
+  bool conversion_pending_ = false;  ///< waiting for the transform
+  bool cloud_updated_ = false;       ///< cloud_ not yet seen by the planner
+  ros::Time planner_cloud_stamp_;    ///< stamp of the cloud in the planner
+};
+
+/**
+* @brief debug products of the planner are only generated when their topic has
+*subscribers, e.g. rviz or a rosbag recording, and at most once per period
+**/
+struct DebugThrottle {
+  ros::Duration period;  ///< minimal time between two publications
+  ros::Time last_publication;
+
+  /**
+  * @brief     checks if the product is due and starts the next period if so
+  * @param[in] num_subscribers, subscribers of the product's topics
+  * @param[in] now, current time
+  * @returns   true, if the product should be generated and published
+  **/
+  bool due(uint32_t num_subscribers, const ros::Time& now) {
+    if (num_subscribers == 0 || now - last_publication < period) return false;
+    last_publication = now;
+    return true;
+  }
 };
 
 /**
@@ -112,6 +153,11 @@ class LocalPlannerNode {
   bool position_received_ = false;
   bool disable_rise_to_goal_altitude_;
   bool accept_goal_input_topic_;
+  bool async_pointcloud_processing_;  ///< don't wait for all cameras
+  double planner_rate_;               ///< in asynchronous mode [Hz]
+  double max_pointcloud_age_;         ///< in asynchronous mode [s]
+  bool use_depth_images_;             ///< instead of pointclouds
+  int depth_image_stride_;            ///< pixel subsampling of depth images
 
   std::atomic<bool> should_exit_{false};
 
@@ -137,6 +183,7 @@ class LocalPlannerNode {
 
   std::unique_ptr<LocalPlanner> local_planner_;
   std::unique_ptr<WaypointGenerator> wp_generator_;
+  std::unique_ptr<ThreadPool> preprocessing_pool_;  ///< one thread per camera
 
   ros::Publisher world_pub_;
   ros::Publisher drone_pub_;
@@ -186,6 +233,32 @@ class LocalPlannerNode {
   **/
   void updatePlannerInfo();
 
+  /**
+  * @brief     decodes and transforms the newest clouds of all cameras into the
+  *planner, the cameras are processed in parallel
+  **/
+  void updatePointClouds();
+
+  /**
+  * @brief     asynchronous mode: hands the clouds converted since the last
+  *update over to the planner and removes outdated clouds
+  **/
+  void updatePointCloudsAsync();
+
+  /**
+  * @brief     asynchronous mode: decodes and transforms the newest cloud of a
+  *camera into its buffer, if the transformation is available
+  * @param[in] index, index of the camera
+  **/
+  void convertPointCloud(size_t index);
+
+  /**
+  * @brief     asynchronous mode: checks if the planner should be updated, which
+  *is the case at the planner rate as long as at least one camera delivers
+  * @returns   true, if the planner should be updated
+  **/
+  bool canUpdatePlannerAsync();
+
   /**
   * @brief     computes the number of available pointclouds
   * @ returns  number of pointclouds
@@ -277,11 +350,18 @@ class LocalPlannerNode {
   ros::Publisher histogram_image_pub_;
   ros::Publisher cost_image_pub_;
 
+  DebugThrottle local_pointcloud_throttle_;
+  DebugThrottle reprojected_points_throttle_;
+  DebugThrottle tree_throttle_;
+  DebugThrottle histogram_image_throttle_;
+  DebugThrottle cost_image_throttle_;
+
   std::vector<float> algo_time;
 
   geometry_msgs::TwistStamped vel_msg_;
   bool armed_, offboard_, mission_, new_goal_;
   bool data_ready_ = false;
+  ros::Time last_planner_update_;
 
   dynamic_reconfigure::Server<avoidance::LocalPlannerNodeConfig>* server_;
   boost::recursive_mutex config_mutex_;
@@ -296,7 +376,8 @@ class LocalPlannerNode {
 
   /**
   * @brief     subscribes to all the camera topics and camera info
-  * @param     camera_topics, array with the pointcloud topics strings
+  * @param     camera_topics, array with the pointcloud or depth image topics
+  *strings
   **/
   void initializeCameraSubscribers(std::vector<std::string>& camera_topics);
 
@@ -313,6 +394,23 @@ class LocalPlannerNode {
   **/
   void pointCloudCallback(const sensor_msgs::PointCloud2::ConstPtr& msg,
                           int index);
+
+  /**
+  * @brief     callaback for depth images
+  * @param[in] msg, depth image message
+  * @param[in] index, camera instance number
+  **/
+  void depthImageCallback(const sensor_msgs::Image::ConstPtr& msg, int index);
+
+  /**
+  * @brief     converts the newest pointcloud or depth image of a camera
+  * @param[in] index, camera instance number
+  * @param[in] transform, transformation from the camera to /local_origin
+  * @param[out] cloud, pointcloud in /local_origin frame
+  * @returns   false, if the data could not be decoded
+  **/
+  bool decodeCameraData(size_t index, const Eigen::Affine3f& transform,
+                        pcl::PointCloud<pcl::PointXYZ>& cloud);
   /**
   * @brief     callaback for camera information
   * @param[in] msg, camera information message
@@ -402,6 +500,11 @@ class LocalPlannerNode {
   **/
   void publishDataImages();
   /**
+  * @brief     requests the debug images of the next planner run from the
+  *planner, if they are due
+  **/
+  void requestDebugImages();
+  /**
   * @brief     publishes ground plane visualization for Rviz
   **/
   void publishGround();
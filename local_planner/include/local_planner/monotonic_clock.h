@@ -0,0 +1,36 @@
+#ifndef MONOTONIC_CLOCK_H
+#define MONOTONIC_CLOCK_H
+
+#include <chrono>
+
+namespace avoidance {
+
+/**
+* @brief source of the time for deadlines within a planning cycle. The time
+*never goes backwards, unlike the ROS time, so that the deadlines are not
+*affected by simulated time or clock adjustments. Tests inject a clock which
+*advances deterministically.
+**/
+class MonotonicClock {
+ public:
+  typedef std::chrono::steady_clock::duration duration;
+  typedef std::chrono::steady_clock::time_point time_point;
+
+  virtual ~MonotonicClock() = default;
+
+  /**
+  * @returns   current time, only the difference of two times is meaningful
+  **/
+  virtual time_point now() = 0;
+};
+
+/**
+* @brief clock reading std::chrono::steady_clock, used outside of the tests
+**/
+class SteadyClock : public MonotonicClock {
+ public:
+  time_point now() override { return std::chrono::steady_clock::now(); }
+};
+}
+
+#endif  // MONOTONIC_CLOCK_H
@@ -12,11 +12,81 @@
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
 
+#include <sensor_msgs/CameraInfo.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include <bitset>
 #include <queue>
+#include <string>
+#include <utility>
 #include <vector>
 
 namespace avoidance {
 
+/**
+* @brief      scratch buffers of downsamplePointCloud. Kept by the caller across
+*planning cycles, they stop allocating once grown to the size of the clouds
+**/
+struct VoxelGridBuffers {
+  // open addressing hash table from voxel key to voxel index
+  std::vector<uint64_t> keys;
+  std::vector<uint32_t> voxel_index;
+  // distance to the vehicle of the point representing each voxel
+  std::vector<float> voxel_dist;
+};
+
+/**
+* @brief      obstacle points aggregated per voxel. Built once per search tree,
+*the histogram of every expanded node bins the occupied voxels instead of every
+*point of the cloud
+**/
+struct ObstacleIndex {
+  // centroid and number of points of every occupied voxel
+  pcl::PointCloud<pcl::PointXYZ> centroids;
+  std::vector<int> weights;
+  // open addressing hash table from voxel key to voxel index
+  std::vector<uint64_t> keys;
+  std::vector<uint32_t> voxel_index;
+};
+
+/**
+* @brief      scratch matrices of getCostMatrix. Kept by the caller across
+*planning cycles, they are only allocated in the first call
+**/
+struct CostMatrixBuffers {
+  Eigen::MatrixXf distance_matrix;
+  Eigen::VectorXf box_buffer;
+};
+
+/**
+* @brief      scratch buffers of the candidate selection. Kept by the caller
+*across planning cycles, they are only allocated in the first call
+**/
+struct CandidateSelectionBuffers {
+  // cost and row major bin index of the cells to select from
+  std::vector<std::pair<float, int>> cells;
+  // row major bin index of the selected candidates
+  std::vector<int> selected_cells;
+};
+
+/**
+* @brief      azimuth columns of the histogram inside the Field of View, bit z
+*is set if column z is inside. Sized for the finest supported bin size
+**/
+typedef std::bitset<360 / ALPHA_RES_FINE> FOVMask;
+
+/**
+* @brief      histogram bins and distances of a batch of points, output of
+*binPointBatch
+**/
+struct PointBinBatch {
+  static const int SIZE = 8;
+  int e_index[SIZE];
+  int z_index[SIZE];
+  float distance[SIZE];
+};
+
 /**
 * @brief      crops the pointcloud so that only the points inside the bounding
 *box around the vehicle position are considered
@@ -43,35 +113,185 @@ void filterPointCloud(
     int min_cloud_size, float min_dist_backoff, Box histogram_box,
     const Eigen::Vector3f& position, float min_realsense_dist);
 
+/**
+* @brief      reduces the pointcloud to one point per voxel. The voxel edge
+*length grows with the distance to the vehicle, since far away obstacles cover
+*fewer histogram cells. The point closest to the vehicle represents the voxel,
+*so that obstacles never appear farther away than measured.
+* @param[in,out] cloud, pointcloud to be downsampled
+* @param[in]  position, current vehicle position
+* @param[in]  leaf_size, voxel edge length at the vehicle position [m]
+* @param[in]  leaf_size_growth, voxel edge length increase per meter distance
+*to the vehicle
+* @param[in]  max_points, maximum number of points in the downsampled cloud,
+*the voxels are enlarged until the cloud fits. Zero disables the limit
+* @param      buffers, scratch buffers, optional
+**/
+void downsamplePointCloud(pcl::PointCloud<pcl::PointXYZ>& cloud,
+                          const Eigen::Vector3f& position, float leaf_size,
+                          float leaf_size_growth, int max_points,
+                          VoxelGridBuffers& buffers);
+
+void downsamplePointCloud(pcl::PointCloud<pcl::PointXYZ>& cloud,
+                          const Eigen::Vector3f& position, float leaf_size,
+                          float leaf_size_growth, int max_points);
+
+/**
+* @brief      aggregates the pointcloud into voxels of a fixed size, each voxel
+*is represented by the centroid of its points and weighted by their number.
+*Binning the weighted centroids approximates binning every point: the distance
+*of a centroid is at most the mean distance of its points and at most a voxel
+*diagonal shorter, and all points of a voxel fall into the bin of the centroid
+* @param[in]  cloud, pointcloud to be indexed
+* @param[in]  origin, corner of the voxel grid, e.g. the vehicle position
+* @param[in]  voxel_size, voxel edge length [m], must be positive
+* @param[out] index, voxel centroids and weights. The buffers are reused
+**/
+void buildObstacleIndex(const pcl::PointCloud<pcl::PointXYZ>& cloud,
+                        const Eigen::Vector3f& origin, float voxel_size,
+                        ObstacleIndex& index);
+
+/**
+* @brief      checks if a straight line segment keeps a minimum distance to all
+*points of a cloud
+* @param[in]  cloud, obstacle points
+* @param[in]  start, start of the segment
+* @param[in]  end, end of the segment
+* @param[in]  clearance, minimum distance between the segment and a point [m]
+* @returns    true if no point is closer to the segment than clearance
+**/
+bool isSegmentClear(const pcl::PointCloud<pcl::PointXYZ>& cloud,
+                    const Eigen::Vector3f& start, const Eigen::Vector3f& end,
+                    float clearance);
+
+/**
+* @brief      decodes a pointcloud message, removes the NaN points and
+*transforms the remaining points into the target frame in a single pass
+* @param[out] cloud, pointcloud in the target frame. The buffer is reused, its
+*capacity is kept between calls
+* @param[in]  msg, pointcloud message as received from the sensor
+* @param[in]  transform, transformation from the sensor frame to the target
+*frame
+* @param[in]  target_frame, frame id of the output cloud
+* @returns    false, if the message has no float32 x, y and z fields or if its
+*data is smaller than its layout
+**/
+bool transformPointCloudMsg(pcl::PointCloud<pcl::PointXYZ>& cloud,
+                            const sensor_msgs::PointCloud2& msg,
+                            const Eigen::Affine3f& transform,
+                            const std::string& target_frame);
+
+/**
+* @brief      computes the viewing ray of every sampled pixel of a depth camera
+*from its intrinsics, scaled such that the ray has unit depth
+* @param[out] pixel_rays, rays in the camera optical frame, row by row
+* @param[in]  camera_info, intrinsics and image size of the camera
+* @param[in]  stride, only every stride-th pixel in both directions is sampled
+**/
+void computePixelRays(std::vector<Eigen::Vector3f>& pixel_rays,
+                      const sensor_msgs::CameraInfo& camera_info, int stride);
+
+/**
+* @brief      converts a depth image directly into a pointcloud in the target
+*frame, scaling the precomputed pixel rays with the measured depth. Pixels
+*without a valid depth are skipped
+* @param[out] cloud, pointcloud in the target frame. The buffer is reused, its
+*capacity is kept between calls
+* @param[in]  msg, depth image with 16UC1 [mm] or 32FC1 [m] encoding
+* @param[in]  pixel_rays, rays of the sampled pixels from computePixelRays
+* @param[in]  stride, pixel stride used to compute the rays
+* @param[in]  transform, transformation from the camera optical frame to the
+*target frame
+* @param[in]  target_frame, frame id of the output cloud
+* @returns    false, if the encoding is not supported, the image does not
+*match the rays or its data is smaller than its layout
+**/
+bool depthImageToPointCloud(pcl::PointCloud<pcl::PointXYZ>& cloud,
+                            const sensor_msgs::Image& msg,
+                            const std::vector<Eigen::Vector3f>& pixel_rays,
+                            int stride, const Eigen::Affine3f& transform,
+                            const std::string& target_frame);
+
 /**
 * @brief      calculates the histogram cells within the Field of View
 * @param[in]  h_FOV, horizontal Field of View [rad]
 * @param[in]  v_FOV, vertical Field of View [rad]
-* @param[out] z_FOV_idx, array of azimuth indexes inside the FOV
+* @param[out] z_FOV_idx, array of azimuth indexes inside the FOV, or
+*z_FOV_mask, bitmask of the azimuth indexes inside the FOV
 * @param[out] e_FOV_min, minimum elevation index inside the FOV
 * @param[out] e_FOV_max, maximum elevation index inside the FOV
 * @param[in]  yaw, vehicle yaw [rad]
 * @param[in]  pitch, vehicle pitch [rad]
 * @note azimuth angle is wrapped, elevation is not
+* @note the histogram functions are templates on the bin size RES [deg], they
+*are compiled for the bin sizes listed in histogram.h
 **/
+template <int RES = ALPHA_RES>
 void calculateFOV(float h_FOV, float v_FOV, std::vector<int>& z_FOV_idx,
                   int& e_FOV_min, int& e_FOV_max, float yaw_fcu_frame,
                   float pitch_fcu_frame);
+template <int RES = ALPHA_RES>
+void calculateFOV(float h_FOV, float v_FOV, FOVMask& z_FOV_mask,
+                  int& e_FOV_min, int& e_FOV_max, float yaw_fcu_frame,
+                  float pitch_fcu_frame);
+
+/**
+* @brief      reprojects the four corners of the occupied bins of a histogram
+*into 3D space
+* @param[out] reprojected_points, bin corners closer to position than max_dist
+*and further than 0.3m
+* @param[out] reprojected_points_age, age of each reprojected point
+* @param[in]  histogram, histogram from a previous algorithm iteration
+* @param[in]  histogram_position, vehicle position at which histogram was built
+* @param[in]  position, current vehicle position
+* @param[in]  max_dist, maximum distance of a reprojected point to position
+* @param[in]  max_age, bins of this age or older are dropped
+**/
+template <int RES>
+void reprojectHistogram(pcl::PointCloud<pcl::PointXYZ>& reprojected_points,
+                        std::vector<int>& reprojected_points_age,
+                        const PolarHistogram<RES>& histogram,
+                        const Eigen::Vector3f& histogram_position,
+                        const Eigen::Vector3f& position, float max_dist,
+                        int max_age);
+
+/**
+* @brief      warps the histogram of a previous algorithm iteration to the
+*current vehicle position. The bin corners are reprojected as in
+*reprojectHistogram and binned at half resolution directly, without building a
+*pointcloud. Cells with less than 6 corners are dropped
+* @param[out] polar_histogram_est, propagated histogram around position
+* @param[in]  previous_histogram, histogram from the previous algorithm
+*iteration
+* @param[in]  previous_position, vehicle position at which previous_histogram
+*was built
+* @param[in]  position, current vehicle position
+* @param[in]  max_dist, maximum distance of a reprojected corner to position
+* @param[in]  max_age, bins of this age or older are dropped
+**/
+template <int RES>
+void propagateHistogram(PolarHistogram<RES>& polar_histogram_est,
+                        const PolarHistogram<RES>& previous_histogram,
+                        const Eigen::Vector3f& previous_position,
+                        const Eigen::Vector3f& position, float max_dist,
+                        int max_age);
 
 /**
-* @brief     calculates a histogram from older pointcloud data around the
-*current vehicle postion
-* @param[]   polar_histogram_est, histogram calculated from reprojected_points
-* @param[in] reprojected_points, previous iterations occupied histogram bins
-*reprojected in 3D space
-* @param[in] reprojected_points_age, age of each reprojected point
-* @param[in]   position, current vehicle positon
+* @brief      computes the histogram bins of a batch of points. The angles are
+*computed with approxAtan2 for the whole batch at once, points closer than
+*ATAN2_APPROX_MAX_ERROR_RAD to a bin edge may be put into the neighbouring bin
+* @param[in]  cloud, pointcloud
+* @param[in]  begin, index of the first point of the batch
+* @param[in]  position, origin of the polar coordinates
+* @param[in]  res, histogram bin size [deg]
+* @param[out] batch, bins and distances to the position of the points
+*[begin, begin + n)
+* @returns    n, the number of points in the batch, smaller than
+*PointBinBatch::SIZE at the end of the cloud
 **/
-void propagateHistogram(
-    Histogram& polar_histogram_est,
-    const pcl::PointCloud<pcl::PointXYZ>& reprojected_points,
-    const std::vector<int>& reprojected_points_age,
-    const Eigen::Vector3f& position);
+int binPointBatch(const pcl::PointCloud<pcl::PointXYZ>& cloud, size_t begin,
+                  const Eigen::Vector3f& position, int res,
+                  PointBinBatch& batch);
 
 /**
 * @brief      calculates a histogram from the current frame pointcloud around
@@ -80,7 +300,8 @@ void propagateHistogram(
 * @param[in]  cropped_cloud, current frame filtered pointcloud
 * @param[in]  position, current vehicle position
 **/
-void generateNewHistogram(Histogram& polar_histogram,
+template <int RES>
+void generateNewHistogram(PolarHistogram<RES>& polar_histogram,
                           const pcl::PointCloud<pcl::PointXYZ>& cropped_cloud,
                           const Eigen::Vector3f& position);
 
@@ -98,20 +319,113 @@ void generateNewHistogram(Histogram& polar_histogram,
 * @param[in]  e_FOV_min, minimum elevation index inside the FOV
 * @param[in]  e_FOV_max, maximum elevation index inside the FOV
 **/
-void combinedHistogram(bool& hist_empty, Histogram& new_hist,
-                       const Histogram& propagated_hist,
+template <int RES>
+void combinedHistogram(bool& hist_empty, PolarHistogram<RES>& new_hist,
+                       const PolarHistogram<RES>& propagated_hist,
                        bool waypoint_outside_FOV,
                        const std::vector<int>& z_FOV_idx, int e_FOV_min,
                        int e_FOV_max);
 
+/**
+* @brief      builds the combined histogram of the current frame pointcloud and
+*the warped previous histogram in a single sweep over the histogram. Equivalent
+*to propagateHistogram, generateNewHistogram and combinedHistogram
+* @param[out] polar_histogram, combined histogram, every cell is overwritten.
+*May be the same object as previous_histogram
+* @param[out] hist_empty, true if the combined histogram is empty
+* @param[in]  cropped_cloud, current frame filtered pointcloud
+* @param[in]  previous_histogram, histogram from the previous algorithm
+*iteration
+* @param[in]  previous_position, vehicle position at which previous_histogram
+*was built
+* @param[in]  position, current vehicle position
+* @param[in]  max_dist, maximum distance of a reprojected corner to position
+* @param[in]  max_age, bins of this age or older are dropped
+* @param[in]  waypoint_outside_FOV, true if the waypoint is outside the FOV
+* @param[in]  z_FOV_mask, azimuth columns inside the FOV
+* @param[in]  e_FOV_min, minimum elevation index inside the FOV
+* @param[in]  e_FOV_max, maximum elevation index inside the FOV
+**/
+template <int RES>
+void generateCombinedHistogram(
+    PolarHistogram<RES>& polar_histogram, bool& hist_empty,
+    const pcl::PointCloud<pcl::PointXYZ>& cropped_cloud,
+    const PolarHistogram<RES>& previous_histogram,
+    const Eigen::Vector3f& previous_position, const Eigen::Vector3f& position,
+    float max_dist, int max_age, bool waypoint_outside_FOV,
+    const FOVMask& z_FOV_mask, int e_FOV_min, int e_FOV_max);
+
+/**
+* @brief      builds the combined histogram from an obstacle index instead of
+*the pointcloud. Every voxel counts as many points as it holds, so the bin
+*distances approximate the ones of the pointcloud within about a voxel size.
+*Unlike the pointcloud overload, voxels farther than max_dist from position are
+*left out like the corners of the previous histogram
+* @param[in]  obstacle_index, voxels of the current frame pointcloud
+**/
+template <int RES>
+void generateCombinedHistogram(
+    PolarHistogram<RES>& polar_histogram, bool& hist_empty,
+    const ObstacleIndex& obstacle_index,
+    const PolarHistogram<RES>& previous_histogram,
+    const Eigen::Vector3f& previous_position, const Eigen::Vector3f& position,
+    float max_dist, int max_age, bool waypoint_outside_FOV,
+    const FOVMask& z_FOV_mask, int e_FOV_min, int e_FOV_max);
+
+/**
+* @brief      builds the combined histogram when only some cameras delivered a
+*new cloud. The slices of the histogram seen by these cameras are built from
+*the points as the FOV in generateCombinedHistogram, the points outside of them
+*are left out. The other bins are the previous histogram warped to position,
+*which holds the last cloud of every other camera
+* @param[in]  z_slice_mask, e_slice_min, e_slice_max, slices seen by the cameras
+*with a new cloud, in the format of calculateFOV
+**/
+template <int RES>
+void updateHistogramSlices(
+    PolarHistogram<RES>& polar_histogram, bool& hist_empty,
+    const pcl::PointCloud<pcl::PointXYZ>& cropped_cloud,
+    const PolarHistogram<RES>& previous_histogram,
+    const Eigen::Vector3f& previous_position, const Eigen::Vector3f& position,
+    float max_dist, int max_age, bool waypoint_outside_FOV,
+    const FOVMask& z_slice_mask, int e_slice_min, int e_slice_max);
+
 /**
 * @brief      compresses the histogram such that for each azimuth the minimum
 *distance at the elevation inside the FOV is saved
 * @param[out] new_hist, compressed elevation histogram
 * @param[int] input_hist, original histogram
 **/
-void compressHistogramElevation(Histogram& new_hist,
-                                const Histogram& input_hist);
+template <int RES>
+void compressHistogramElevation(PolarHistogram<RES>& new_hist,
+                                const PolarHistogram<RES>& input_hist);
+/**
+* @brief      evaluates the cost function for every histogram bin, before the
+*distance cost is smoothed. The bins of an elevation row are evaluated as
+*array expressions with the terms that are constant per matrix or per row
+*hoisted out, the results equal costFunction. At high elevations only every
+*step_size-th bin is evaluated, where step_size bins are about as wide as one
+*bin at zero elevation, the others are interpolated
+* @param[in]  histogram, polar histogram representing obstacles
+* @param[in]  goal, current goal position
+* @param[in]  position, current vehicle position
+* @param[in]  yaw_angle_histogram_frame_deg, current vehicle heading in
+*histogram angle convention [deg]
+* @param[in]  last_sent_waypoint, last position waypoint
+* @param[in]  cost_params, weight for the cost function
+* @param[out] cost_matrix, goal, smoothness and heading costs
+* @param[out] distance_matrix, obstacle distance costs
+**/
+template <int RES>
+void evaluateCostMatrix(const PolarHistogram<RES>& histogram,
+                        const Eigen::Vector3f& goal,
+                        const Eigen::Vector3f& position,
+                        float yaw_angle_histogram_frame_deg,
+                        const Eigen::Vector3f& last_sent_waypoint,
+                        const costParameters& cost_params,
+                        Eigen::MatrixXf& cost_matrix,
+                        Eigen::MatrixXf& distance_matrix);
+
 /**
 * @brief      calculates each histogram bin cost and stores it in a cost matrix
 * @param[in]  histogram, polar histogram representing obstacles
@@ -124,8 +438,23 @@ void compressHistogramElevation(Histogram& new_hist,
 * @param[in]  parameter how far an obstacle is spread in the cost matrix
 * @param[out] cost_matrix
 * @param[out] image of the cost matrix for visualization
+* @param[in]  generate_image, if false the image is left unchanged, optional
+* @param      buffers, scratch matrices, optional
 **/
-void getCostMatrix(const Histogram& histogram, const Eigen::Vector3f& goal,
+template <int RES>
+void getCostMatrix(const PolarHistogram<RES>& histogram,
+                   const Eigen::Vector3f& goal,
+                   const Eigen::Vector3f& position,
+                   const float yaw_angle_histogram_frame_deg,
+                   const Eigen::Vector3f& last_sent_waypoint,
+                   costParameters cost_params, bool only_yawed,
+                   const float smoothing_margin_degrees,
+                   Eigen::MatrixXf& cost_matrix,
+                   std::vector<uint8_t>& image_data, bool generate_image,
+                   CostMatrixBuffers& buffers);
+template <int RES>
+void getCostMatrix(const PolarHistogram<RES>& histogram,
+                   const Eigen::Vector3f& goal,
                    const Eigen::Vector3f& position,
                    const float yaw_angle_histogram_frame_deg,
                    const Eigen::Vector3f& last_sent_waypoint,
@@ -138,9 +467,10 @@ void getCostMatrix(const Histogram& histogram, const Eigen::Vector3f& goal,
 * @brief      get the index in the data vector of a color image
 *             from the histogram index
 * @param[in] histogram index e,z and color (0=red, 1=green, 2=blue)
+* @param[in] res, histogram bin size of the image [deg]
 * @param[out] index in image data vector
 **/
-int colorImageIndex(int e_ind, int z_ind, int color);
+int colorImageIndex(int e_ind, int z_ind, int color, int res);
 
 /**
 * @brief      transform cost_matrix into an image
@@ -158,10 +488,29 @@ void generateCostImage(const Eigen::MatrixXf& cost_matrix,
 * @param[out] candidate_vector, array of candidate polar direction arranged from
 *the least to the most expensive
 **/
+template <int RES = ALPHA_RES>
 void getBestCandidatesFromCostMatrix(
     const Eigen::MatrixXf& matrix, unsigned int number_of_candidates,
     std::vector<candidateDirection>& candidate_vector);
 
+/**
+* @brief      classifies the candidate directions in increasing cost order,
+*skipping directions close to a cheaper candidate. Only the selected cells are
+*converted to polar directions
+* @param[in]  matrix, cost matrix of bin size RES
+* @param[in]  number_of_candidates, number of candidate direction to consider
+* @param[in]  min_separation_deg, minimal angle between the bin centers of two
+*candidates [deg], 0 selects the cheapest cells
+* @param[out] candidate_vector, array of candidate polar direction arranged from
+*the least to the most expensive
+* @param      buffers, scratch buffers
+**/
+template <int RES>
+void getBestCandidatesFromCostMatrix(
+    const Eigen::MatrixXf& matrix, unsigned int number_of_candidates,
+    float min_separation_deg, std::vector<candidateDirection>& candidate_vector,
+    CandidateSelectionBuffers& buffers);
+
 /**
 * @brief   computes the cost of each direction in the polar histogram
 * @param[in] e_angle, elevation angle [deg]
@@ -183,10 +532,40 @@ void costFunction(float e_angle, float z_angle, float obstacle_distance,
                   float& other_costs);
 
 /**
-* @brief   max-median filtes the cost matrix
+* @brief   computes the cost of a direction from precomputed unit vectors, the
+*          terms that don't depend on the direction are evaluated once by the
+*          caller
+* @param[in] candidate_direction, unit vector of the candidate direction
+* @param[in] heading_direction, unit vector of the vehicle heading at the
+*            candidate elevation
+* @param[in] obstacle_distance, distance to the obstacle in the candidate
+*            direction, 0 if free
+* @param[in] goal, current goal position
+* @param[in] position, current vehicle position
+* @param[in] projected_last_wp, previous waypoint projected to goal distance
+* @param[in] cost_params, weights for goal oriented vs smooth behaviour
+* @param[out] distance_cost, cost component due to proximity to obstacles
+* @param[out] other_costs, cost component due to goal and smoothness
+**/
+void costFunction(const Eigen::Vector3f& candidate_direction,
+                  const Eigen::Vector3f& heading_direction,
+                  float obstacle_distance, const Eigen::Vector3f& goal,
+                  const Eigen::Vector3f& position,
+                  const Eigen::Vector3f& projected_last_wp,
+                  const costParameters& cost_params, float& distance_cost,
+                  float& other_costs);
+
+/**
+* @brief   smoothes the cost matrix with the conic kernel of getConicKernel
+*          along the elevation and then along the azimuth, wrapping around
+*          as padPolarMatrix. The kernel is applied as two box filters with
+*          running sums, the cost per cell doesn't depend on the radius
 * @param   matrix, cost matrix
-* @param[in] smoothing_radius, median filter window size
+* @param[in] smoothing_radius, kernel radius, at most the number of rows
+* @param     box_buffer, scratch vector for the box filter sums, optional
 **/
+void smoothPolarMatrix(Eigen::MatrixXf& matrix, unsigned int smoothing_radius,
+                       Eigen::VectorXf& box_buffer);
 void smoothPolarMatrix(Eigen::MatrixXf& matrix, unsigned int smoothing_radius);
 
 /**
@@ -211,7 +590,8 @@ Eigen::ArrayXf getConicKernel(int radius);
 * @brief   helper method to output on the console the histogram
 * @param[in] histogram, polar histogram
 **/
-void printHistogram(Histogram& histogram);
+template <int RES>
+void printHistogram(const PolarHistogram<RES>& histogram);
 
 /**
 * @brief      finds the minimum cost direction in the tree
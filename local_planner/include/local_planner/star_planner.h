@@ -2,8 +2,13 @@
 #define STAR_PLANNER_H
 
 #include "box.h"
+#include "candidate_direction.h"
 #include "cost_parameters.h"
 #include "histogram.h"
+#include "monotonic_clock.h"
+#include "planner_functions.h"
+#include "thread_pool.h"
+#include "tree_node.h"
 
 #include <Eigen/Dense>
 
@@ -15,10 +20,11 @@
 #include <dynamic_reconfigure/server.h>
 #include <local_planner/LocalPlannerNodeConfig.h>
 
+#include <memory>
+#include <utility>
 #include <vector>
 
 namespace avoidance {
-class TreeNode;
 
 class StarPlanner {
   float h_FOV_ = 59.0f;
@@ -26,22 +32,60 @@ class StarPlanner {
   int children_per_node_ = 1;
   int n_expanded_nodes_ = 5;
   float tree_node_distance_ = 1.0f;
+  float tree_voxel_size_ = 0.1f;
+  int tree_expansion_batch_ = 1;
+  bool tree_warm_start_ = false;
+  float tree_time_budget_ms_ = 0.f;
   float tree_discount_factor_ = 0.8f;
   float max_path_length_ = 4.f;
   float curr_yaw_histogram_frame_deg_ = 90.f;
   float smoothing_margin_degrees_ = 30.f;
+  int histogram_resolution_ = ALPHA_RES;
+  int memory_max_age_ = 0;
+  float memory_max_dist_ = 0.f;
 
-  std::vector<int> reprojected_points_age_;
   std::vector<int> path_node_origins_;
 
-  pcl::PointCloud<pcl::PointXYZ> pointcloud_;
-  pcl::PointCloud<pcl::PointXYZ> reprojected_points_;
+  pcl::PointCloud<pcl::PointXYZ>::ConstPtr pointcloud_;
+  // voxels of pointcloud_, built once per tree for the expanded nodes
+  ObstacleIndex obstacle_index_;
+
+  // histogram of the previous iteration for every supported bin size, it is
+  // warped to the position of every expanded node
+  PolarHistogram<ALPHA_RES_FINE> memory_histogram_fine_;
+  Histogram memory_histogram_;
+  PolarHistogram<ALPHA_RES_COARSE> memory_histogram_coarse_;
+  Eigen::Vector3f memory_position_ = Eigen::Vector3f::Zero();
 
   Eigen::Vector3f goal_ = Eigen::Vector3f(NAN, NAN, NAN);
   Eigen::Vector3f projected_last_wp_ = Eigen::Vector3f::Zero();
   Eigen::Vector3f position_ = Eigen::Vector3f(NAN, NAN, NAN);
   costParameters cost_params_;
 
+  // workspace of one node expansion, there is one per node of a batch
+  struct ExpansionWorkspace {
+    Eigen::MatrixXf cost_matrix;
+    std::vector<uint8_t> cost_image_data;
+    std::vector<candidateDirection> candidate_vector;
+    CostMatrixBuffers cost_matrix_buffers;
+    CandidateSelectionBuffers selection_buffers;
+  };
+  std::vector<ExpansionWorkspace> expansion_workspaces_;
+
+  // nodes expanded in the current batch, cheapest first
+  std::vector<int> expansion_origins_;
+  // min heap of the cost and index of the open nodes. The cost of a node does
+  // not change once it is added, the heap needs no decrease key
+  std::vector<std::pair<float, int>> open_nodes_;
+  // positions of all tree nodes, for the check for close nodes
+  TreeNodeGrid node_grid_;
+
+  // workers of the batched expansion, started with the first batch
+  std::unique_ptr<ThreadPool> expansion_pool_;
+
+  // time source of the expansion deadline
+  std::shared_ptr<MonotonicClock> clock_;
+
  protected:
   /**
   * @brief     computes the cost of a node
@@ -57,11 +101,81 @@ class StarPlanner {
   **/
   float treeHeuristicFunction(int node_number);
 
+  /**
+  * @brief     buildLookAheadTree for the histogram bin size RES [deg]
+  **/
+  template <int RES>
+  int buildLookAheadTreeImpl();
+
+  /**
+  * @brief     computes the candidate directions of a node. Only reads the
+  *tree, such that the nodes of a batch can be expanded concurrently
+  * @param[in] origin, index of the expanded node
+  * @param[in] min_candidate_separation_deg, minimum angle between candidates
+  * @param[out] workspace, candidates of the node, the buffers are reused
+  **/
+  template <int RES>
+  void expandNode(int origin, float min_candidate_separation_deg,
+                  ExpansionWorkspace& workspace);
+
+  /**
+  * @brief     adds a node to the tree and the grid and computes its costs
+  * @param[in] origin, index of the parent node
+  * @param[in] p_pol, direction from the parent to the node
+  * @param[in] node_location, position of the node
+  **/
+  void addNode(int origin, const PolarPoint& p_pol,
+               const Eigen::Vector3f& node_location);
+
+  /**
+  * @brief     adds a node to the open nodes if it is reachable and within the
+  *maximum path length
+  * @param[in] node, index of the node
+  **/
+  void openNode(int node);
+
+  /**
+  * @brief     re-roots the path of the previous tree at the vehicle position.
+  *The path nodes beyond the one closest to the vehicle are added to the tree
+  *with their costs re-evaluated, up to the first segment which is obstructed
+  *by the current cloud
+  * @param[in] min_node_distance, minimum distance between two nodes [m]
+  * @returns   number of path nodes added to the tree
+  **/
+  int reusePreviousPath(float min_node_distance);
+
+  /**
+  * @brief     adds the candidates of an expanded node to the tree, the grid
+  *and the open nodes, and closes the expanded node
+  * @param[in] origin, index of the expanded node
+  * @param[in] candidate_vector, candidates computed by expandNode
+  * @param[in] min_node_distance, candidates closer than this to any node of
+  *the tree are dropped [m]
+  **/
+  void addChildren(int origin,
+                   const std::vector<candidateDirection>& candidate_vector,
+                   float min_node_distance);
+
+  /**
+  * @brief     selects the cheapest open nodes within the maximum path length
+  *as the origins of the next batch. The origins are left unchanged if no node
+  *is open
+  * @param[in] n_nodes, maximum number of selected nodes
+  **/
+  void selectOpenNodes(size_t n_nodes);
+
+  /**
+  * @brief     getter method for the obstacle memory of a bin size
+  * @returns   histogram of the previous iteration of the bin size RES
+  **/
+  template <int RES>
+  PolarHistogram<RES>& memoryHistogram();
+
  public:
   std::vector<Eigen::Vector3f> path_node_positions_;
   std::vector<int> closed_set_;
   int tree_age_;
-  std::vector<TreeNode> tree_;
+  Tree tree_;
 
   StarPlanner();
   ~StarPlanner() = default;
@@ -86,15 +200,16 @@ class StarPlanner {
   void setFOV(float h_FOV, float v_FOV);
 
   /**
-  * @brief     setter method for reprojected pointcloud
-  * @param[in] reprojected_points, pointcloud from previous frames reprojected
-  *            around the vehicle current position
-  * @param[in] reprojected_points_age, array containing the age of each
-  *            reprojected point
+  * @brief     setter method for the obstacle memory
+  * @param[in] histogram, histogram from the previous algorithm iteration
+  * @param[in] position, vehicle position at which histogram was built
+  * @param[in] max_age, bins of this age or older are dropped
+  * @param[in] max_dist, maximum distance of the reprojected bins to a node
   **/
-  void setReprojectedPoints(
-      const pcl::PointCloud<pcl::PointXYZ>& reprojected_points,
-      const std::vector<int>& reprojected_points_age);
+  template <int RES>
+  void setObstacleMemory(const PolarHistogram<RES>& histogram,
+                         const Eigen::Vector3f& position, int max_age,
+                         float max_dist);
 
   /**
   * @brief     setter method for vehicle position
@@ -111,14 +226,24 @@ class StarPlanner {
 
   /**
   * @brief     setter method for pointcloud
-  * @param[in] cropped_cloud, current point cloud cropped around the vehicle
+  * @param[in] cropped_cloud, current point cloud cropped around the vehicle.
+  *The cloud is shared, not copied, and must not be modified afterwards
+  **/
+  void setCloud(const pcl::PointCloud<pcl::PointXYZ>::ConstPtr& cropped_cloud);
+
+  /**
+  * @brief     setter method for the clock of the expansion deadline
+  * @param[in] clock, monotonic time source, replaces the steady clock
   **/
-  void setCloud(const pcl::PointCloud<pcl::PointXYZ>& cropped_cloud);
+  void setClock(std::shared_ptr<MonotonicClock> clock);
 
   /**
-  * @brief     build tree of candidates directions towards the goal
+  * @brief     build tree of candidates directions towards the goal. The
+  *cheapest open nodes are expanded until n_expanded_nodes_ nodes are expanded
+  *or the time budget runs out, the cheapest open node ends the path
+  * @returns   number of expanded nodes
   **/
-  void buildLookAheadTree();
+  int buildLookAheadTree();
 
   /**
   * @brief     setter method for server paramters
@@ -0,0 +1,71 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace avoidance {
+
+/**
+* @brief fixed size pool of worker threads which execute the iterations of a
+*loop in parallel. The threads are started once and sleep between the loops,
+*so that the per-cycle work does not pay for thread creation.
+**/
+class ThreadPool {
+ public:
+  /**
+  * @brief     starts the worker threads
+  * @param[in] n_workers, number of threads in addition to the calling thread,
+  *with zero workers all loops run sequentially on the calling thread
+  **/
+  explicit ThreadPool(size_t n_workers);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  /**
+  * @brief     calls task(i) for every i in [0, n) and returns once all calls
+  *have finished. The calling thread takes part in the work. The iterations
+  *must be independent of each other and must not throw.
+  * @param[in] n, number of iterations
+  * @param[in] task, loop body
+  **/
+  void parallelFor(size_t n, const std::function<void(size_t)>& task);
+
+  /**
+  * @returns   number of threads executing a loop, including the caller
+  **/
+  size_t concurrency() const { return workers_.size() + 1; }
+
+ private:
+  std::vector<std::thread> workers_;
+
+  std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  std::mutex loop_mutex_;  ///< serializes concurrent calls to parallelFor
+
+  // state of the current loop, guarded by mutex_
+  const std::function<void(size_t)>* task_ = nullptr;
+  size_t n_iterations_ = 0;
+  size_t next_iteration_ = 0;
+  size_t n_finished_ = 0;
+  unsigned long generation_ = 0;
+  bool should_exit_ = false;
+
+  void workerFunction();
+
+  /**
+  * @brief     executes iterations of the current loop until none are left
+  * @param     lock, lock on mutex_, released while a task is running
+  **/
+  void runIterations(std::unique_lock<std::mutex>& lock);
+};
+}
+
+#endif  // THREAD_POOL_H
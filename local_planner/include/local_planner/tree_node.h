@@ -2,38 +2,103 @@
 #define TREE_NODE_H
 
 #include <Eigen/Core>
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 
 namespace avoidance {
 
-class TreeNode {
-  Eigen::Vector3f position_;
+/**
+* @brief     nodes of the search tree as a structure of arrays, node i is
+*described by the i-th entry of every array. The cost comparisons and the walks
+*along the parents only touch the arrays they need. The arrays are reserved for
+*the whole tree and keep their capacity for the next tree.
+**/
+struct Tree {
+  std::vector<Eigen::Vector3f> position;
+  // cost of the path to the node plus the heuristic to the goal
+  std::vector<float> total_cost;
+  std::vector<float> heuristic;
+  // direction of the segment from the parent to the node [deg]
+  std::vector<float> last_e;
+  std::vector<float> last_z;
+  std::vector<float> yaw;
+  // index of the parent node, the root is its own parent
+  std::vector<int> origin;
+  // number of segments between the root and the node
+  std::vector<int> depth;
 
+  /**
+  * @brief     adds a node with zero costs and angles
+  * @param[in] from, index of the parent node
+  * @param[in] d, depth of the node
+  * @param[in] pos, node position
+  * @returns   index of the node
+  **/
+  int addNode(int from, int d, const Eigen::Vector3f& pos);
+
+  /**
+  * @brief     removes all nodes, the capacity is kept
+  **/
+  void clear();
+
+  /**
+  * @brief     reserves the arrays for a number of nodes
+  * @param[in] n_nodes, maximum number of nodes of the tree
+  **/
+  void reserve(size_t n_nodes);
+
+  size_t size() const { return origin.size(); }
+  size_t capacity() const { return origin.capacity(); }
+};
+
+/**
+* @brief     spatial hash of the tree node positions. The cells are as large as
+*the merge radius of the tree, such that the search for close nodes only
+*visits the 27 cells around a position instead of every node of the tree
+**/
+class TreeNodeGrid {
  public:
-  float total_cost_;
-  float heuristic_;
-  float last_e_;
-  float last_z_;
-  int origin_;
-  int depth_;
-  float yaw_;
-
-  TreeNode();
-  TreeNode(int from, int d, const Eigen::Vector3f& pos);
-  ~TreeNode() = default;
+  /**
+  * @brief     removes all nodes, the buffers are kept for the next tree
+  * @param[in] origin, position the cells are aligned to, e.g. the tree root
+  * @param[in] cell_size, cell edge length, largest radius of hasNodeWithin [m]
+  * @param[in] max_nodes, maximum number of nodes inserted until the next reset
+  **/
+  void reset(const Eigen::Vector3f& origin, float cell_size, size_t max_nodes);
 
   /**
-  * @brief     setter method for heuristic and cost of a tree node
-  * @param[in] h, heuristic
-  * @param[in] c, cost
+  * @brief     adds a node position to the grid
+  * @param[in] position, node position
   **/
-  void setCosts(float h, float c);
+  void insert(const Eigen::Vector3f& position);
+
+  /**
+  * @brief     checks if any inserted node is closer to a position than radius
+  * @param[in] position, queried position
+  * @param[in] radius, search radius, at most the cell size [m]
+  * @returns   true if a node lies within the radius
+  **/
+  bool hasNodeWithin(const Eigen::Vector3f& position, float radius) const;
+
+ private:
+  Eigen::Vector3f origin_ = Eigen::Vector3f::Zero();
+  float inv_cell_size_ = 1.f;
+  int table_bits_ = 0;
+
+  // open addressing hash table from cell key to the last node of the cell
+  std::vector<uint64_t> keys_;
+  std::vector<int> last_node_;
+  // position of every node and the previous node in the same cell
+  std::vector<Eigen::Vector3f> positions_;
+  std::vector<int> previous_node_;
 
   /**
-  * @brief     getter method for tree node position
-  * @returns   node position in 3D cartesian coordinates
+  * @brief     getter method for the hash table slot of a cell
+  * @param[in] key, cell key
+  * @returns   slot holding the cell, or the empty slot the cell would go to
   **/
-  Eigen::Vector3f getPosition();
+  size_t findSlot(uint64_t key) const;
 };
 }
 
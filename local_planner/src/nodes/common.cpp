@@ -31,12 +31,28 @@ float indexAngleDifference(float a, float b) {
 }
 
 PolarPoint histogramIndexToPolar(int e, int z, int res, float radius) {
-  // ALPHA_RES%2=0 as per definition, see histogram.h
-  PolarPoint p_pol(static_cast<float>(e * res + res / 2 - 90),
-                   static_cast<float>(z * res + res / 2 - 180), radius);
+  // bin center, the half bin size isn't an integer for odd resolutions
+  PolarPoint p_pol(e * res + res / 2.0f - 90.0f,
+                   z * res + res / 2.0f - 180.0f, radius);
   return p_pol;
 }
 
+float approxAtan2(float y, float x) {
+  const float ax = std::abs(x);
+  const float ay = std::abs(y);
+  const float a = ax > ay ? ay / ax : (ay > 0.f ? ax / ay : 0.f);
+  const float s = a * a;
+  float r =
+      a * (ATAN2_COEFFS[0] +
+           s * (ATAN2_COEFFS[1] +
+                s * (ATAN2_COEFFS[2] +
+                     s * (ATAN2_COEFFS[3] + s * ATAN2_COEFFS[4]))));
+  if (ay > ax) r = M_PI_F / 2.f - r;
+  if (x < 0.f) r = M_PI_F - r;
+  if (y < 0.f) r = -r;
+  return r;
+}
+
 PolarPoint cartesianToPolar(const Eigen::Vector3f& pos,
                             const Eigen::Vector3f& origin) {
   return cartesianToPolar(pos.x(), pos.y(), pos.z(), origin);
@@ -181,6 +197,19 @@ Eigen::Quaternionf toEigen(const geometry_msgs::Quaternion& gmq) {
   return eqf;
 }
 
+Eigen::Affine3f toEigen(const tf::Transform& tf_transform) {
+  Eigen::Affine3f eaf = Eigen::Affine3f::Identity();
+  const tf::Matrix3x3& basis = tf_transform.getBasis();
+  for (int row = 0; row < 3; row++) {
+    for (int col = 0; col < 3; col++) {
+      eaf.linear()(row, col) = static_cast<float>(basis[row][col]);
+    }
+  }
+  const tf::Vector3& origin = tf_transform.getOrigin();
+  eaf.translation() = Eigen::Vector3f(origin.x(), origin.y(), origin.z());
+  return eaf;
+}
+
 geometry_msgs::Point toPoint(const Eigen::Vector3f& ev3) {
   geometry_msgs::Point gmp;
   gmp.x = ev3.x();
@@ -1,67 +1,107 @@
 #include "local_planner/histogram.h"
-#include <stdexcept>
 
 namespace avoidance {
-Histogram::Histogram(const int res)
-    : resolution_{res},
-      z_dim_{360 / resolution_},
-      e_dim_{180 / resolution_},
-      age_(e_dim_, z_dim_),
-      dist_(e_dim_, z_dim_) {
+template <int RES>
+PolarHistogram<RES>::PolarHistogram() {
   setZero();
 }
 
-void Histogram::upsample() {
-  if (resolution_ != ALPHA_RES * 2) {
-    throw std::logic_error(
-        "Invalid use of function upsample(). This function can only be used on "
-        "a half resolution histogram.");
-  }
-  resolution_ = resolution_ / 2;
-  z_dim_ = 2 * z_dim_;
-  e_dim_ = 2 * e_dim_;
-  Eigen::MatrixXi temp_age(e_dim_, z_dim_);
-  Eigen::MatrixXf temp_dist(e_dim_, z_dim_);
+template <int RES>
+void PolarHistogram<RES>::setZero() {
+  age_.setZero();
+  dist_.setZero();
+}
 
-  for (int i = 0; i < e_dim_; ++i) {
-    for (int j = 0; j < z_dim_; ++j) {
-      int i_lowres = floor(i / 2);
-      int j_lowres = floor(j / 2);
-      temp_age(i, j) = age_(i_lowres, j_lowres);
-      temp_dist(i, j) = dist_(i_lowres, j_lowres);
+template <int RES>
+void upsample(const PolarHistogram<2 * RES>& low_res_histogram,
+              PolarHistogram<RES>& histogram) {
+  for (int i = 0; i < PolarHistogram<RES>::E_DIM; ++i) {
+    for (int j = 0; j < PolarHistogram<RES>::Z_DIM; ++j) {
+      int i_lowres = i / 2;
+      int j_lowres = j / 2;
+      histogram.set_age(i, j, low_res_histogram.age(i_lowres, j_lowres));
+      histogram.set_dist(i, j, low_res_histogram.dist(i_lowres, j_lowres));
     }
   }
-  age_ = temp_age;
-  dist_ = temp_dist;
 }
 
-void Histogram::downsample() {
-  if (resolution_ != ALPHA_RES) {
-    throw std::logic_error(
-        "Invalid use of function downsample(). This function can only be used "
-        "on a full resolution histogram.");
-  }
-  resolution_ = 2 * resolution_;
-  z_dim_ = z_dim_ / 2;
-  e_dim_ = e_dim_ / 2;
-  Eigen::MatrixXi temp_age(e_dim_, z_dim_);
-  Eigen::MatrixXf temp_dist(e_dim_, z_dim_);
-
-  for (int i = 0; i < e_dim_; ++i) {
-    for (int j = 0; j < z_dim_; ++j) {
+template <int RES>
+void downsample(const PolarHistogram<RES>& histogram,
+                PolarHistogram<2 * RES>& low_res_histogram) {
+  for (int i = 0; i < PolarHistogram<2 * RES>::E_DIM; ++i) {
+    for (int j = 0; j < PolarHistogram<2 * RES>::Z_DIM; ++j) {
       int i_high_res = 2 * i;
       int j_high_res = 2 * j;
-      temp_age(i, j) =
-          static_cast<int>(age_.block(i_high_res, j_high_res, 2, 2).mean());
-      temp_dist(i, j) = dist_.block(i_high_res, j_high_res, 2, 2).mean();
+      int age_sum = histogram.age(i_high_res, j_high_res) +
+                    histogram.age(i_high_res + 1, j_high_res) +
+                    histogram.age(i_high_res, j_high_res + 1) +
+                    histogram.age(i_high_res + 1, j_high_res + 1);
+      float dist_sum = histogram.dist(i_high_res, j_high_res) +
+                       histogram.dist(i_high_res + 1, j_high_res) +
+                       histogram.dist(i_high_res, j_high_res + 1) +
+                       histogram.dist(i_high_res + 1, j_high_res + 1);
+      low_res_histogram.set_age(i, j, age_sum / 4);
+      low_res_histogram.set_dist(i, j, dist_sum / 4.f);
+    }
+  }
+}
+
+// unit vector of the elevation and azimuth angles [deg], matches
+// polarToCartesian
+static Eigen::Vector3f unitVector(double e_deg, double z_deg) {
+  const double e = e_deg * M_PI / 180.0;
+  const double z = z_deg * M_PI / 180.0;
+  return Eigen::Vector3f(static_cast<float>(std::cos(e) * std::sin(z)),
+                         static_cast<float>(std::cos(e) * std::cos(z)),
+                         static_cast<float>(std::sin(e)));
+}
+
+template <int RES>
+HistogramLookupTable<RES>::HistogramLookupTable() {
+  for (int e = 0; e < E_DIM; e++) {
+    const double e_center = e * RES + RES / 2.0 - 90.0;
+    elevation_bin_width_[e] =
+        static_cast<float>(std::cos(e_center * M_PI / 180.0));
+    for (int z = 0; z < Z_DIM; z++) {
+      const double z_center = z * RES + RES / 2.0 - 180.0;
+      center_[e * Z_DIM + z] = unitVector(e_center, z_center);
+      center_x_[e * Z_DIM + z] = center_[e * Z_DIM + z].x();
+      center_y_[e * Z_DIM + z] = center_[e * Z_DIM + z].y();
+    }
+  }
+  for (int e = 0; e <= E_DIM; e++) {
+    for (int z = 0; z <= Z_DIM; z++) {
+      corner_[e * (Z_DIM + 1) + z] =
+          unitVector(e * RES - 90.0, z * RES - 180.0);
     }
   }
-  age_ = temp_age;
-  dist_ = temp_dist;
 }
 
-void Histogram::setZero() {
-  age_.fill(0);
-  dist_.fill(0.f);
+template <int RES>
+const HistogramLookupTable<RES>& HistogramLookupTable<RES>::get() {
+  static const HistogramLookupTable<RES> table;
+  return table;
 }
+
+// instantiate the histograms of the supported bin sizes and their half
+// resolution counterparts, 2 * ALPHA_RES_FINE equals ALPHA_RES
+template class PolarHistogram<ALPHA_RES_FINE>;
+template class PolarHistogram<ALPHA_RES>;
+template class PolarHistogram<2 * ALPHA_RES>;
+template class PolarHistogram<ALPHA_RES_COARSE>;
+template class PolarHistogram<2 * ALPHA_RES_COARSE>;
+
+#define INSTANTIATE_RESAMPLING(RES)                                      \
+  template void upsample<RES>(const PolarHistogram<2 * RES>&,            \
+                              PolarHistogram<RES>&);                     \
+  template void downsample<RES>(const PolarHistogram<RES>&,              \
+                                PolarHistogram<2 * RES>&);
+
+INSTANTIATE_RESAMPLING(ALPHA_RES_FINE)
+INSTANTIATE_RESAMPLING(ALPHA_RES)
+INSTANTIATE_RESAMPLING(ALPHA_RES_COARSE)
+
+template class HistogramLookupTable<ALPHA_RES_FINE>;
+template class HistogramLookupTable<ALPHA_RES>;
+template class HistogramLookupTable<ALPHA_RES_COARSE>;
 }
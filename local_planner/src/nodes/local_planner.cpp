@@ -9,10 +9,30 @@
 
 namespace avoidance {
 
-LocalPlanner::LocalPlanner() : star_planner_(new StarPlanner()) {}
+LocalPlanner::LocalPlanner()
+    : star_planner_(new StarPlanner()),
+      final_cloud_(new pcl::PointCloud<pcl::PointXYZ>()) {
+  goal_dist_incline_.reserve(dist_incline_window_size_ + 1);
+}
 
 LocalPlanner::~LocalPlanner() {}
 
+template <>
+PolarHistogram<ALPHA_RES_FINE> &LocalPlanner::polarHistogram<ALPHA_RES_FINE>() {
+  return polar_histogram_fine_;
+}
+
+template <>
+PolarHistogram<ALPHA_RES> &LocalPlanner::polarHistogram<ALPHA_RES>() {
+  return polar_histogram_;
+}
+
+template <>
+PolarHistogram<ALPHA_RES_COARSE> &
+LocalPlanner::polarHistogram<ALPHA_RES_COARSE>() {
+  return polar_histogram_coarse_;
+}
+
 // update UAV pose
 void LocalPlanner::setPose(const Eigen::Vector3f &pos,
                            const Eigen::Quaternionf &q) {
@@ -53,6 +73,23 @@ void LocalPlanner::dynamicReconfigureSetParams(
   n_expanded_nodes_ = config.n_expanded_nodes_;
   smoothing_margin_degrees_ =
       static_cast<float>(config.smoothing_margin_degrees_);
+  voxel_leaf_size_ = static_cast<float>(config.voxel_leaf_size_);
+  voxel_leaf_size_growth_ = static_cast<float>(config.voxel_leaf_size_growth_);
+  max_cloud_points_ = config.max_cloud_points_;
+
+  int histogram_resolution = config.histogram_resolution_;
+  if (!isSupportedResolution(histogram_resolution)) {
+    ROS_WARN("[OA] Histogram resolution %d deg not supported, using %d deg",
+             histogram_resolution, ALPHA_RES);
+    histogram_resolution = ALPHA_RES;
+  }
+  if (histogram_resolution != histogram_resolution_) {
+    // the obstacle memory of the other bin sizes is outdated
+    polar_histogram_fine_.setZero();
+    polar_histogram_.setZero();
+    polar_histogram_coarse_.setZero();
+    histogram_resolution_ = histogram_resolution;
+  }
 
   if (getGoal().z() != config.goal_z_param) {
     auto goal = getGoal();
@@ -65,6 +102,7 @@ void LocalPlanner::dynamicReconfigureSetParams(
   use_back_off_ = config.use_back_off_;
   use_VFH_star_ = config.use_VFH_star_;
   adapt_cost_params_ = config.adapt_cost_params_;
+  downsample_cloud_ = config.downsample_cloud_;
   send_obstacles_fcu_ = config.send_obstacles_fcu_;
 
   star_planner_->dynamicReconfigureSetStarParams(config, level);
@@ -92,53 +130,104 @@ void LocalPlanner::runPlanner() {
   ROS_INFO("\033[1;35m[OA] Planning started, using %i cameras\n \033[0m",
            static_cast<int>(complete_cloud_.size()));
 
-  // calculate Field of View
-  z_FOV_idx_.clear();
-  calculateFOV(h_FOV_, v_FOV_, z_FOV_idx_, e_FOV_min_, e_FOV_max_,
-               curr_yaw_histogram_frame_deg_, curr_pitch_deg_);
-
   histogram_box_.setBoxLimits(position_, ground_distance_);
 
-  filterPointCloud(final_cloud_, closest_point_, distance_to_closest_point_,
+  // the cloud of the cycle is built once and then shared without copies. It
+  // is built in the storage of the cloud before the last one, unless the
+  // publisher or the star planner still read that one
+  pcl::PointCloud<pcl::PointXYZ>::Ptr final_cloud;
+  final_cloud.swap(previous_final_cloud_);
+  if (!final_cloud || final_cloud.use_count() > 1) {
+    final_cloud.reset(new pcl::PointCloud<pcl::PointXYZ>());
+  }
+  filterPointCloud(*final_cloud, closest_point_, distance_to_closest_point_,
                    counter_close_points_backoff_, complete_cloud_,
                    min_cloud_size_, min_dist_backoff_, histogram_box_,
                    position_, min_realsense_dist_);
 
+  // the strategy decisions are based on the number of measured points, the
+  // downsampled cloud is only used to build the histograms
+  cropped_cloud_size_ = final_cloud->points.size();
+  if (downsample_cloud_) {
+    downsamplePointCloud(*final_cloud, position_, voxel_leaf_size_,
+                         voxel_leaf_size_growth_, max_cloud_points_,
+                         voxel_grid_buffers_);
+    ROS_DEBUG(
+        "\033[0;35m[OA] Downsampled pointcloud: %zu -> %zu points\033[0m",
+        cropped_cloud_size_, final_cloud->points.size());
+  }
+  previous_final_cloud_.swap(final_cloud_);
+  final_cloud_.swap(final_cloud);
+
   determineStrategy();
 }
 
+template <int RES>
 void LocalPlanner::create2DObstacleRepresentation(const bool send_to_fcu) {
   // construct histogram if it is needed
   // or if it is required by the FCU
-  reprojectPoints(polar_histogram_);
-  Histogram propagated_histogram = Histogram(2 * ALPHA_RES);
-  Histogram new_histogram = Histogram(ALPHA_RES);
-  to_fcu_histogram_.setZero();
-
-  propagateHistogram(propagated_histogram, reprojected_points_,
-                     reprojected_points_age_, position_);
-  generateNewHistogram(new_histogram, final_cloud_, position_);
-  combinedHistogram(hist_is_empty_, new_histogram, propagated_histogram,
-                    waypoint_outside_FOV_, z_FOV_idx_, e_FOV_min_, e_FOV_max_);
+  PolarHistogram<RES> &polar_histogram = polarHistogram<RES>();
+  const float max_memory_dist = 2.0f * histogram_box_.radius_;
+  if (use_VFH_star_) {
+    star_planner_->setObstacleMemory(polar_histogram, position_old_,
+                                     reproj_age_, max_memory_dist);
+  }
+
+  // the histogram of the previous iteration is the obstacle memory, it is
+  // warped to the current position and rebuilt in place
+  if (camera_slices_.empty()) {
+    generateCombinedHistogram(polar_histogram, hist_is_empty_, *final_cloud_,
+                              polar_histogram, position_old_, position_,
+                              max_memory_dist, reproj_age_,
+                              waypoint_outside_FOV_, z_FOV_mask_, e_FOV_min_,
+                              e_FOV_max_);
+  } else {
+    // only the slices of the cameras with a new cloud are rebuilt from the
+    // cloud, the others keep the last cloud of their camera from the memory.
+    // The elevation range spans the ones of all these cameras
+    const float camera_h_FOV = h_FOV_ / camera_slices_.size();
+    FOVMask z_slice_mask, camera_z_mask;
+    int e_slice_min = PolarHistogram<RES>::E_DIM;
+    int e_slice_max = -1;
+    for (const CameraSlice &slice : camera_slices_) {
+      if (!slice.updated) continue;
+      int camera_e_min, camera_e_max;
+      calculateFOV<RES>(camera_h_FOV, v_FOV_, camera_z_mask, camera_e_min,
+                        camera_e_max, slice.direction.z, slice.direction.e);
+      z_slice_mask |= camera_z_mask;
+      e_slice_min = std::min(e_slice_min, camera_e_min);
+      e_slice_max = std::max(e_slice_max, camera_e_max);
+    }
+    updateHistogramSlices(polar_histogram, hist_is_empty_, *final_cloud_,
+                          polar_histogram, position_old_, position_,
+                          max_memory_dist, reproj_age_, waypoint_outside_FOV_,
+                          z_slice_mask, e_slice_min, e_slice_max);
+  }
   if (send_to_fcu) {
-    compressHistogramElevation(to_fcu_histogram_, new_histogram);
-    updateObstacleDistanceMsg(to_fcu_histogram_);
+    PolarHistogram<RES> to_fcu_histogram;
+    compressHistogramElevation(to_fcu_histogram, polar_histogram);
+    updateObstacleDistanceMsg(to_fcu_histogram);
   }
-  polar_histogram_ = new_histogram;
 
   // generate histogram image for logging
-  generateHistogramImage(polar_histogram_);
+  if (generate_histogram_image_) {
+    generateHistogramImage(polar_histogram);
+  } else {
+    histogram_image_data_.clear();
+  }
 }
 
-void LocalPlanner::generateHistogramImage(Histogram &histogram) {
+template <int RES>
+void LocalPlanner::generateHistogramImage(
+    const PolarHistogram<RES> &histogram) {
   histogram_image_data_.clear();
-  histogram_image_data_.reserve(GRID_LENGTH_E * GRID_LENGTH_Z);
+  histogram_image_data_.reserve(PolarHistogram<RES>::E_DIM *
+                                PolarHistogram<RES>::Z_DIM);
 
   // fill image data
-  for (int e = GRID_LENGTH_E - 1; e >= 0; e--) {
-    for (int z = 0; z < GRID_LENGTH_Z; z++) {
-      float depth_val =
-          255.f * histogram.get_dist(e, z) / histogram_box_.radius_;
+  for (int e = PolarHistogram<RES>::E_DIM - 1; e >= 0; e--) {
+    for (int z = 0; z < PolarHistogram<RES>::Z_DIM; z++) {
+      float depth_val = 255.f * histogram.dist(e, z) / histogram_box_.radius_;
       histogram_image_data_.push_back(
           (int)std::max(0.0f, std::min(255.f, depth_val)));
     }
@@ -146,11 +235,33 @@ void LocalPlanner::generateHistogramImage(Histogram &histogram) {
 }
 
 void LocalPlanner::determineStrategy() {
+  switch (histogram_resolution_) {
+    case ALPHA_RES_FINE:
+      determineStrategyImpl<ALPHA_RES_FINE>();
+      break;
+    case ALPHA_RES_COARSE:
+      determineStrategyImpl<ALPHA_RES_COARSE>();
+      break;
+    default:
+      determineStrategyImpl<ALPHA_RES>();
+      break;
+  }
+}
+
+template <int RES>
+void LocalPlanner::determineStrategyImpl() {
   star_planner_->tree_age_++;
 
+  // calculate Field of View
+  calculateFOV<RES>(h_FOV_, v_FOV_, z_FOV_mask_, e_FOV_min_, e_FOV_max_,
+                    curr_yaw_histogram_frame_deg_, curr_pitch_deg_);
+
   // clear cost image
   cost_image_data_.clear();
-  cost_image_data_.resize(3 * GRID_LENGTH_E * GRID_LENGTH_Z, 0);
+  if (generate_cost_image_) {
+    cost_image_data_.resize(
+        3 * PolarHistogram<RES>::E_DIM * PolarHistogram<RES>::Z_DIM, 0);
+  }
 
   if (disable_rise_to_goal_altitude_) {
     reach_altitude_ = true;
@@ -168,9 +279,9 @@ void LocalPlanner::determineStrategy() {
     }
 
     if (send_obstacles_fcu_) {
-      create2DObstacleRepresentation(true);
+      create2DObstacleRepresentation<RES>(true);
     }
-  } else if (final_cloud_.points.size() > min_cloud_size_ && stop_in_front_ &&
+  } else if (cropped_cloud_size_ > min_cloud_size_ && stop_in_front_ &&
              reach_altitude_) {
     obstacle_ = true;
     ROS_INFO(
@@ -179,11 +290,11 @@ void LocalPlanner::determineStrategy() {
     waypoint_type_ = direct;
 
     if (send_obstacles_fcu_) {
-      create2DObstacleRepresentation(true);
+      create2DObstacleRepresentation<RES>(true);
     }
   } else {
     if (((counter_close_points_backoff_ > 200 &&
-          final_cloud_.points.size() > min_cloud_size_) ||
+          cropped_cloud_size_ > min_cloud_size_) ||
          back_off_) &&
         reach_altitude_ && use_back_off_) {
       if (!back_off_) {
@@ -198,13 +309,13 @@ void LocalPlanner::determineStrategy() {
       }
       waypoint_type_ = goBack;
       if (send_obstacles_fcu_) {
-        create2DObstacleRepresentation(true);
+        create2DObstacleRepresentation<RES>(true);
       }
 
     } else {
       evaluateProgressRate();
 
-      create2DObstacleRepresentation(send_obstacles_fcu_);
+      create2DObstacleRepresentation<RES>(send_obstacles_fcu_);
 
       // decide how to proceed
       if (hist_is_empty_) {
@@ -215,16 +326,16 @@ void LocalPlanner::determineStrategy() {
       if (!hist_is_empty_ && reach_altitude_) {
         obstacle_ = true;
 
-        getCostMatrix(
-            polar_histogram_, goal_, position_, curr_yaw_histogram_frame_deg_,
-            last_sent_waypoint_, cost_params_, velocity_.norm() < 0.1f,
-            smoothing_margin_degrees_, cost_matrix_, cost_image_data_);
+        getCostMatrix(polarHistogram<RES>(), goal_, position_,
+                      curr_yaw_histogram_frame_deg_, last_sent_waypoint_,
+                      cost_params_, velocity_.norm() < 0.1f,
+                      smoothing_margin_degrees_, cost_matrix_,
+                      cost_image_data_, generate_cost_image_,
+                      cost_matrix_buffers_);
 
         if (use_VFH_star_) {
           star_planner_->setParams(cost_params_);
           star_planner_->setFOV(h_FOV_, v_FOV_);
-          star_planner_->setReprojectedPoints(reprojected_points_,
-                                              reprojected_points_age_);
           star_planner_->setCloud(final_cloud_);
 
           // set last chosen direction for smoothing
@@ -241,7 +352,9 @@ void LocalPlanner::determineStrategy() {
           waypoint_type_ = tryPath;
           last_path_time_ = ros::Time::now();
         } else {
-          getBestCandidatesFromCostMatrix(cost_matrix_, 1, candidate_vector_);
+          getBestCandidatesFromCostMatrix<RES>(cost_matrix_, 1, 0.f,
+                                               candidate_vector_,
+                                               candidate_selection_buffers_);
 
           if (candidate_vector_.empty()) {
             stopInFrontObstacles();
@@ -264,60 +377,49 @@ void LocalPlanner::determineStrategy() {
   position_old_ = position_;
 }
 
-void LocalPlanner::updateObstacleDistanceMsg(Histogram hist) {
-  sensor_msgs::LaserScan msg = {};
+template <int RES>
+void LocalPlanner::updateObstacleDistanceMsg(const PolarHistogram<RES> &hist) {
+  const int Z_DIM = PolarHistogram<RES>::Z_DIM;
+  // the message is filled in place to reuse the buffer of the ranges
+  sensor_msgs::LaserScan &msg = distance_data_;
   msg.header.stamp = ros::Time::now();
   msg.header.frame_id = "local_origin";
-  msg.angle_increment = static_cast<double>(ALPHA_RES) * M_PI / 180.0;
+  msg.angle_increment = static_cast<double>(RES) * M_PI / 180.0;
   msg.range_min = 0.2f;
   msg.range_max = 20.0f;
 
-  // turn idxs 180 degress to point to local north instead of south
-  std::vector<int> z_FOV_idx_north;
-  z_FOV_idx_north.reserve(z_FOV_idx_.size());
+  msg.ranges.clear();
+  msg.ranges.reserve(Z_DIM);
+  for (int idx = 0; idx < Z_DIM; idx++) {
+    float range;
 
-  for (size_t i = 0; i < z_FOV_idx_.size(); i++) {
-    int new_idx = z_FOV_idx_[i] + GRID_LENGTH_Z / 2;
+    // turn idxs 180 degress to point to local north instead of south
+    int hist_idx = idx - Z_DIM / 2;
 
-    if (new_idx >= GRID_LENGTH_Z) {
-      new_idx = new_idx - GRID_LENGTH_Z;
+    if (hist_idx < 0) {
+      hist_idx = hist_idx + Z_DIM;
     }
 
-    z_FOV_idx_north.push_back(new_idx);
-  }
-
-  msg.ranges.reserve(GRID_LENGTH_Z);
-  for (int idx = 0; idx < GRID_LENGTH_Z; idx++) {
-    float range;
-
-    if (std::find(z_FOV_idx_north.begin(), z_FOV_idx_north.end(), idx) ==
-        z_FOV_idx_north.end()) {
+    if (!z_FOV_mask_[hist_idx]) {
       range = UINT16_MAX;
     } else {
-      int hist_idx = idx - GRID_LENGTH_Z / 2;
-
-      if (hist_idx < 0) {
-        hist_idx = hist_idx + GRID_LENGTH_Z;
-      }
-
-      if (hist.get_dist(0, hist_idx) == 0.0f) {
+      if (hist.dist(0, hist_idx) == 0.0f) {
         range = msg.range_max + 1.0f;
       } else {
-        range = hist.get_dist(0, hist_idx);
+        range = hist.dist(0, hist_idx);
       }
     }
 
     msg.ranges.push_back(range);
   }
-
-  distance_data_ = msg;
 }
 
 void LocalPlanner::updateObstacleDistanceMsg() {
   sensor_msgs::LaserScan msg = {};
   msg.header.stamp = ros::Time::now();
   msg.header.frame_id = "local_origin";
-  msg.angle_increment = static_cast<double>(ALPHA_RES) * M_PI / 180.0;
+  msg.angle_increment =
+      static_cast<double>(histogram_resolution_) * M_PI / 180.0;
   msg.range_min = 0.2f;
   msg.range_max = 20.0f;
 
@@ -325,56 +427,16 @@ void LocalPlanner::updateObstacleDistanceMsg() {
 }
 
 // get 3D points from old histogram
-void LocalPlanner::reprojectPoints(Histogram histogram) {
-  float dist;
-  int age;
-  // ALPHA_RES%2=0 as per definition, see histogram.h
-  int half_res = ALPHA_RES / 2;
-  Eigen::Vector3f temp_array[4];
-
-  std::array<PolarPoint, 4> p_pol;
-  reprojected_points_age_.clear();
-
-  reprojected_points_.points.clear();
-  reprojected_points_.header.stamp = final_cloud_.header.stamp;
-  reprojected_points_.header.frame_id = "local_origin";
-
-  for (int e = 0; e < GRID_LENGTH_E; e++) {
-    for (int z = 0; z < GRID_LENGTH_Z; z++) {
-      if (histogram.get_dist(e, z) > FLT_MIN) {
-        for (auto &i : p_pol) {
-          i.r = histogram.get_dist(e, z);
-          i = histogramIndexToPolar(e, z, ALPHA_RES, i.r);
-        }
-        // transform from array index to angle
-        p_pol[0].e += half_res;
-        p_pol[0].z += half_res;
-        p_pol[1].e -= half_res;
-        p_pol[1].z += half_res;
-        p_pol[2].e += half_res;
-        p_pol[2].z -= half_res;
-        p_pol[3].e -= half_res;
-        p_pol[3].z -= half_res;
-
-        // transform from Polar to Cartesian
-        temp_array[0] = polarToCartesian(p_pol[0], position_old_);
-        temp_array[1] = polarToCartesian(p_pol[1], position_old_);
-        temp_array[2] = polarToCartesian(p_pol[2], position_old_);
-        temp_array[3] = polarToCartesian(p_pol[3], position_old_);
-
-        for (int i = 0; i < 4; i++) {
-          dist = (position_ - temp_array[i]).norm();
-          age = histogram.get_age(e, z);
-
-          if (dist < 2.0f * histogram_box_.radius_ && dist > 0.3f &&
-              age < reproj_age_) {
-            reprojected_points_.points.push_back(toXYZ(temp_array[i]));
-            reprojected_points_age_.push_back(age);
-          }
-        }
-      }
-    }
-  }
+template <int RES>
+void LocalPlanner::reprojectObstacleMemory(
+    pcl::PointCloud<pcl::PointXYZ> &reprojected_points) {
+  // the histogram was built at the position of the last iteration
+  std::vector<int> reprojected_points_age;
+  reprojectHistogram(reprojected_points, reprojected_points_age,
+                     polarHistogram<RES>(), position_old_, position_old_,
+                     2.0f * histogram_box_.radius_, reproj_age_);
+  reprojected_points.header.stamp = final_cloud_->header.stamp;
+  reprojected_points.header.frame_id = "local_origin";
 }
 
 // calculate the correct weight between fly over and fly around
@@ -391,7 +453,7 @@ void LocalPlanner::evaluateProgressRate() {
 
     goal_dist_incline_.push_back(incline);
     if (goal_dist_incline_.size() > dist_incline_window_size_) {
-      goal_dist_incline_.pop_front();
+      goal_dist_incline_.erase(goal_dist_incline_.begin());
     }
 
     float sum_incline = 0.0f;
@@ -445,23 +507,39 @@ void LocalPlanner::stopInFrontObstacles() {
 
 Eigen::Vector3f LocalPlanner::getPosition() { return position_; }
 
-void LocalPlanner::getCloudsForVisualization(
-    pcl::PointCloud<pcl::PointXYZ> &final_cloud,
+int LocalPlanner::getHistogramResolution() const {
+  return histogram_resolution_;
+}
+
+pcl::PointCloud<pcl::PointXYZ>::ConstPtr LocalPlanner::getFinalCloud() const {
+  return final_cloud_;
+}
+
+void LocalPlanner::getReprojectedPoints(
     pcl::PointCloud<pcl::PointXYZ> &reprojected_points) {
-  final_cloud = final_cloud_;
-  reprojected_points = reprojected_points_;
+  switch (histogram_resolution_) {
+    case ALPHA_RES_FINE:
+      reprojectObstacleMemory<ALPHA_RES_FINE>(reprojected_points);
+      break;
+    case ALPHA_RES_COARSE:
+      reprojectObstacleMemory<ALPHA_RES_COARSE>(reprojected_points);
+      break;
+    default:
+      reprojectObstacleMemory<ALPHA_RES>(reprojected_points);
+      break;
+  }
 }
 
 void LocalPlanner::setCurrentVelocity(const Eigen::Vector3f &vel) {
   velocity_ = vel;
 }
 
-void LocalPlanner::getTree(std::vector<TreeNode> &tree,
-                           std::vector<int> &closed_set,
-                           std::vector<Eigen::Vector3f> &path_node_positions) {
-  tree = star_planner_->tree_;
+const Tree &LocalPlanner::getTree(
+    std::vector<int> &closed_set,
+    std::vector<Eigen::Vector3f> &path_node_positions) const {
   closed_set = star_planner_->closed_set_;
   path_node_positions = star_planner_->path_node_positions_;
+  return star_planner_->tree_;
 }
 
 void LocalPlanner::sendObstacleDistanceDataToFcu(
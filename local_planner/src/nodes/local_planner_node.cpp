@@ -21,6 +21,10 @@ LocalPlannerNode::LocalPlannerNode(const bool tf_spin_thread) {
   nh_ = ros::NodeHandle("~");
   readParams();
 
+  // the calling thread processes one of the cameras itself
+  preprocessing_pool_.reset(
+      new ThreadPool(std::max<size_t>(cameras_.size(), 1) - 1));
+
   tf_listener_ = new tf::TransformListener(
       ros::Duration(tf::Transformer::DEFAULT_CACHE_TIME), tf_spin_thread);
 
@@ -133,9 +137,34 @@ void LocalPlannerNode::readParams() {
   nh_.param<bool>("disable_rise_to_goal_altitude",
                   disable_rise_to_goal_altitude_, false);
   nh_.param<bool>("accept_goal_input_topic", accept_goal_input_topic_, false);
+  nh_.param<bool>("async_pointcloud_processing", async_pointcloud_processing_,
+                  false);
+  nh_.param<double>("planner_rate", planner_rate_, 10.0);
+  nh_.param<double>("max_pointcloud_age", max_pointcloud_age_, 0.5);
+
+  // minimal period of each debug product [s], 0 publishes every planner run
+  // while the topic has subscribers
+  std::pair<const char*, DebugThrottle*> debug_throttles[] = {
+      {"debug_period_local_pointcloud", &local_pointcloud_throttle_},
+      {"debug_period_reprojected_points", &reprojected_points_throttle_},
+      {"debug_period_tree", &tree_throttle_},
+      {"debug_period_histogram_image", &histogram_image_throttle_},
+      {"debug_period_cost_image", &cost_image_throttle_}};
+  for (auto& debug_throttle : debug_throttles) {
+    double period;
+    nh_.param<double>(debug_throttle.first, period, 0.0);
+    debug_throttle.second->period = ros::Duration(std::max(0.0, period));
+  }
 
+  // depth images are projected directly, without a pointcloud message
   std::vector<std::string> camera_topics;
-  nh_.getParam("pointcloud_topics", camera_topics);
+  nh_.getParam("depth_image_topics", camera_topics);
+  use_depth_images_ = !camera_topics.empty();
+  nh_.param<int>("depth_image_stride", depth_image_stride_, 2);
+  depth_image_stride_ = std::max(1, depth_image_stride_);
+  if (!use_depth_images_) {
+    nh_.getParam("pointcloud_topics", camera_topics);
+  }
   initializeCameraSubscribers(camera_topics);
 
   nh_.param<std::string>("world_name", world_path_, "");
@@ -153,9 +182,15 @@ void LocalPlannerNode::initializeCameraSubscribers(
   std::vector<std::string> camera_info(camera_topics.size(), s);
 
   for (size_t i = 0; i < camera_topics.size(); i++) {
-    cameras_[i].pointcloud_sub_ = nh_.subscribe<sensor_msgs::PointCloud2>(
-        camera_topics[i], 1,
-        boost::bind(&LocalPlannerNode::pointCloudCallback, this, _1, i));
+    if (use_depth_images_) {
+      cameras_[i].pointcloud_sub_ = nh_.subscribe<sensor_msgs::Image>(
+          camera_topics[i], 1,
+          boost::bind(&LocalPlannerNode::depthImageCallback, this, _1, i));
+    } else {
+      cameras_[i].pointcloud_sub_ = nh_.subscribe<sensor_msgs::PointCloud2>(
+          camera_topics[i], 1,
+          boost::bind(&LocalPlannerNode::pointCloudCallback, this, _1, i));
+    }
     cameras_[i].topic_ = camera_topics[i];
 
     // get each namespace in the pointcloud topic and construct the camera_info
@@ -182,67 +217,181 @@ size_t LocalPlannerNode::numReceivedClouds() {
 }
 
 void LocalPlannerNode::updatePlanner() {
-  if (cameras_.size() == numReceivedClouds() && cameras_.size() != 0) {
-    if (canUpdatePlannerInfo()) {
-      if (running_mutex_.try_lock()) {
-        updatePlannerInfo();
-        // reset all clouds to not yet received
-        for (size_t i = 0; i < cameras_.size(); i++) {
-          cameras_[i].received_ = false;
-        }
-        wp_generator_->setPlannerInfo(local_planner_->getAvoidanceOutput());
-        if (local_planner_->stop_in_front_active_) {
-          goal_msg_.pose.position = toPoint(local_planner_->getGoal());
-        }
-        running_mutex_.unlock();
-        // Wake up the planner
-        std::unique_lock<std::mutex> lck(data_ready_mutex_);
-        data_ready_ = true;
-        data_ready_cv_.notify_one();
+  bool update_planner = false;
+  if (async_pointcloud_processing_) {
+    // retry the clouds whose transformation was not available on arrival
+    for (size_t i = 0; i < cameras_.size(); i++) {
+      if (cameras_[i].conversion_pending_) convertPointCloud(i);
+    }
+    update_planner = canUpdatePlannerAsync();
+  } else {
+    update_planner = cameras_.size() == numReceivedClouds() &&
+                     cameras_.size() != 0 && canUpdatePlannerInfo();
+  }
+
+  if (update_planner) {
+    if (running_mutex_.try_lock()) {
+      updatePlannerInfo();
+      // reset all clouds to not yet received
+      for (size_t i = 0; i < cameras_.size(); i++) {
+        cameras_[i].received_ = false;
+      }
+      last_planner_update_ = ros::Time::now();
+      wp_generator_->setPlannerInfo(local_planner_->getAvoidanceOutput());
+      if (local_planner_->stop_in_front_active_) {
+        goal_msg_.pose.position = toPoint(local_planner_->getGoal());
       }
+      running_mutex_.unlock();
+      // Wake up the planner
+      std::unique_lock<std::mutex> lck(data_ready_mutex_);
+      data_ready_ = true;
+      data_ready_cv_.notify_one();
     }
   }
 }
 
+bool LocalPlannerNode::canUpdatePlannerAsync() {
+  ros::Time now = ros::Time::now();
+  if (now - last_planner_update_ < ros::Duration(1.0 / planner_rate_)) {
+    return false;
+  }
+
+  // without any recent cloud the planner stops, which triggers the failsafe
+  for (size_t i = 0; i < cameras_.size(); i++) {
+    const ros::Time& stamp = cameras_[i].cloud_updated_
+                                 ? cameras_[i].cloud_stamp_
+                                 : cameras_[i].planner_cloud_stamp_;
+    if (!stamp.isZero() &&
+        !(now - stamp > ros::Duration(max_pointcloud_age_))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void LocalPlannerNode::convertPointCloud(size_t index) {
+  cameraData& camera = cameras_[index];
+  const std_msgs::Header& header = camera.newest_header_;
+  if ((use_depth_images_ && camera.pixel_rays_.empty()) ||
+      !tf_listener_->canTransform("/local_origin", header.frame_id,
+                                  header.stamp)) {
+    camera.conversion_pending_ = true;
+    return;
+  }
+  camera.conversion_pending_ = false;
+
+  ros::WallTime start_time = ros::WallTime::now();
+  try {
+    tf_listener_->lookupTransform("/local_origin", header.frame_id,
+                                  header.stamp, camera.transform_);
+  } catch (tf::TransformException& ex) {
+    ROS_ERROR("Received an exception trying to transform a pointcloud: %s",
+              ex.what());
+    return;
+  }
+
+  const Eigen::Affine3f transform = toEigen(camera.transform_);
+  if (!decodeCameraData(index, transform, camera.cloud_)) {
+    return;
+  }
+  // the optical axis is the z axis of the camera frame
+  camera.direction_ = cartesianToPolar(
+      transform.linear() * Eigen::Vector3f::UnitZ(), Eigen::Vector3f::Zero());
+  camera.cloud_stamp_ = header.stamp;
+  camera.cloud_updated_ = true;
+  camera.preprocessing_time_ = ros::WallTime::now() - start_time;
+  ROS_DEBUG("\033[0;35m[OA] Pointcloud preprocessing %s: %2.2f ms\033[0m",
+            camera.topic_.c_str(), camera.preprocessing_time_.toSec() * 1000.0);
+}
+
 bool LocalPlannerNode::canUpdatePlannerInfo() {
   // Check if we have a transformation available at the time of the current
   // point cloud
   size_t missing_transforms = 0;
   for (size_t i = 0; i < cameras_.size(); ++i) {
-    if (!tf_listener_->canTransform(
-            "/local_origin", cameras_[i].newest_cloud_msg_.header.frame_id,
-            ros::Time(0))) {
+    if (cameras_[i].newest_header_.frame_id.empty() ||
+        (use_depth_images_ && cameras_[i].pixel_rays_.empty()) ||
+        !tf_listener_->canTransform("/local_origin",
+                                    cameras_[i].newest_header_.frame_id,
+                                    ros::Time(0))) {
       missing_transforms++;
     }
   }
 
   return missing_transforms == 0;
 }
-void LocalPlannerNode::updatePlannerInfo() {
-  // update the point cloud
-  local_planner_->complete_cloud_.clear();
+void LocalPlannerNode::updatePointClouds() {
+  // update the point cloud: the transforms are looked up first, then each
+  // camera is decoded on its own thread into its own buffer, which is reused
+  // across iterations
   for (size_t i = 0; i < cameras_.size(); ++i) {
-    pcl::PointCloud<pcl::PointXYZ> pcl_cloud;
+    const std_msgs::Header& header = cameras_[i].newest_header_;
     try {
-      // transform message to pcl type
-      pcl::fromROSMsg(cameras_[i].newest_cloud_msg_, pcl_cloud);
-
-      // remove nan padding
-      std::vector<int> dummy_index;
-      dummy_index.reserve(pcl_cloud.points.size());
-      pcl::removeNaNFromPointCloud(pcl_cloud, pcl_cloud, dummy_index);
-
-      // transform cloud to /local_origin frame
-      pcl_ros::transformPointCloud("/local_origin", pcl_cloud, pcl_cloud,
-                                   *tf_listener_);
-
-      local_planner_->complete_cloud_.push_back(std::move(pcl_cloud));
+      tf_listener_->lookupTransform("/local_origin", header.frame_id,
+                                    header.stamp, cameras_[i].transform_);
+      cameras_[i].transform_valid_ = true;
     } catch (tf::TransformException& ex) {
       ROS_ERROR("Received an exception trying to transform a pointcloud: %s",
                 ex.what());
+      cameras_[i].transform_valid_ = false;
     }
   }
 
+  ros::WallTime start_time = ros::WallTime::now();
+  preprocessing_pool_->parallelFor(cameras_.size(), [this](size_t i) {
+    ros::WallTime camera_start_time = ros::WallTime::now();
+    pcl::PointCloud<pcl::PointXYZ>& pcl_cloud =
+        local_planner_->complete_cloud_[i];
+    if (!cameras_[i].transform_valid_) {
+      pcl_cloud.clear();
+    } else {
+      decodeCameraData(i, toEigen(cameras_[i].transform_), pcl_cloud);
+    }
+    cameras_[i].preprocessing_time_ =
+        ros::WallTime::now() - camera_start_time;
+  });
+
+  for (const cameraData& camera : cameras_) {
+    ROS_DEBUG("\033[0;35m[OA] Pointcloud preprocessing %s: %2.2f ms\033[0m",
+              camera.topic_.c_str(),
+              camera.preprocessing_time_.toSec() * 1000.0);
+  }
+  ROS_DEBUG("\033[0;35m[OA] Pointcloud preprocessing total: %2.2f ms\033[0m",
+            (ros::WallTime::now() - start_time).toSec() * 1000.0);
+}
+
+void LocalPlannerNode::updatePointCloudsAsync() {
+  // the clouds have been converted on arrival, hand the new ones over to the
+  // planner and drop the ones which are too old to be trusted
+  ros::Time now = ros::Time::now();
+  local_planner_->camera_slices_.resize(cameras_.size());
+  for (size_t i = 0; i < cameras_.size(); ++i) {
+    cameraData& camera = cameras_[i];
+    CameraSlice& slice = local_planner_->camera_slices_[i];
+    slice.updated = camera.cloud_updated_;
+    if (camera.cloud_updated_) {
+      local_planner_->complete_cloud_[i].swap(camera.cloud_);
+      slice.direction = camera.direction_;
+      camera.planner_cloud_stamp_ = camera.cloud_stamp_;
+      camera.cloud_updated_ = false;
+    }
+    if (now - camera.planner_cloud_stamp_ >
+        ros::Duration(max_pointcloud_age_)) {
+      local_planner_->complete_cloud_[i].clear();
+      ROS_DEBUG("\033[0;35m[OA] Pointcloud on %s is outdated\033[0m",
+                camera.topic_.c_str());
+    }
+  }
+}
+
+void LocalPlannerNode::updatePlannerInfo() {
+  local_planner_->complete_cloud_.resize(cameras_.size());
+  if (async_pointcloud_processing_) {
+    updatePointCloudsAsync();
+  } else {
+    updatePointClouds();
+  }
+
   // update position
   local_planner_->setPose(toEigen(newest_pose_.pose.position),
                           toEigen(newest_pose_.pose.orientation));
@@ -371,6 +520,7 @@ void LocalPlannerNode::publishPaths() {
 }
 
 void LocalPlannerNode::publishGoal() {
+  if (marker_goal_pub_.getNumSubscribers() == 0) return;
   visualization_msgs::MarkerArray marker_goal;
   visualization_msgs::Marker m;
 
@@ -395,6 +545,11 @@ void LocalPlannerNode::publishGoal() {
 }
 
 void LocalPlannerNode::publishReachHeight() {
+  if (initial_height_pub_.getNumSubscribers() +
+          takeoff_pose_pub_.getNumSubscribers() ==
+      0) {
+    return;
+  }
   visualization_msgs::Marker m;
   m.header.frame_id = "local_origin";
   m.header.stamp = ros::Time::now();
@@ -437,6 +592,7 @@ void LocalPlannerNode::publishReachHeight() {
 }
 
 void LocalPlannerNode::publishBox() {
+  if (bounding_box_pub_.getNumSubscribers() == 0) return;
   visualization_msgs::MarkerArray marker_array;
   Eigen::Vector3f drone_pos = local_planner_->getPosition();
   double histogram_box_radius =
@@ -588,10 +744,34 @@ void LocalPlannerNode::publishWaypoints(bool hover) {
 }
 
 void LocalPlannerNode::publishDataImages() {
+  const int res = local_planner_->getHistogramResolution();
+  const int grid_length_e = 180 / res;
+  const int grid_length_z = 360 / res;
+
+  // histogram image
+  if (local_planner_->generate_histogram_image_ &&
+      !local_planner_->histogram_image_data_.empty()) {
+    sensor_msgs::Image hist_img;
+    hist_img.header.stamp = ros::Time::now();
+    hist_img.height = grid_length_e;
+    hist_img.width = grid_length_z;
+    hist_img.encoding = sensor_msgs::image_encodings::MONO8;
+    hist_img.is_bigendian = 0;
+    hist_img.step = 255;
+    hist_img.data = local_planner_->histogram_image_data_;
+    histogram_image_pub_.publish(hist_img);
+  }
+
+  // cost image
+  if (!local_planner_->generate_cost_image_ ||
+      local_planner_->cost_image_data_.empty()) {
+    return;
+  }
+
   sensor_msgs::Image cost_img;
   cost_img.header.stamp = ros::Time::now();
-  cost_img.height = GRID_LENGTH_E;
-  cost_img.width = GRID_LENGTH_Z;
+  cost_img.height = grid_length_e;
+  cost_img.width = grid_length_z;
   cost_img.encoding = "rgb8";
   cost_img.is_bigendian = 0;
   cost_img.step = 3 * cost_img.width;
@@ -604,51 +784,40 @@ void LocalPlannerNode::publishDataImages() {
       std::round((-static_cast<float>(curr_yaw_fcu_frame) * 180.0f / M_PI_F)) +
       90.0f;
   PolarPoint heading_pol(0, yaw_angle_histogram_frame, 1.0);
-  Eigen::Vector2i heading_index = polarToHistogramIndex(heading_pol, ALPHA_RES);
+  Eigen::Vector2i heading_index = polarToHistogramIndex(heading_pol, res);
 
   // current setpoint
   PolarPoint waypoint_pol = cartesianToPolar(
       toEigen(newest_waypoint_position_), toEigen(newest_pose_.pose.position));
-  Eigen::Vector2i waypoint_index =
-      polarToHistogramIndex(waypoint_pol, ALPHA_RES);
+  Eigen::Vector2i waypoint_index = polarToHistogramIndex(waypoint_pol, res);
   PolarPoint adapted_waypoint_pol =
       cartesianToPolar(toEigen(newest_adapted_waypoint_position_),
                        toEigen(newest_pose_.pose.position));
   Eigen::Vector2i adapted_waypoint_index =
-      polarToHistogramIndex(adapted_waypoint_pol, ALPHA_RES);
+      polarToHistogramIndex(adapted_waypoint_pol, res);
 
-  // color in the image
-  if (cost_img.data.size() == 3 * GRID_LENGTH_E * GRID_LENGTH_Z) {
+  // color in the image, skipped if the resolution changed since the image was
+  // generated
+  if (cost_img.data.size() == 3 * grid_length_e * grid_length_z) {
     // current heading blue
-    cost_img.data[colorImageIndex(heading_index.y(), heading_index.x(), 2)] =
-        255.f;
+    cost_img.data[colorImageIndex(heading_index.y(), heading_index.x(), 2,
+                                  res)] = 255.f;
 
     // waypoint white
-    cost_img.data[colorImageIndex(waypoint_index.y(), waypoint_index.x(), 0)] =
-        255.f;
-    cost_img.data[colorImageIndex(waypoint_index.y(), waypoint_index.x(), 1)] =
-        255.f;
-    cost_img.data[colorImageIndex(waypoint_index.y(), waypoint_index.x(), 2)] =
-        255.f;
+    cost_img.data[colorImageIndex(waypoint_index.y(), waypoint_index.x(), 0,
+                                  res)] = 255.f;
+    cost_img.data[colorImageIndex(waypoint_index.y(), waypoint_index.x(), 1,
+                                  res)] = 255.f;
+    cost_img.data[colorImageIndex(waypoint_index.y(), waypoint_index.x(), 2,
+                                  res)] = 255.f;
 
     // adapted waypoint light blue
     cost_img.data[colorImageIndex(adapted_waypoint_index.y(),
-                                  adapted_waypoint_index.x(), 1)] = 255.f;
+                                  adapted_waypoint_index.x(), 1, res)] = 255.f;
     cost_img.data[colorImageIndex(adapted_waypoint_index.y(),
-                                  adapted_waypoint_index.x(), 2)] = 255.f;
+                                  adapted_waypoint_index.x(), 2, res)] = 255.f;
   }
 
-  // histogram image
-  sensor_msgs::Image hist_img;
-  hist_img.header.stamp = ros::Time::now();
-  hist_img.height = GRID_LENGTH_E;
-  hist_img.width = GRID_LENGTH_Z;
-  hist_img.encoding = sensor_msgs::image_encodings::MONO8;
-  hist_img.is_bigendian = 0;
-  hist_img.step = 255;
-  hist_img.data = local_planner_->histogram_image_data_;
-
-  histogram_image_pub_.publish(hist_img);
   cost_image_pub_.publish(cost_img);
 }
 
@@ -679,17 +848,15 @@ void LocalPlannerNode::publishTree() {
   path_marker.color.g = 0.0;
   path_marker.color.b = 0.0;
 
-  std::vector<TreeNode> tree;
   std::vector<int> closed_set;
-
-  local_planner_->getTree(tree, closed_set, path_node_positions_);
+  const Tree& tree = local_planner_->getTree(closed_set, path_node_positions_);
 
   tree_marker.points.reserve(closed_set.size() * 2);
   for (size_t i = 0; i < closed_set.size(); i++) {
     int node_nr = closed_set[i];
-    geometry_msgs::Point p1 = toPoint(tree[node_nr].getPosition());
-    int origin = tree[node_nr].origin_;
-    geometry_msgs::Point p2 = toPoint(tree[origin].getPosition());
+    geometry_msgs::Point p1 = toPoint(tree.position[node_nr]);
+    int origin = tree.origin[node_nr];
+    geometry_msgs::Point p2 = toPoint(tree.position[origin]);
     tree_marker.points.push_back(p1);
     tree_marker.points.push_back(p2);
   }
@@ -841,8 +1008,9 @@ void LocalPlannerNode::printPointInfo(double x, double y, double z) {
                   (Eigen::Vector2f(x, y) - drone_pos.topRows<2>()).norm()) *
              180.0 / M_PI));  //(-90.+90)
 
-  beta_z = beta_z + (ALPHA_RES - beta_z % ALPHA_RES);  //[-170,+190]
-  beta_e = beta_e + (ALPHA_RES - beta_e % ALPHA_RES);  //[-80,+90]
+  const int res = local_planner_->getHistogramResolution();
+  beta_z = beta_z + (res - beta_z % res);  //[-170,+190]
+  beta_e = beta_e + (res - beta_e % res);  //[-80,+90]
 
   printf("----- Point: %f %f %f -----\n", x, y, z);
   printf("Elevation %d Azimuth %d \n", beta_e, beta_z);
@@ -851,8 +1019,49 @@ void LocalPlannerNode::printPointInfo(double x, double y, double z) {
 
 void LocalPlannerNode::pointCloudCallback(
     const sensor_msgs::PointCloud2::ConstPtr& msg, int index) {
-  cameras_[index].newest_cloud_msg_ = *msg;  // FIXME: avoid a copy
+  cameras_[index].newest_cloud_msg_ = msg;
+  cameras_[index].newest_header_ = msg->header;
+  cameras_[index].received_ = true;
+  if (async_pointcloud_processing_) {
+    convertPointCloud(index);
+  }
+}
+
+void LocalPlannerNode::depthImageCallback(
+    const sensor_msgs::Image::ConstPtr& msg, int index) {
+  cameras_[index].newest_depth_msg_ = msg;
+  cameras_[index].newest_header_ = msg->header;
   cameras_[index].received_ = true;
+  if (async_pointcloud_processing_) {
+    convertPointCloud(index);
+  }
+}
+
+bool LocalPlannerNode::decodeCameraData(
+    size_t index, const Eigen::Affine3f& transform,
+    pcl::PointCloud<pcl::PointXYZ>& cloud) {
+  const cameraData& camera = cameras_[index];
+  if (use_depth_images_) {
+    // project the sampled pixels along their precomputed rays
+    if (!depthImageToPointCloud(cloud, *camera.newest_depth_msg_,
+                                camera.pixel_rays_, depth_image_stride_,
+                                transform, "/local_origin")) {
+      ROS_ERROR("Depth image on topic %s is not 16UC1 or 32FC1, does not "
+                "match the camera info or is truncated",
+                camera.topic_.c_str());
+      return false;
+    }
+  } else {
+    // decode, remove nan padding and transform cloud to /local_origin frame
+    if (!transformPointCloudMsg(cloud, *camera.newest_cloud_msg_, transform,
+                                "/local_origin")) {
+      ROS_ERROR("Pointcloud on topic %s has no float32 x, y, z fields or "
+                "is truncated",
+                camera.topic_.c_str());
+      return false;
+    }
+  }
+  return true;
 }
 
 void LocalPlannerNode::cameraInfoCallback(
@@ -870,6 +1079,18 @@ void LocalPlannerNode::cameraInfoCallback(
       2.0 * atan(static_cast<double>(msg->height) / (2.0 * msg->K[4])) * 180.0 /
       M_PI);
   wp_generator_->setFOV(local_planner_->h_FOV_, local_planner_->v_FOV_);
+
+  // the camera info is repeated with every image, the rays are only computed
+  // again if the intrinsics change
+  cameraData& camera = cameras_[index];
+  const bool same_intrinsics = camera.pixel_rays_info_ &&
+                               camera.pixel_rays_info_->K == msg->K &&
+                               camera.pixel_rays_info_->width == msg->width &&
+                               camera.pixel_rays_info_->height == msg->height;
+  if (use_depth_images_ && !same_intrinsics) {
+    computePixelRays(camera.pixel_rays_, *msg, depth_image_stride_);
+    camera.pixel_rays_info_ = msg;
+  }
 }
 
 void LocalPlannerNode::publishSetpoint(const geometry_msgs::Twist& wp,
@@ -1001,13 +1222,32 @@ void LocalPlannerNode::transformVelocityToTrajectory(
   obst_avoid.point_valid = {true, false, false, false, false};
 }
 
-void LocalPlannerNode::publishPlannerData() {
-  pcl::PointCloud<pcl::PointXYZ> final_cloud, reprojected_points;
-  local_planner_->getCloudsForVisualization(final_cloud, reprojected_points);
-  local_pointcloud_pub_.publish(final_cloud);
-  reprojected_points_pub_.publish(reprojected_points);
+void LocalPlannerNode::requestDebugImages() {
+  const ros::Time now = ros::Time::now();
+  local_planner_->generate_histogram_image_ = histogram_image_throttle_.due(
+      histogram_image_pub_.getNumSubscribers(), now);
+  local_planner_->generate_cost_image_ =
+      cost_image_throttle_.due(cost_image_pub_.getNumSubscribers(), now);
+}
 
-  publishTree();
+void LocalPlannerNode::publishPlannerData() {
+  // the debug products are only copied and converted if they are due
+  const ros::Time now = ros::Time::now();
+  if (local_pointcloud_throttle_.due(local_pointcloud_pub_.getNumSubscribers(),
+                                     now)) {
+    local_pointcloud_pub_.publish(local_planner_->getFinalCloud());
+  }
+  if (reprojected_points_throttle_.due(
+          reprojected_points_pub_.getNumSubscribers(), now)) {
+    pcl::PointCloud<pcl::PointXYZ> reprojected_points;
+    local_planner_->getReprojectedPoints(reprojected_points);
+    reprojected_points_pub_.publish(reprojected_points);
+  }
+  if (tree_throttle_.due(complete_tree_pub_.getNumSubscribers() +
+                             tree_path_pub_.getNumSubscribers(),
+                         now)) {
+    publishTree();
+  }
 
   last_wp_time_ = ros::Time::now();
 
@@ -1047,6 +1287,7 @@ void LocalPlannerNode::threadFunction() {
       std::lock_guard<std::mutex> guard(running_mutex_);
       never_run_ = false;
       std::clock_t start_time = std::clock();
+      requestDebugImages();
       local_planner_->runPlanner();
       publishPlannerData();
 
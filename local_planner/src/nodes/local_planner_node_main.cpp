@@ -62,8 +62,11 @@ int main(int argc, char** argv) {
       if (!hover) Node.status_msg_.state = (int)MAV_STATE::MAV_STATE_ACTIVE;
     } else {
       for (size_t i = 0; i < Node.cameras_.size(); ++i) {
-        // once the camera info have been set once, unsubscribe from topic
-        Node.cameras_[i].camera_info_sub_.shutdown();
+        // once the camera info have been set once, unsubscribe from topic. The
+        // depth image projection can't start without it
+        if (!Node.use_depth_images_ || !Node.cameras_[i].pixel_rays_.empty()) {
+          Node.cameras_[i].camera_info_sub_.shutdown();
+        }
       }
     }
 
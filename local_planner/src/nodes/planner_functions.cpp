@@ -3,11 +3,335 @@
 #include "local_planner/common.h"
 
 #include <ros/console.h>
+#include <sensor_msgs/image_encodings.h>
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
 #include <numeric>
 
+// The AVX2 kernels are compiled for that target function by function and
+// selected at runtime, the rest of the package keeps the baseline instruction
+// set and with it the Eigen alignment of PCL and ROS
+#if defined(__GNUC__) && defined(__x86_64__)
+#define AVX2_KERNELS
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#endif
+
 namespace avoidance {
 
+namespace {
+
+// limits of the crop test, distances are compared squared and all
+// comparisons are strict so that they fail for NaN coordinates
+struct CropLimits {
+  Eigen::Vector3f box_min;
+  Eigen::Vector3f box_max;
+  Eigen::Vector3f position;
+  float min_dist_sq;
+  float max_dist_sq;
+  float backoff_dist_sq;
+};
+
+// reduction state of the crop test, the vectorized path keeps one per lane
+struct CropState {
+  float closest_dist_sq = INFINITY;
+  int closest_index = std::numeric_limits<int>::max();
+  int counter_backoff = 0;
+
+  // ties are resolved towards the point which comes first in the input, like
+  // in a sequential loop
+  void merge(float dist_sq, int index) {
+    if (dist_sq < closest_dist_sq ||
+        (dist_sq == closest_dist_sq && index < closest_index)) {
+      closest_dist_sq = dist_sq;
+      closest_index = index;
+    }
+  }
+};
+
+#if defined(AVX2_KERNELS)
+bool cpuSupportsAVX2() {
+  static const bool supported = __builtin_cpu_supports("avx2");
+  return supported;
+}
+#endif
+
+inline bool cropPoint(const pcl::PointXYZ& xyz, int index,
+                      const CropLimits& limits, CropState& state) {
+  if (!(xyz.x > limits.box_min.x() && xyz.x < limits.box_max.x() &&
+        xyz.y > limits.box_min.y() && xyz.y < limits.box_max.y() &&
+        xyz.z > limits.box_min.z() && xyz.z < limits.box_max.z())) {
+    return false;
+  }
+  float dx = xyz.x - limits.position.x();
+  float dy = xyz.y - limits.position.y();
+  float dz = xyz.z - limits.position.z();
+  float dist_sq = dx * dx + dy * dy + dz * dz;
+  if (dist_sq > limits.min_dist_sq && dist_sq < limits.max_dist_sq) {
+    state.merge(dist_sq, index);
+    if (dist_sq < limits.backoff_dist_sq) state.counter_backoff++;
+    return true;
+  }
+  return false;
+}
+
+void cropCloudScalar(const pcl::PointCloud<pcl::PointXYZ>& cloud,
+                     size_t begin, int index_offset, const CropLimits& limits,
+                     pcl::PointCloud<pcl::PointXYZ>& cropped_cloud,
+                     CropState& state) {
+  for (size_t i = begin; i < cloud.points.size(); i++) {
+    if (cropPoint(cloud.points[i], index_offset + static_cast<int>(i), limits,
+                  state)) {
+      cropped_cloud.points.push_back(cloud.points[i]);
+    }
+  }
+}
+
+#if defined(AVX2_KERNELS)
+// Eight-wide variant of the SSE kernel below. Two points are loaded per
+// register, so the in-lane transpose yields x, y and z of eight consecutive
+// points.
+__attribute__((target("avx2"))) void cropCloudAVX2(
+    const pcl::PointCloud<pcl::PointXYZ>& cloud, int index_offset,
+    const CropLimits& limits, pcl::PointCloud<pcl::PointXYZ>& cropped_cloud,
+    CropState& state) {
+  const __m256 x_min = _mm256_set1_ps(limits.box_min.x());
+  const __m256 y_min = _mm256_set1_ps(limits.box_min.y());
+  const __m256 z_min = _mm256_set1_ps(limits.box_min.z());
+  const __m256 x_max = _mm256_set1_ps(limits.box_max.x());
+  const __m256 y_max = _mm256_set1_ps(limits.box_max.y());
+  const __m256 z_max = _mm256_set1_ps(limits.box_max.z());
+  const __m256 pos_x = _mm256_set1_ps(limits.position.x());
+  const __m256 pos_y = _mm256_set1_ps(limits.position.y());
+  const __m256 pos_z = _mm256_set1_ps(limits.position.z());
+  const __m256 min_dist_sq = _mm256_set1_ps(limits.min_dist_sq);
+  const __m256 max_dist_sq = _mm256_set1_ps(limits.max_dist_sq);
+  const __m256 backoff_dist_sq = _mm256_set1_ps(limits.backoff_dist_sq);
+
+  __m256 best_dist_sq = _mm256_set1_ps(INFINITY);
+  __m256i best_index = _mm256_set1_epi32(std::numeric_limits<int>::max());
+  __m256i backoff = _mm256_setzero_si256();
+  __m256i index = _mm256_add_epi32(_mm256_set1_epi32(index_offset),
+                                   _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+  const __m256i index_step = _mm256_set1_epi32(8);
+
+  const int kStagingSize = 256;
+  pcl::PointXYZ staged[kStagingSize];
+  int n_staged = 0;
+
+  const size_t n_points = cloud.points.size();
+  const size_t n_blocks = n_points - n_points % 8;
+  const pcl::PointXYZ* points = cloud.points.data();
+  for (size_t i = 0; i < n_blocks;
+       i += 8, index = _mm256_add_epi32(index, index_step)) {
+    __m256 r[4];
+    for (int k = 0; k < 4; k++) {
+      r[k] = _mm256_insertf128_ps(
+          _mm256_castps128_ps256(_mm_loadu_ps(&points[i + k].x)),
+          _mm_loadu_ps(&points[i + k + 4].x), 1);
+    }
+    const __m256 t0 = _mm256_unpacklo_ps(r[0], r[1]);
+    const __m256 t1 = _mm256_unpacklo_ps(r[2], r[3]);
+    const __m256 t2 = _mm256_unpackhi_ps(r[0], r[1]);
+    const __m256 t3 = _mm256_unpackhi_ps(r[2], r[3]);
+    const __m256 x = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+    const __m256 y = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+    const __m256 z = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+
+    __m256 mask = _mm256_and_ps(_mm256_cmp_ps(x, x_min, _CMP_GT_OQ),
+                                _mm256_cmp_ps(x, x_max, _CMP_LT_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(y, y_min, _CMP_GT_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(y, y_max, _CMP_LT_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(z, z_min, _CMP_GT_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(z, z_max, _CMP_LT_OQ));
+
+    const __m256 dx = _mm256_sub_ps(x, pos_x);
+    const __m256 dy = _mm256_sub_ps(y, pos_y);
+    const __m256 dz = _mm256_sub_ps(z, pos_z);
+    const __m256 dist_sq = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+        _mm256_mul_ps(dz, dz));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(dist_sq, min_dist_sq, _CMP_GT_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(dist_sq, max_dist_sq, _CMP_LT_OQ));
+
+    backoff = _mm256_sub_epi32(
+        backoff,
+        _mm256_castps_si256(_mm256_and_ps(
+            mask, _mm256_cmp_ps(dist_sq, backoff_dist_sq, _CMP_LT_OQ))));
+
+    const __m256 closer = _mm256_and_ps(
+        mask, _mm256_cmp_ps(dist_sq, best_dist_sq, _CMP_LT_OQ));
+    best_dist_sq = _mm256_blendv_ps(best_dist_sq, dist_sq, closer);
+    best_index =
+        _mm256_blendv_epi8(best_index, index, _mm256_castps_si256(closer));
+
+    const int accepted = _mm256_movemask_ps(mask);
+    for (int lane = 0; lane < 8; lane++) {
+      staged[n_staged] = points[i + lane];
+      n_staged += (accepted >> lane) & 1;
+    }
+    if (n_staged > kStagingSize - 8) {
+      cropped_cloud.points.insert(cropped_cloud.points.end(), staged,
+                                  staged + n_staged);
+      n_staged = 0;
+    }
+  }
+  cropped_cloud.points.insert(cropped_cloud.points.end(), staged,
+                              staged + n_staged);
+
+  float lane_dist_sq[8];
+  int lane_index[8], lane_backoff[8];
+  _mm256_storeu_ps(lane_dist_sq, best_dist_sq);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(lane_index), best_index);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(lane_backoff), backoff);
+  for (int lane = 0; lane < 8; lane++) {
+    state.merge(lane_dist_sq[lane], lane_index[lane]);
+    state.counter_backoff += lane_backoff[lane];
+  }
+
+  cropCloudScalar(cloud, n_blocks, index_offset, limits, cropped_cloud, state);
+}
+#endif
+
+#if defined(__SSE2__)
+// selects a where mask is set and b otherwise
+inline __m128 select(__m128 mask, __m128 a, __m128 b) {
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+inline __m128i select(__m128i mask, __m128i a, __m128i b) {
+  return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// Processes four points per iteration without branching on the data: the
+// x-y-z-padding layout of pcl::PointXYZ is transposed into x, y and z
+// registers, all tests are evaluated as lane masks and the accepted points
+// are compacted into a small staging buffer which is appended to the output
+// in bulk.
+void cropCloudSSE(const pcl::PointCloud<pcl::PointXYZ>& cloud, int index_offset,
+                  const CropLimits& limits,
+                  pcl::PointCloud<pcl::PointXYZ>& cropped_cloud,
+                  CropState& state) {
+  const __m128 x_min = _mm_set1_ps(limits.box_min.x());
+  const __m128 y_min = _mm_set1_ps(limits.box_min.y());
+  const __m128 z_min = _mm_set1_ps(limits.box_min.z());
+  const __m128 x_max = _mm_set1_ps(limits.box_max.x());
+  const __m128 y_max = _mm_set1_ps(limits.box_max.y());
+  const __m128 z_max = _mm_set1_ps(limits.box_max.z());
+  const __m128 pos_x = _mm_set1_ps(limits.position.x());
+  const __m128 pos_y = _mm_set1_ps(limits.position.y());
+  const __m128 pos_z = _mm_set1_ps(limits.position.z());
+  const __m128 min_dist_sq = _mm_set1_ps(limits.min_dist_sq);
+  const __m128 max_dist_sq = _mm_set1_ps(limits.max_dist_sq);
+  const __m128 backoff_dist_sq = _mm_set1_ps(limits.backoff_dist_sq);
+
+  __m128 best_dist_sq = _mm_set1_ps(INFINITY);
+  __m128i best_index = _mm_set1_epi32(std::numeric_limits<int>::max());
+  __m128i backoff = _mm_setzero_si128();
+  __m128i index = _mm_add_epi32(_mm_set1_epi32(index_offset),
+                                _mm_set_epi32(3, 2, 1, 0));
+  const __m128i index_step = _mm_set1_epi32(4);
+
+  const int kStagingSize = 256;
+  pcl::PointXYZ staged[kStagingSize];
+  int n_staged = 0;
+
+  const size_t n_points = cloud.points.size();
+  const size_t n_blocks = n_points - n_points % 4;
+  const pcl::PointXYZ* points = cloud.points.data();
+  for (size_t i = 0; i < n_blocks;
+       i += 4, index = _mm_add_epi32(index, index_step)) {
+    __m128 x = _mm_loadu_ps(&points[i].x);
+    __m128 y = _mm_loadu_ps(&points[i + 1].x);
+    __m128 z = _mm_loadu_ps(&points[i + 2].x);
+    __m128 w = _mm_loadu_ps(&points[i + 3].x);
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+
+    __m128 mask = _mm_and_ps(_mm_cmpgt_ps(x, x_min), _mm_cmplt_ps(x, x_max));
+    mask = _mm_and_ps(mask, _mm_cmpgt_ps(y, y_min));
+    mask = _mm_and_ps(mask, _mm_cmplt_ps(y, y_max));
+    mask = _mm_and_ps(mask, _mm_cmpgt_ps(z, z_min));
+    mask = _mm_and_ps(mask, _mm_cmplt_ps(z, z_max));
+
+    const __m128 dx = _mm_sub_ps(x, pos_x);
+    const __m128 dy = _mm_sub_ps(y, pos_y);
+    const __m128 dz = _mm_sub_ps(z, pos_z);
+    const __m128 dist_sq =
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+                   _mm_mul_ps(dz, dz));
+    mask = _mm_and_ps(mask, _mm_cmpgt_ps(dist_sq, min_dist_sq));
+    mask = _mm_and_ps(mask, _mm_cmplt_ps(dist_sq, max_dist_sq));
+
+    // lane masks are all ones, subtracting them counts the points
+    backoff = _mm_sub_epi32(
+        backoff, _mm_castps_si128(_mm_and_ps(
+                     mask, _mm_cmplt_ps(dist_sq, backoff_dist_sq))));
+
+    // a lane only sees increasing indices, so a strict comparison keeps the
+    // first of equally distant points
+    const __m128 closer = _mm_and_ps(mask, _mm_cmplt_ps(dist_sq, best_dist_sq));
+    best_dist_sq = select(closer, dist_sq, best_dist_sq);
+    best_index = select(_mm_castps_si128(closer), index, best_index);
+
+    // every lane is written, only the accepted ones advance the buffer
+    const int accepted = _mm_movemask_ps(mask);
+    staged[n_staged] = points[i];
+    n_staged += accepted & 1;
+    staged[n_staged] = points[i + 1];
+    n_staged += (accepted >> 1) & 1;
+    staged[n_staged] = points[i + 2];
+    n_staged += (accepted >> 2) & 1;
+    staged[n_staged] = points[i + 3];
+    n_staged += (accepted >> 3) & 1;
+    if (n_staged > kStagingSize - 4) {
+      cropped_cloud.points.insert(cropped_cloud.points.end(), staged,
+                                  staged + n_staged);
+      n_staged = 0;
+    }
+  }
+  cropped_cloud.points.insert(cropped_cloud.points.end(), staged,
+                              staged + n_staged);
+
+  // horizontal reduction of the lanes
+  float lane_dist_sq[4];
+  int lane_index[4], lane_backoff[4];
+  _mm_storeu_ps(lane_dist_sq, best_dist_sq);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lane_index), best_index);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lane_backoff), backoff);
+  for (int lane = 0; lane < 4; lane++) {
+    state.merge(lane_dist_sq[lane], lane_index[lane]);
+    state.counter_backoff += lane_backoff[lane];
+  }
+
+  cropCloudScalar(cloud, n_blocks, index_offset, limits, cropped_cloud, state);
+}
+#endif
+
+void cropCloud(const pcl::PointCloud<pcl::PointXYZ>& cloud, int index_offset,
+               const CropLimits& limits,
+               pcl::PointCloud<pcl::PointXYZ>& cropped_cloud,
+               CropState& state) {
+#if defined(AVX2_KERNELS)
+  if (cpuSupportsAVX2()) {
+    cropCloudAVX2(cloud, index_offset, limits, cropped_cloud, state);
+    return;
+  }
+#endif
+#if defined(__SSE2__)
+  cropCloudSSE(cloud, index_offset, limits, cropped_cloud, state);
+#else
+  cropCloudScalar(cloud, 0, index_offset, limits, cropped_cloud, state);
+#endif
+}
+}
+
 // trim the point cloud so that only points inside the bounding box are
 // considered
 void filterPointCloud(
@@ -19,29 +343,39 @@ void filterPointCloud(
     const Eigen::Vector3f& position, float min_realsense_dist) {
   cropped_cloud.points.clear();
   cropped_cloud.width = 0;
-  distance_to_closest_point = HUGE_VAL;
-  float distance;
-  counter_backoff = 0;
 
+  // a negative bound rejects (upper) or accepts (lower) every distance
+  auto squared = [](float dist) { return dist < 0.f ? -1.f : dist * dist; };
+  CropLimits limits;
+  limits.box_min = histogram_box.getMinCorner();
+  limits.box_max = histogram_box.getMaxCorner();
+  limits.position = position;
+  limits.min_dist_sq = squared(min_realsense_dist);
+  limits.max_dist_sq = squared(histogram_box.radius_);
+  limits.backoff_dist_sq = squared(min_dist_backoff);
+
+  size_t n_input = 0;
+  for (const auto& cloud : complete_cloud) n_input += cloud.points.size();
+  cropped_cloud.points.reserve(n_input);
+
+  CropState state;
+  int index_offset = 0;
   for (const auto& cloud : complete_cloud) {
-    for (const pcl::PointXYZ& xyz : cloud) {
-      // Check if the point is invalid
-      if (!std::isnan(xyz.x) && !std::isnan(xyz.y) && !std::isnan(xyz.z)) {
-        if (histogram_box.isPointWithinBox(xyz.x, xyz.y, xyz.z)) {
-          distance = (position - toEigen(xyz)).norm();
-          if (distance > min_realsense_dist &&
-              distance < histogram_box.radius_) {
-            cropped_cloud.points.push_back(pcl::PointXYZ(xyz.x, xyz.y, xyz.z));
-            if (distance < distance_to_closest_point) {
-              distance_to_closest_point = distance;
-              closest_point = toEigen(xyz);
-            }
-            if (distance < min_dist_backoff) {
-              counter_backoff++;
-            }
-          }
-        }
+    cropCloud(cloud, index_offset, limits, cropped_cloud, state);
+    index_offset += static_cast<int>(cloud.points.size());
+  }
+
+  counter_backoff = state.counter_backoff;
+  distance_to_closest_point = HUGE_VAL;
+  if (!cropped_cloud.points.empty()) {
+    distance_to_closest_point = std::sqrt(state.closest_dist_sq);
+    int index = state.closest_index;
+    for (const auto& cloud : complete_cloud) {
+      if (index < static_cast<int>(cloud.points.size())) {
+        closest_point = toEigen(cloud.points[index]);
+        break;
       }
+      index -= static_cast<int>(cloud.points.size());
     }
   }
 
@@ -55,107 +389,708 @@ void filterPointCloud(
   }
 }
 
+void downsamplePointCloud(pcl::PointCloud<pcl::PointXYZ>& cloud,
+                          const Eigen::Vector3f& position, float leaf_size,
+                          float leaf_size_growth, int max_points) {
+  VoxelGridBuffers buffers;
+  downsamplePointCloud(cloud, position, leaf_size, leaf_size_growth,
+                       max_points, buffers);
+}
+
+void downsamplePointCloud(pcl::PointCloud<pcl::PointXYZ>& cloud,
+                          const Eigen::Vector3f& position, float leaf_size,
+                          float leaf_size_growth, int max_points,
+                          VoxelGridBuffers& buffers) {
+  if (leaf_size <= 0.f) return;
+
+  // The leaf size is quantized to powers of two of the base leaf size, the
+  // voxels of a level are aligned to the vehicle position. The key packs the
+  // level and the voxel indices, which stay within 20 bits for any distance
+  // inside the histogram box.
+  auto voxelKey = [&](const pcl::PointXYZ& xyz, float dist) {
+    const float growth = 1.f + leaf_size_growth * dist / leaf_size;
+    const int level = std::min(15, static_cast<int>(std::log2(growth)));
+    const float inv_leaf = 1.f / std::ldexp(leaf_size, level);
+    const int64_t offset = 1 << 19;
+    const int64_t x = std::floor((xyz.x - position.x()) * inv_leaf) + offset;
+    const int64_t y = std::floor((xyz.y - position.y()) * inv_leaf) + offset;
+    const int64_t z = std::floor((xyz.z - position.z()) * inv_leaf) + offset;
+    return (static_cast<uint64_t>(level) << 60) |
+           ((static_cast<uint64_t>(x) & 0xFFFFF) << 40) |
+           ((static_cast<uint64_t>(y) & 0xFFFFF) << 20) |
+           (static_cast<uint64_t>(z) & 0xFFFFF);
+  };
+
+  const uint32_t empty_slot = std::numeric_limits<uint32_t>::max();
+  do {
+    // power of two table with linear probing, at most half of it is used
+    int table_bits = 4;
+    while ((size_t(1) << table_bits) < 2 * cloud.points.size()) table_bits++;
+    const size_t table_mask = (size_t(1) << table_bits) - 1;
+    buffers.keys.resize(table_mask + 1);
+    buffers.voxel_index.assign(table_mask + 1, empty_slot);
+    buffers.voxel_dist.clear();
+
+    uint32_t n_voxels = 0;
+    for (const pcl::PointXYZ& xyz : cloud.points) {
+      const float dist = (toEigen(xyz) - position).norm();
+      const uint64_t key = voxelKey(xyz, dist);
+      size_t slot = (key * 0x9E3779B97F4A7C15ull) >> (64 - table_bits);
+      while (buffers.voxel_index[slot] != empty_slot &&
+             buffers.keys[slot] != key) {
+        slot = (slot + 1) & table_mask;
+      }
+
+      const uint32_t voxel = buffers.voxel_index[slot];
+      if (voxel == empty_slot) {
+        buffers.keys[slot] = key;
+        buffers.voxel_index[slot] = n_voxels;
+        // points are compacted in place, the write index never overtakes
+        // the read index
+        cloud.points[n_voxels++] = xyz;
+        buffers.voxel_dist.push_back(dist);
+      } else if (dist < buffers.voxel_dist[voxel]) {
+        cloud.points[voxel] = xyz;
+        buffers.voxel_dist[voxel] = dist;
+      }
+    }
+    cloud.points.resize(n_voxels);
+
+    leaf_size *= 2.f;
+  } while (max_points > 0 &&
+           cloud.points.size() > static_cast<size_t>(max_points));
+
+  cloud.width = cloud.points.size();
+  cloud.height = 1;
+}
+
+void buildObstacleIndex(const pcl::PointCloud<pcl::PointXYZ>& cloud,
+                        const Eigen::Vector3f& origin, float voxel_size,
+                        ObstacleIndex& index) {
+  index.centroids.points.clear();
+  index.weights.clear();
+
+  // the key packs the voxel indices relative to the origin, which stay within
+  // 21 bits for any distance inside the histogram box
+  const float inv_voxel_size = 1.f / voxel_size;
+  auto voxelIndex = [inv_voxel_size](float coordinate, float origin) {
+    const int64_t offset = 1 << 20;
+    const int64_t i = std::floor((coordinate - origin) * inv_voxel_size);
+    return static_cast<uint64_t>(i + offset) & 0x1FFFFF;
+  };
+  auto voxelKey = [&](const pcl::PointXYZ& xyz) {
+    return (voxelIndex(xyz.x, origin.x()) << 42) |
+           (voxelIndex(xyz.y, origin.y()) << 21) |
+           voxelIndex(xyz.z, origin.z());
+  };
+
+  // power of two table with linear probing, at most half of it is used
+  const uint32_t empty_slot = std::numeric_limits<uint32_t>::max();
+  int table_bits = 4;
+  while ((size_t(1) << table_bits) < 2 * cloud.points.size()) table_bits++;
+  const size_t table_mask = (size_t(1) << table_bits) - 1;
+  index.keys.resize(table_mask + 1);
+  index.voxel_index.assign(table_mask + 1, empty_slot);
+
+  // the centroids hold the coordinate sums until all points are added
+  uint32_t n_voxels = 0;
+  for (const pcl::PointXYZ& xyz : cloud.points) {
+    const uint64_t key = voxelKey(xyz);
+    size_t slot = (key * 0x9E3779B97F4A7C15ull) >> (64 - table_bits);
+    while (index.voxel_index[slot] != empty_slot && index.keys[slot] != key) {
+      slot = (slot + 1) & table_mask;
+    }
+
+    const uint32_t voxel = index.voxel_index[slot];
+    if (voxel == empty_slot) {
+      index.keys[slot] = key;
+      index.voxel_index[slot] = n_voxels++;
+      index.centroids.points.push_back(xyz);
+      index.weights.push_back(1);
+    } else {
+      pcl::PointXYZ& sum = index.centroids.points[voxel];
+      sum.x += xyz.x;
+      sum.y += xyz.y;
+      sum.z += xyz.z;
+      index.weights[voxel]++;
+    }
+  }
+
+  for (uint32_t voxel = 0; voxel < n_voxels; voxel++) {
+    pcl::PointXYZ& centroid = index.centroids.points[voxel];
+    const float inv_weight = 1.f / index.weights[voxel];
+    centroid.x *= inv_weight;
+    centroid.y *= inv_weight;
+    centroid.z *= inv_weight;
+  }
+  index.centroids.width = n_voxels;
+  index.centroids.height = 1;
+}
+
+bool isSegmentClear(const pcl::PointCloud<pcl::PointXYZ>& cloud,
+                    const Eigen::Vector3f& start, const Eigen::Vector3f& end,
+                    float clearance) {
+  const Eigen::Vector3f segment = end - start;
+  const float length_sq = segment.squaredNorm();
+  const float clearance_sq = clearance * clearance;
+  for (const pcl::PointXYZ& xyz : cloud.points) {
+    const Eigen::Vector3f point = toEigen(xyz) - start;
+    // parameter of the point on the segment closest to the obstacle
+    float t = length_sq > 0.f ? point.dot(segment) / length_sq : 0.f;
+    t = std::min(1.f, std::max(0.f, t));
+    if ((point - t * segment).squaredNorm() < clearance_sq) return false;
+  }
+  return true;
+}
+
+// decode, NaN-filter and transform a pointcloud message without intermediate
+// copies of the cloud
+bool transformPointCloudMsg(pcl::PointCloud<pcl::PointXYZ>& cloud,
+                            const sensor_msgs::PointCloud2& msg,
+                            const Eigen::Affine3f& transform,
+                            const std::string& target_frame) {
+  int offset_x = -1, offset_y = -1, offset_z = -1;
+  for (const sensor_msgs::PointField& field : msg.fields) {
+    if (field.datatype != sensor_msgs::PointField::FLOAT32) continue;
+    if (field.name == "x") offset_x = static_cast<int>(field.offset);
+    if (field.name == "y") offset_y = static_cast<int>(field.offset);
+    if (field.name == "z") offset_z = static_cast<int>(field.offset);
+  }
+
+  cloud.header.stamp = msg.header.stamp.toNSec() / 1000ull;  // [us]
+  cloud.header.frame_id = target_frame;
+  cloud.height = 1;
+  cloud.is_dense = true;
+
+  // the fields must lie within a point, the points within a row and the rows
+  // within the data, a malformed message is rejected instead of read past
+  const uint64_t max_offset = std::max(offset_x, std::max(offset_y, offset_z));
+  const bool is_valid =
+      offset_x >= 0 && offset_y >= 0 && offset_z >= 0 &&
+      max_offset + sizeof(float) <= msg.point_step &&
+      static_cast<uint64_t>(msg.width) * msg.point_step <= msg.row_step &&
+      static_cast<uint64_t>(msg.height) * msg.row_step <= msg.data.size();
+  if (!is_valid) {
+    cloud.points.clear();
+    cloud.width = 0;
+    return false;
+  }
+
+  // resize to the upper bound and shrink at the end, resize does not release
+  // the capacity of the buffer
+  cloud.points.resize(static_cast<size_t>(msg.width) * msg.height);
+  size_t n_points = 0;
+  for (uint32_t row = 0; row < msg.height; row++) {
+    const uint8_t* point_data = msg.data.data() + row * msg.row_step;
+    for (uint32_t col = 0; col < msg.width; col++) {
+      float x, y, z;
+      std::memcpy(&x, point_data + offset_x, sizeof(float));
+      std::memcpy(&y, point_data + offset_y, sizeof(float));
+      std::memcpy(&z, point_data + offset_z, sizeof(float));
+      point_data += msg.point_step;
+
+      // remove nan padding
+      if (std::isnan(x) || std::isnan(y) || std::isnan(z)) continue;
+
+      const Eigen::Vector3f p = transform * Eigen::Vector3f(x, y, z);
+      pcl::PointXYZ& xyz = cloud.points[n_points++];
+      xyz.x = p.x();
+      xyz.y = p.y();
+      xyz.z = p.z();
+    }
+  }
+  cloud.points.resize(n_points);
+  cloud.width = n_points;
+  return true;
+}
+
+void computePixelRays(std::vector<Eigen::Vector3f>& pixel_rays,
+                      const sensor_msgs::CameraInfo& camera_info, int stride) {
+  const float fx = static_cast<float>(camera_info.K[0]);
+  const float cx = static_cast<float>(camera_info.K[2]);
+  const float fy = static_cast<float>(camera_info.K[4]);
+  const float cy = static_cast<float>(camera_info.K[5]);
+
+  pixel_rays.clear();
+  for (uint32_t v = 0; v < camera_info.height; v += stride) {
+    for (uint32_t u = 0; u < camera_info.width; u += stride) {
+      pixel_rays.push_back(Eigen::Vector3f((u - cx) / fx, (v - cy) / fy, 1.f));
+    }
+  }
+}
+
+bool depthImageToPointCloud(pcl::PointCloud<pcl::PointXYZ>& cloud,
+                            const sensor_msgs::Image& msg,
+                            const std::vector<Eigen::Vector3f>& pixel_rays,
+                            int stride, const Eigen::Affine3f& transform,
+                            const std::string& target_frame) {
+  const bool is_16u = msg.encoding == sensor_msgs::image_encodings::TYPE_16UC1;
+  const bool is_32f = msg.encoding == sensor_msgs::image_encodings::TYPE_32FC1;
+  const size_t n_cols = (msg.width + stride - 1) / stride;
+  const size_t n_rows = (msg.height + stride - 1) / stride;
+  const uint64_t bytes_per_pixel = is_16u ? sizeof(uint16_t) : sizeof(float);
+
+  cloud.header.stamp = msg.header.stamp.toNSec() / 1000ull;  // [us]
+  cloud.header.frame_id = target_frame;
+  cloud.height = 1;
+  cloud.is_dense = true;
+  // the rows must lie within the data, a malformed image is rejected instead
+  // of read past
+  if ((!is_16u && !is_32f) || msg.is_bigendian ||
+      pixel_rays.size() != n_cols * n_rows ||
+      msg.width * bytes_per_pixel > msg.step ||
+      static_cast<uint64_t>(msg.height) * msg.step > msg.data.size()) {
+    cloud.points.clear();
+    cloud.width = 0;
+    return false;
+  }
+
+  // rotate the rays once per pixel, the translation is added afterwards
+  const Eigen::Matrix3f rotation = transform.linear();
+  const Eigen::Vector3f translation = transform.translation();
+  cloud.points.resize(pixel_rays.size());
+  size_t n_points = 0;
+  const Eigen::Vector3f* ray = pixel_rays.data();
+  for (uint32_t v = 0; v < msg.height; v += stride) {
+    const uint8_t* row_data = msg.data.data() + v * msg.step;
+    for (uint32_t u = 0; u < msg.width; u += stride, ray++) {
+      float depth;
+      if (is_16u) {
+        uint16_t depth_mm;
+        std::memcpy(&depth_mm, row_data + u * sizeof(uint16_t),
+                    sizeof(uint16_t));
+        depth = 0.001f * depth_mm;
+      } else {
+        std::memcpy(&depth, row_data + u * sizeof(float), sizeof(float));
+      }
+
+      // zero depth marks pixels without measurement
+      if (!(depth > 0.f) || std::isinf(depth)) continue;
+
+      const Eigen::Vector3f p = depth * (rotation * *ray) + translation;
+      pcl::PointXYZ& xyz = cloud.points[n_points++];
+      xyz.x = p.x();
+      xyz.y = p.y();
+      xyz.z = p.z();
+    }
+  }
+  cloud.points.resize(n_points);
+  cloud.width = n_points;
+  return true;
+}
+
+namespace {
+
+// constants of the angle to bin index conversion
+struct BinLimits {
+  float scale;     // rad to bins
+  float e_offset;  // bins below zero elevation
+  float z_offset;  // bins below zero azimuth
+  int e_dim;
+  int z_dim;
+};
+
+inline void binPointScalar(const pcl::PointXYZ& xyz,
+                           const Eigen::Vector3f& position,
+                           const BinLimits& limits, int& e_index, int& z_index,
+                           float& distance) {
+  const float dx = xyz.x - position.x();
+  const float dy = xyz.y - position.y();
+  const float dz = xyz.z - position.z();
+  const float den = std::sqrt(dx * dx + dy * dy);
+  distance = std::sqrt(den * den + dz * dz);
+  // truncation equals floor, the angles are offset to positive values
+  e_index = static_cast<int>(approxAtan2(dz, den) * limits.scale +
+                             limits.e_offset);
+  z_index =
+      static_cast<int>(approxAtan2(dx, dy) * limits.scale + limits.z_offset);
+  e_index = std::max(0, std::min(limits.e_dim - 1, e_index));
+  if (z_index >= limits.z_dim) z_index -= limits.z_dim;  // +180 deg wraps
+  z_index = std::max(0, z_index);
+}
+
+#if defined(AVX2_KERNELS)
+__attribute__((target("avx2"))) inline __m256 approxAtan2AVX2(__m256 y,
+                                                               __m256 x) {
+  const __m256 sign_mask = _mm256_set1_ps(-0.f);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 ax = _mm256_andnot_ps(sign_mask, x);
+  const __m256 ay = _mm256_andnot_ps(sign_mask, y);
+  const __m256 max_xy = _mm256_max_ps(ax, ay);
+  // the ratio is zero for a zero vector instead of NaN
+  const __m256 a =
+      _mm256_and_ps(_mm256_div_ps(_mm256_min_ps(ax, ay), max_xy),
+                    _mm256_cmp_ps(max_xy, zero, _CMP_GT_OQ));
+  const __m256 s = _mm256_mul_ps(a, a);
+  __m256 r = _mm256_set1_ps(ATAN2_COEFFS[4]);
+  for (int k = 3; k >= 0; k--) {
+    r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(ATAN2_COEFFS[k]));
+  }
+  r = _mm256_mul_ps(r, a);
+  r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(M_PI_F / 2.f), r),
+                       _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+  r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(M_PI_F), r),
+                       _mm256_cmp_ps(x, zero, _CMP_LT_OQ));
+  return _mm256_xor_ps(
+      r, _mm256_and_ps(sign_mask, _mm256_cmp_ps(y, zero, _CMP_LT_OQ)));
+}
+
+// bins eight points, loaded with the in-lane transpose of cropCloudAVX2
+__attribute__((target("avx2"))) void binPointsAVX2(
+    const pcl::PointXYZ* points, const Eigen::Vector3f& position,
+    const BinLimits& limits, PointBinBatch& batch) {
+  __m256 r[4];
+  for (int k = 0; k < 4; k++) {
+    r[k] = _mm256_insertf128_ps(
+        _mm256_castps128_ps256(_mm_loadu_ps(&points[k].x)),
+        _mm_loadu_ps(&points[k + 4].x), 1);
+  }
+  const __m256 t0 = _mm256_unpacklo_ps(r[0], r[1]);
+  const __m256 t1 = _mm256_unpacklo_ps(r[2], r[3]);
+  const __m256 t2 = _mm256_unpackhi_ps(r[0], r[1]);
+  const __m256 t3 = _mm256_unpackhi_ps(r[2], r[3]);
+  const __m256 dx = _mm256_sub_ps(
+      _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0)),
+      _mm256_set1_ps(position.x()));
+  const __m256 dy = _mm256_sub_ps(
+      _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2)),
+      _mm256_set1_ps(position.y()));
+  const __m256 dz = _mm256_sub_ps(
+      _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0)),
+      _mm256_set1_ps(position.z()));
+
+  const __m256 den_sq =
+      _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+  const __m256 den = _mm256_sqrt_ps(den_sq);
+  const __m256 distance =
+      _mm256_sqrt_ps(_mm256_add_ps(den_sq, _mm256_mul_ps(dz, dz)));
+
+  const __m256 scale = _mm256_set1_ps(limits.scale);
+  __m256i e_index = _mm256_cvttps_epi32(
+      _mm256_add_ps(_mm256_mul_ps(approxAtan2AVX2(dz, den), scale),
+                    _mm256_set1_ps(limits.e_offset)));
+  __m256i z_index = _mm256_cvttps_epi32(
+      _mm256_add_ps(_mm256_mul_ps(approxAtan2AVX2(dx, dy), scale),
+                    _mm256_set1_ps(limits.z_offset)));
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i e_max = _mm256_set1_epi32(limits.e_dim - 1);
+  const __m256i z_max = _mm256_set1_epi32(limits.z_dim - 1);
+  const __m256i z_dim = _mm256_set1_epi32(limits.z_dim);
+  e_index = _mm256_max_epi32(zero, _mm256_min_epi32(e_max, e_index));
+  z_index = _mm256_sub_epi32(
+      z_index, _mm256_and_si256(z_dim, _mm256_cmpgt_epi32(z_index, z_max)));
+  z_index = _mm256_max_epi32(zero, z_index);
+
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(batch.e_index), e_index);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(batch.z_index), z_index);
+  _mm256_storeu_ps(batch.distance, distance);
+}
+#endif
+
+#if defined(__SSE2__)
+inline __m128 approxAtan2SSE(__m128 y, __m128 x) {
+  const __m128 sign_mask = _mm_set1_ps(-0.f);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 ax = _mm_andnot_ps(sign_mask, x);
+  const __m128 ay = _mm_andnot_ps(sign_mask, y);
+  const __m128 max_xy = _mm_max_ps(ax, ay);
+  // the ratio is zero for a zero vector instead of NaN
+  const __m128 a = _mm_and_ps(_mm_div_ps(_mm_min_ps(ax, ay), max_xy),
+                              _mm_cmpgt_ps(max_xy, zero));
+  const __m128 s = _mm_mul_ps(a, a);
+  __m128 r = _mm_set1_ps(ATAN2_COEFFS[4]);
+  for (int k = 3; k >= 0; k--) {
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN2_COEFFS[k]));
+  }
+  r = _mm_mul_ps(r, a);
+  r = select(_mm_cmpgt_ps(ay, ax), _mm_sub_ps(_mm_set1_ps(M_PI_F / 2.f), r),
+             r);
+  r = select(_mm_cmplt_ps(x, zero), _mm_sub_ps(_mm_set1_ps(M_PI_F), r), r);
+  return _mm_xor_ps(r, _mm_and_ps(sign_mask, _mm_cmplt_ps(y, zero)));
+}
+
+// bins eight points as two groups of four
+void binPointsSSE(const pcl::PointXYZ* points, const Eigen::Vector3f& position,
+                  const BinLimits& limits, PointBinBatch& batch) {
+  const __m128 scale = _mm_set1_ps(limits.scale);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i e_max = _mm_set1_epi32(limits.e_dim - 1);
+  const __m128i z_max = _mm_set1_epi32(limits.z_dim - 1);
+  const __m128i z_dim = _mm_set1_epi32(limits.z_dim);
+  for (int i = 0; i < PointBinBatch::SIZE; i += 4) {
+    __m128 x = _mm_loadu_ps(&points[i].x);
+    __m128 y = _mm_loadu_ps(&points[i + 1].x);
+    __m128 z = _mm_loadu_ps(&points[i + 2].x);
+    __m128 w = _mm_loadu_ps(&points[i + 3].x);
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    const __m128 dx = _mm_sub_ps(x, _mm_set1_ps(position.x()));
+    const __m128 dy = _mm_sub_ps(y, _mm_set1_ps(position.y()));
+    const __m128 dz = _mm_sub_ps(z, _mm_set1_ps(position.z()));
+
+    const __m128 den_sq = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+    const __m128 den = _mm_sqrt_ps(den_sq);
+    const __m128 distance = _mm_sqrt_ps(_mm_add_ps(den_sq, _mm_mul_ps(dz, dz)));
+
+    __m128i e_index = _mm_cvttps_epi32(
+        _mm_add_ps(_mm_mul_ps(approxAtan2SSE(dz, den), scale),
+                   _mm_set1_ps(limits.e_offset)));
+    __m128i z_index = _mm_cvttps_epi32(
+        _mm_add_ps(_mm_mul_ps(approxAtan2SSE(dx, dy), scale),
+                   _mm_set1_ps(limits.z_offset)));
+    e_index = select(_mm_cmpgt_epi32(e_index, e_max), e_max, e_index);
+    e_index = select(_mm_cmplt_epi32(e_index, zero), zero, e_index);
+    z_index = _mm_sub_epi32(
+        z_index, _mm_and_si128(z_dim, _mm_cmpgt_epi32(z_index, z_max)));
+    z_index = select(_mm_cmplt_epi32(z_index, zero), zero, z_index);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(batch.e_index + i), e_index);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(batch.z_index + i), z_index);
+    _mm_storeu_ps(batch.distance + i, distance);
+  }
+}
+#endif
+
+// bins the first n <= PointBinBatch::SIZE points of the array
+void binPoints(const pcl::PointXYZ* points, int n,
+               const Eigen::Vector3f& position, int res, PointBinBatch& batch) {
+  BinLimits limits;
+  limits.scale = RAD_TO_DEG / res;
+  limits.e_offset = 90.f / res;
+  limits.z_offset = 180.f / res;
+  limits.e_dim = 180 / res;
+  limits.z_dim = 360 / res;
+
+  if (n == PointBinBatch::SIZE) {
+#if defined(AVX2_KERNELS)
+    if (cpuSupportsAVX2()) {
+      binPointsAVX2(points, position, limits, batch);
+      return;
+    }
+#endif
+#if defined(__SSE2__)
+    binPointsSSE(points, position, limits, batch);
+    return;
+#endif
+  }
+  for (int i = 0; i < n; i++) {
+    binPointScalar(points[i], position, limits, batch.e_index[i],
+                   batch.z_index[i], batch.distance[i]);
+  }
+}
+
+// reprojects the bin corners of the previous histogram around position and
+// sums their count, age and distance per bin of the half resolution histogram.
+// The corners are binned in batches from a stack buffer
+template <int RES, typename CounterMatrix>
+void accumulatePropagatedBins(const PolarHistogram<RES>& previous_histogram,
+                              const Eigen::Vector3f& previous_position,
+                              const Eigen::Vector3f& position, float max_dist,
+                              int max_age, CounterMatrix& counter,
+                              PolarHistogram<2 * RES>& sums) {
+  static_assert(PointBinBatch::SIZE % 4 == 0,
+                "a batch must hold the corners of whole bins");
+  const HistogramLookupTable<RES>& lookup = HistogramLookupTable<RES>::get();
+  // corner order of reprojectHistogram
+  const int e_edge_offset[4] = {1, 0, 1, 0};
+  const int z_edge_offset[4] = {1, 1, 0, 0};
+  pcl::PointXYZ corners[PointBinBatch::SIZE];
+  int ages[PointBinBatch::SIZE];
+  PointBinBatch batch;
+  int n = 0;
+
+  auto flush = [&]() {
+    binPoints(corners, n, position, 2 * RES, batch);
+    for (int k = 0; k < n; k++) {
+      if (batch.distance[k] < max_dist && batch.distance[k] > 0.3f) {
+        const int e = batch.e_index[k];
+        const int z = batch.z_index[k];
+        counter(e, z) += 1;
+        sums.set_age(e, z, sums.age(e, z) + ages[k]);
+        sums.set_dist(e, z, sums.dist(e, z) + batch.distance[k]);
+      }
+    }
+    n = 0;
+  };
+
+  for (int e = 0; e < PolarHistogram<RES>::E_DIM; e++) {
+    for (int z = 0; z < PolarHistogram<RES>::Z_DIM; z++) {
+      const float r = previous_histogram.dist(e, z);
+      const int age = previous_histogram.age(e, z);
+      if (r > FLT_MIN && age < max_age) {
+        for (int i = 0; i < 4; i++) {
+          corners[n] = toXYZ(
+              previous_position +
+              r * lookup.binCorner(e + e_edge_offset[i], z + z_edge_offset[i]));
+          ages[n++] = age;
+        }
+        if (n == PointBinBatch::SIZE) flush();
+      }
+    }
+  }
+  if (n > 0) flush();
+}
+}  // namespace
+
+int binPointBatch(const pcl::PointCloud<pcl::PointXYZ>& cloud, size_t begin,
+                  const Eigen::Vector3f& position, int res,
+                  PointBinBatch& batch) {
+  const size_t end =
+      std::min(cloud.points.size(), begin + PointBinBatch::SIZE);
+  if (begin >= end) return 0;
+  const int n = static_cast<int>(end - begin);
+  binPoints(cloud.points.data() + begin, n, position, res, batch);
+  return n;
+}
+
 // Calculate FOV. Azimuth angle is wrapped, elevation is not!
-void calculateFOV(float h_fov, float v_fov, std::vector<int>& z_FOV_idx,
+template <int RES>
+void calculateFOV(float h_fov, float v_fov, FOVMask& z_FOV_mask,
                   int& e_FOV_min, int& e_FOV_max, float yaw_deg_histogram_frame,
                   float pitch_deg) {
+  static_assert(PolarHistogram<RES>::Z_DIM <= 360 / ALPHA_RES_FINE,
+                "the FOV mask is too small for the bin size");
   PolarPoint max_angle(pitch_deg + v_fov / 2.0f,
                        yaw_deg_histogram_frame + h_fov / 2.0f, 1.f);
   PolarPoint min_angle(pitch_deg - v_fov / 2.0f,
                        yaw_deg_histogram_frame - h_fov / 2.0f, 1.f);
-  Eigen::Vector2i max_ind = polarToHistogramIndex(max_angle, ALPHA_RES);
-  Eigen::Vector2i min_ind = polarToHistogramIndex(min_angle, ALPHA_RES);
+  Eigen::Vector2i max_ind = polarToHistogramIndex(max_angle, RES);
+  Eigen::Vector2i min_ind = polarToHistogramIndex(min_angle, RES);
 
   e_FOV_max = max_ind.y();
   e_FOV_min = min_ind.y();
+  z_FOV_mask.reset();
 
   // indices not wrapped
   if (max_ind.x() > min_ind.x()) {
     for (int i = min_ind.x(); i <= max_ind.x(); i++) {
-      z_FOV_idx.push_back(i);
+      z_FOV_mask.set(i);
     }
   }
 
   // indices wrapped
   if (min_ind.x() > max_ind.x()) {
     for (int i = 0; i <= max_ind.x(); i++) {
-      z_FOV_idx.push_back(i);
+      z_FOV_mask.set(i);
     }
-    for (int i = min_ind.x(); i < GRID_LENGTH_Z; i++) {
-      z_FOV_idx.push_back(i);
+    for (int i = min_ind.x(); i < PolarHistogram<RES>::Z_DIM; i++) {
+      z_FOV_mask.set(i);
     }
   }
 }
 
-// Build histogram estimate from reprojected points
-void propagateHistogram(
-    Histogram& polar_histogram_est,
-    const pcl::PointCloud<pcl::PointXYZ>& reprojected_points,
-    const std::vector<int>& reprojected_points_age,
-    const Eigen::Vector3f& position) {
-  Eigen::MatrixXi counter(GRID_LENGTH_E / 2, GRID_LENGTH_Z / 2);
+template <int RES>
+void calculateFOV(float h_fov, float v_fov, std::vector<int>& z_FOV_idx,
+                  int& e_FOV_min, int& e_FOV_max, float yaw_deg_histogram_frame,
+                  float pitch_deg) {
+  FOVMask z_FOV_mask;
+  calculateFOV<RES>(h_fov, v_fov, z_FOV_mask, e_FOV_min, e_FOV_max,
+                    yaw_deg_histogram_frame, pitch_deg);
+  for (int z = 0; z < PolarHistogram<RES>::Z_DIM; z++) {
+    if (z_FOV_mask[z]) z_FOV_idx.push_back(z);
+  }
+}
+
+// Reproject the occupied bins of a histogram into 3D space
+template <int RES>
+void reprojectHistogram(pcl::PointCloud<pcl::PointXYZ>& reprojected_points,
+                        std::vector<int>& reprojected_points_age,
+                        const PolarHistogram<RES>& histogram,
+                        const Eigen::Vector3f& histogram_position,
+                        const Eigen::Vector3f& position, float max_dist,
+                        int max_age) {
+  const HistogramLookupTable<RES>& lookup = HistogramLookupTable<RES>::get();
+  Eigen::Vector3f temp_array[4];
+  reprojected_points.points.clear();
+  reprojected_points_age.clear();
+
+  for (int e = 0; e < PolarHistogram<RES>::E_DIM; e++) {
+    for (int z = 0; z < PolarHistogram<RES>::Z_DIM; z++) {
+      const float r = histogram.dist(e, z);
+      const int age = histogram.age(e, z);
+      if (r > FLT_MIN && age < max_age) {
+        // transform the four bin corners from Polar to Cartesian
+        const Eigen::Vector3f& p = histogram_position;
+        temp_array[0] = p + r * lookup.binCorner(e + 1, z + 1);
+        temp_array[1] = p + r * lookup.binCorner(e, z + 1);
+        temp_array[2] = p + r * lookup.binCorner(e + 1, z);
+        temp_array[3] = p + r * lookup.binCorner(e, z);
+
+        for (int i = 0; i < 4; i++) {
+          float dist = (position - temp_array[i]).norm();
+          if (dist < max_dist && dist > 0.3f) {
+            reprojected_points.points.push_back(toXYZ(temp_array[i]));
+            reprojected_points_age.push_back(age);
+          }
+        }
+      }
+    }
+  }
+  reprojected_points.width = reprojected_points.points.size();
+  reprojected_points.height = 1;
+}
+
+// Build histogram estimate by warping the previous histogram
+template <int RES>
+void propagateHistogram(PolarHistogram<RES>& polar_histogram_est,
+                        const PolarHistogram<RES>& previous_histogram,
+                        const Eigen::Vector3f& previous_position,
+                        const Eigen::Vector3f& position, float max_dist,
+                        int max_age) {
+  typedef PolarHistogram<2 * RES> LowResHistogram;
+  LowResHistogram low_res_histogram;
+  Eigen::Matrix<int, LowResHistogram::E_DIM, LowResHistogram::Z_DIM,
+                Eigen::RowMajor>
+      counter;
   counter.fill(0);
+  accumulatePropagatedBins(previous_histogram, previous_position, position,
+                           max_dist, max_age, counter, low_res_histogram);
 
-  for (size_t i = 0; i < reprojected_points.points.size(); i++) {
-    PolarPoint p_pol =
-        cartesianToPolar(toEigen(reprojected_points.points[i]), position);
-    Eigen::Vector2i p_ind = polarToHistogramIndex(p_pol, 2 * ALPHA_RES);
-    float point_distance =
-        (position - toEigen(reprojected_points.points[i])).norm();
-
-    counter(p_ind.y(), p_ind.x()) += 1;
-    polar_histogram_est.set_age(
-        p_ind.y(), p_ind.x(),
-        polar_histogram_est.get_age(p_ind.y(), p_ind.x()) +
-            reprojected_points_age[i]);
-    polar_histogram_est.set_dist(
-        p_ind.y(), p_ind.x(),
-        polar_histogram_est.get_dist(p_ind.y(), p_ind.x()) + point_distance);
-  }
-
-  for (int e = 0; e < GRID_LENGTH_E / 2; e++) {
-    for (int z = 0; z < GRID_LENGTH_Z / 2; z++) {
+  for (int e = 0; e < LowResHistogram::E_DIM; e++) {
+    for (int z = 0; z < LowResHistogram::Z_DIM; z++) {
       if (counter(e, z) >= 6) {
-        polar_histogram_est.set_dist(
-            e, z, polar_histogram_est.get_dist(e, z) / counter(e, z));
-        polar_histogram_est.set_age(
-            e, z, static_cast<int>(polar_histogram_est.get_age(e, z) /
-                                   counter(e, z)));
+        low_res_histogram.set_dist(
+            e, z, low_res_histogram.dist(e, z) / counter(e, z));
+        low_res_histogram.set_age(
+            e, z,
+            static_cast<int>(low_res_histogram.age(e, z) / counter(e, z)));
       } else {  // not enough points to confidently block cell
-        polar_histogram_est.set_dist(e, z, 0.f);
-        polar_histogram_est.set_age(e, z, 0);
+        low_res_histogram.set_dist(e, z, 0.f);
+        low_res_histogram.set_age(e, z, 0);
       }
     }
   }
 
   // Upsample propagated histogram
-  polar_histogram_est.upsample();
+  upsample(low_res_histogram, polar_histogram_est);
 }
 
 // Generate new histogram from pointcloud
-void generateNewHistogram(Histogram& polar_histogram,
+template <int RES>
+void generateNewHistogram(PolarHistogram<RES>& polar_histogram,
                           const pcl::PointCloud<pcl::PointXYZ>& cropped_cloud,
                           const Eigen::Vector3f& position) {
-  Eigen::MatrixXi counter(GRID_LENGTH_E, GRID_LENGTH_Z);
+  typedef PolarHistogram<RES> Hist;
+  Eigen::Matrix<int, Hist::E_DIM, Hist::Z_DIM, Eigen::RowMajor> counter;
   counter.fill(0);
-  for (auto xyz : cropped_cloud) {
-    Eigen::Vector3f p = toEigen(xyz);
-    float dist = (p - position).norm();
-    PolarPoint p_pol = cartesianToPolar(p, position);
-    Eigen::Vector2i p_ind = polarToHistogramIndex(p_pol, ALPHA_RES);
-
-    counter(p_ind.y(), p_ind.x()) += 1;
-    polar_histogram.set_dist(
-        p_ind.y(), p_ind.x(),
-        polar_histogram.get_dist(p_ind.y(), p_ind.x()) + dist);
+  PointBinBatch batch;
+  for (size_t i = 0; i < cropped_cloud.points.size();
+       i += PointBinBatch::SIZE) {
+    const int n = binPointBatch(cropped_cloud, i, position, RES, batch);
+    for (int k = 0; k < n; k++) {
+      const int e = batch.e_index[k];
+      const int z = batch.z_index[k];
+      counter(e, z) += 1;
+      polar_histogram.set_dist(e, z,
+                               polar_histogram.dist(e, z) + batch.distance[k]);
+    }
   }
 
   // Normalize and get mean in distance bins
-  for (int e = 0; e < GRID_LENGTH_E; e++) {
-    for (int z = 0; z < GRID_LENGTH_Z; z++) {
+  for (int e = 0; e < Hist::E_DIM; e++) {
+    for (int z = 0; z < Hist::Z_DIM; z++) {
       if (counter(e, z) > 0) {
-        polar_histogram.set_dist(
-            e, z, polar_histogram.get_dist(e, z) / counter(e, z));
+        polar_histogram.set_dist(e, z,
+                                 polar_histogram.dist(e, z) / counter(e, z));
       } else {
         polar_histogram.set_dist(e, z, 0.f);
       }
@@ -164,63 +1099,284 @@ void generateNewHistogram(Histogram& polar_histogram,
 }
 
 // Combine propagated histogram and new histogram to the final binary histogram
-void combinedHistogram(bool& hist_empty, Histogram& new_hist,
-                       const Histogram& propagated_hist,
+template <int RES>
+void combinedHistogram(bool& hist_empty, PolarHistogram<RES>& new_hist,
+                       const PolarHistogram<RES>& propagated_hist,
                        bool waypoint_outside_FOV,
                        const std::vector<int>& z_FOV_idx, int e_FOV_min,
                        int e_FOV_max) {
+  typedef PolarHistogram<RES> Hist;
+  bool inside_FOV_z[Hist::Z_DIM] = {};
+  for (int z : z_FOV_idx) {
+    if (z >= 0 && z < Hist::Z_DIM) inside_FOV_z[z] = true;
+  }
+
   hist_empty = true;
-  for (int z = 0; z < GRID_LENGTH_Z; z++) {
-    bool inside_FOV_z =
-        std::find(z_FOV_idx.begin(), z_FOV_idx.end(), z) != z_FOV_idx.end();
-    for (int e = 0; e < GRID_LENGTH_E; e++) {
-      if (inside_FOV_z && e > e_FOV_min && e < e_FOV_max) {  // inside FOV
-        if (new_hist.get_dist(e, z) > 0) {
+  for (int e = 0; e < Hist::E_DIM; e++) {
+    const bool inside_FOV_e = e > e_FOV_min && e < e_FOV_max;
+    for (int z = 0; z < Hist::Z_DIM; z++) {
+      if (inside_FOV_z[z] && inside_FOV_e) {  // inside FOV
+        if (new_hist.dist(e, z) > 0) {
           new_hist.set_age(e, z, 1);
           hist_empty = false;
         }
       } else {
-        if (propagated_hist.get_dist(e, z) > 0) {
+        if (propagated_hist.dist(e, z) > 0) {
           if (waypoint_outside_FOV) {
-            new_hist.set_age(e, z, propagated_hist.get_age(e, z));
+            new_hist.set_age(e, z, propagated_hist.age(e, z));
           } else {
-            new_hist.set_age(e, z, propagated_hist.get_age(e, z) + 1);
+            new_hist.set_age(e, z, propagated_hist.age(e, z) + 1);
           }
           hist_empty = false;
         }
-        if (new_hist.get_dist(e, z) > 0) {
+        if (new_hist.dist(e, z) > 0) {
           new_hist.set_age(e, z, 1);
           hist_empty = false;
         }
-        if (propagated_hist.get_dist(e, z) > 0 &&
-            new_hist.get_dist(e, z) < FLT_MIN) {
-          new_hist.set_dist(e, z, propagated_hist.get_dist(e, z));
+        if (propagated_hist.dist(e, z) > 0 && new_hist.dist(e, z) < FLT_MIN) {
+          new_hist.set_dist(e, z, propagated_hist.dist(e, z));
+        }
+      }
+    }
+  }
+}
+
+namespace {
+// Build the combined histogram from weighted points and the reprojected points
+// in a single sweep over the bins. Without weights every point counts once,
+// points at max_point_dist or farther are left out, as well as the points
+// outside the FOV if only_inside_FOV is set
+template <int RES>
+void generateCombinedHistogramImpl(
+    PolarHistogram<RES>& polar_histogram, bool& hist_empty,
+    const pcl::PointXYZ* points, const int* weights, size_t n_points,
+    float max_point_dist, bool only_inside_FOV,
+    const PolarHistogram<RES>& previous_histogram,
+    const Eigen::Vector3f& previous_position, const Eigen::Vector3f& position,
+    float max_dist, int max_age, bool waypoint_outside_FOV,
+    const FOVMask& z_FOV_mask, int e_FOV_min, int e_FOV_max) {
+  typedef PolarHistogram<RES> Hist;
+  typedef PolarHistogram<2 * RES> LowResHistogram;
+  Eigen::Matrix<int, Hist::E_DIM, Hist::Z_DIM, Eigen::RowMajor> counter;
+  Eigen::Matrix<int, LowResHistogram::E_DIM, LowResHistogram::Z_DIM,
+                Eigen::RowMajor>
+      low_res_counter;
+  // sums of the age and distance of the reprojected corners in every bin
+  LowResHistogram low_res_histogram;
+  counter.fill(0);
+  low_res_counter.fill(0);
+
+  // the previous histogram is read before the output is reset, they may be
+  // the same object
+  accumulatePropagatedBins(previous_histogram, previous_position, position,
+                           max_dist, max_age, low_res_counter,
+                           low_res_histogram);
+  polar_histogram.setZero();
+
+  PointBinBatch batch;
+  for (size_t i = 0; i < n_points; i += PointBinBatch::SIZE) {
+    const int n = static_cast<int>(
+        std::min<size_t>(PointBinBatch::SIZE, n_points - i));
+    binPoints(points + i, n, position, RES, batch);
+    for (int k = 0; k < n; k++) {
+      if (batch.distance[k] >= max_point_dist) continue;
+      const int weight = weights ? weights[i + k] : 1;
+      const int e = batch.e_index[k];
+      const int z = batch.z_index[k];
+      if (only_inside_FOV &&
+          !(z_FOV_mask[z] && e > e_FOV_min && e < e_FOV_max)) {
+        continue;
+      }
+      counter(e, z) += weight;
+      polar_histogram.set_dist(
+          e, z, polar_histogram.dist(e, z) + weight * batch.distance[k]);
+    }
+  }
+
+  hist_empty = true;
+  for (int e = 0; e < Hist::E_DIM; e++) {
+    const bool inside_FOV_e = e > e_FOV_min && e < e_FOV_max;
+    for (int z = 0; z < Hist::Z_DIM; z++) {
+      float new_dist = 0.f;
+      if (counter(e, z) > 0) {
+        new_dist = polar_histogram.dist(e, z) / counter(e, z);
+      }
+
+      // propagated cell, not enough points to confidently block it below 6
+      const int e_low_res = e / 2;
+      const int z_low_res = z / 2;
+      const int n_propagated = low_res_counter(e_low_res, z_low_res);
+      float propagated_dist = 0.f;
+      int propagated_age = 0;
+      if (n_propagated >= 6) {
+        propagated_dist =
+            low_res_histogram.dist(e_low_res, z_low_res) / n_propagated;
+        propagated_age = static_cast<int>(
+            low_res_histogram.age(e_low_res, z_low_res) / n_propagated);
+      }
+
+      int age = 0;
+      if (z_FOV_mask[z] && inside_FOV_e) {  // inside FOV
+        if (new_dist > 0) {
+          age = 1;
+          hist_empty = false;
+        }
+      } else {
+        if (propagated_dist > 0) {
+          age = waypoint_outside_FOV ? propagated_age : propagated_age + 1;
+          hist_empty = false;
+        }
+        if (new_dist > 0) {
+          age = 1;
+          hist_empty = false;
+        }
+        if (propagated_dist > 0 && new_dist < FLT_MIN) {
+          new_dist = propagated_dist;
         }
       }
+      polar_histogram.set_age(e, z, age);
+      polar_histogram.set_dist(e, z, new_dist);
     }
   }
 }
+}  // namespace
+
+template <int RES>
+void generateCombinedHistogram(
+    PolarHistogram<RES>& polar_histogram, bool& hist_empty,
+    const pcl::PointCloud<pcl::PointXYZ>& cropped_cloud,
+    const PolarHistogram<RES>& previous_histogram,
+    const Eigen::Vector3f& previous_position, const Eigen::Vector3f& position,
+    float max_dist, int max_age, bool waypoint_outside_FOV,
+    const FOVMask& z_FOV_mask, int e_FOV_min, int e_FOV_max) {
+  generateCombinedHistogramImpl(
+      polar_histogram, hist_empty, cropped_cloud.points.data(), nullptr,
+      cropped_cloud.points.size(), std::numeric_limits<float>::infinity(),
+      false, previous_histogram, previous_position, position, max_dist,
+      max_age, waypoint_outside_FOV, z_FOV_mask, e_FOV_min, e_FOV_max);
+}
+
+template <int RES>
+void generateCombinedHistogram(
+    PolarHistogram<RES>& polar_histogram, bool& hist_empty,
+    const ObstacleIndex& obstacle_index,
+    const PolarHistogram<RES>& previous_histogram,
+    const Eigen::Vector3f& previous_position, const Eigen::Vector3f& position,
+    float max_dist, int max_age, bool waypoint_outside_FOV,
+    const FOVMask& z_FOV_mask, int e_FOV_min, int e_FOV_max) {
+  // the radius query shares the range of the obstacle memory
+  generateCombinedHistogramImpl(
+      polar_histogram, hist_empty, obstacle_index.centroids.points.data(),
+      obstacle_index.weights.data(), obstacle_index.centroids.points.size(),
+      max_dist, false, previous_histogram, previous_position, position,
+      max_dist, max_age, waypoint_outside_FOV, z_FOV_mask, e_FOV_min,
+      e_FOV_max);
+}
 
-void compressHistogramElevation(Histogram& new_hist,
-                                const Histogram& input_hist) {
+template <int RES>
+void updateHistogramSlices(
+    PolarHistogram<RES>& polar_histogram, bool& hist_empty,
+    const pcl::PointCloud<pcl::PointXYZ>& cropped_cloud,
+    const PolarHistogram<RES>& previous_histogram,
+    const Eigen::Vector3f& previous_position, const Eigen::Vector3f& position,
+    float max_dist, int max_age, bool waypoint_outside_FOV,
+    const FOVMask& z_slice_mask, int e_slice_min, int e_slice_max) {
+  // the slices are rebuilt like the FOV, the points outside of them have
+  // already been binned into the previous histogram
+  generateCombinedHistogramImpl(
+      polar_histogram, hist_empty, cropped_cloud.points.data(), nullptr,
+      cropped_cloud.points.size(), std::numeric_limits<float>::infinity(),
+      true, previous_histogram, previous_position, position, max_dist,
+      max_age, waypoint_outside_FOV, z_slice_mask, e_slice_min, e_slice_max);
+}
+
+template <int RES>
+void compressHistogramElevation(PolarHistogram<RES>& new_hist,
+                                const PolarHistogram<RES>& input_hist) {
   float vertical_FOV_range_sensor = 20.0;
   PolarPoint p_pol_lower(-1.0f * vertical_FOV_range_sensor / 2.0f, 0.0f, 0.0f);
   PolarPoint p_pol_upper(vertical_FOV_range_sensor / 2.0f, 0.0f, 0.0f);
-  Eigen::Vector2i p_ind_lower = polarToHistogramIndex(p_pol_lower, ALPHA_RES);
-  Eigen::Vector2i p_ind_upper = polarToHistogramIndex(p_pol_upper, ALPHA_RES);
+  Eigen::Vector2i p_ind_lower = polarToHistogramIndex(p_pol_lower, RES);
+  Eigen::Vector2i p_ind_upper = polarToHistogramIndex(p_pol_upper, RES);
 
   for (int e = p_ind_lower.y(); e <= p_ind_upper.y(); e++) {
-    for (int z = 0; z < GRID_LENGTH_Z; z++) {
-      if (input_hist.get_dist(e, z) > 0) {
-        if (input_hist.get_dist(e, z) < new_hist.get_dist(0, z) ||
-            (new_hist.get_dist(0, z) == 0.f))
-          new_hist.set_dist(0, z, input_hist.get_dist(e, z));
+    for (int z = 0; z < PolarHistogram<RES>::Z_DIM; z++) {
+      if (input_hist.dist(e, z) > 0) {
+        if (input_hist.dist(e, z) < new_hist.dist(0, z) ||
+            (new_hist.dist(0, z) == 0.f))
+          new_hist.set_dist(0, z, input_hist.dist(e, z));
       }
     }
   }
 }
 
-void getCostMatrix(const Histogram& histogram, const Eigen::Vector3f& goal,
+namespace {
+
+// keeps the n cheapest items in the max-heap
+template <typename T>
+inline void pushCheapest(std::vector<T>& heap, size_t n, const T& item) {
+  if (heap.size() < n) {
+    heap.push_back(item);
+    std::push_heap(heap.begin(), heap.end());
+  } else if (item < heap.front()) {
+    std::pop_heap(heap.begin(), heap.end());
+    heap.back() = item;
+    std::push_heap(heap.begin(), heap.end());
+  }
+}
+
+inline float obstacleDistanceCost(float obstacle_distance) {
+  return obstacle_distance > 0.0f ? 700.0f / obstacle_distance : 0.0f;
+}
+
+// number of bins at an elevation which are about as wide as a single bin at
+// horizontal, only every step_size-th bin of the row is evaluated
+inline int azimuthStepSize(float bin_width) {
+  return static_cast<int>(std::round(1 / bin_width));
+}
+
+// horizontally interpolates the bins between every step_size-th bin of a
+// matrix row, the last bins are interpolated towards the bin at azimuth 0
+void interpolateRow(Eigen::MatrixXf& matrix, int e_index, int step_size) {
+  const int cols = matrix.cols();
+  int last_index = 0;
+  for (int z_index = step_size; z_index < cols; z_index += step_size) {
+    float gradient =
+        (matrix(e_index, z_index) - matrix(e_index, last_index)) / step_size;
+    for (int i = 1; i < step_size; i++) {
+      matrix(e_index, last_index + i) =
+          matrix(e_index, last_index) + gradient * i;
+    }
+    last_index = z_index;
+  }
+
+  // special case the last columns wrapping around back to 0
+  int clamped_z_scale = cols - last_index;
+  float gradient =
+      (matrix(e_index, 0) - matrix(e_index, last_index)) / clamped_z_scale;
+  for (int i = 1; i < clamped_z_scale; i++) {
+    matrix(e_index, last_index + i) =
+        matrix(e_index, last_index) + gradient * i;
+  }
+}
+
+// unsmoothed distance cost of a histogram row, evaluated at every
+// step_size-th bin and interpolated in between
+template <int RES>
+void evaluateDistanceRow(const PolarHistogram<RES>& histogram, int e_index,
+                         int step_size, Eigen::MatrixXf& distance_matrix) {
+  for (int z_index = 0; z_index < PolarHistogram<RES>::Z_DIM;
+       z_index += step_size) {
+    distance_matrix(e_index, z_index) =
+        obstacleDistanceCost(histogram.dist(e_index, z_index));
+  }
+  if (step_size > 1) interpolateRow(distance_matrix, e_index, step_size);
+}
+}  // namespace
+
+template <int RES>
+void getCostMatrix(const PolarHistogram<RES>& histogram,
+                   const Eigen::Vector3f& goal,
                    const Eigen::Vector3f& position,
                    const float yaw_angle_histogram_frame_deg,
                    const Eigen::Vector3f& last_sent_waypoint,
@@ -228,76 +1384,125 @@ void getCostMatrix(const Histogram& histogram, const Eigen::Vector3f& goal,
                    const float smoothing_margin_degrees,
                    Eigen::MatrixXf& cost_matrix,
                    std::vector<uint8_t>& image_data) {
-  Eigen::MatrixXf distance_matrix(GRID_LENGTH_E, GRID_LENGTH_Z);
-  distance_matrix.fill(NAN);
-  float distance_cost = 0.f;
-  float other_costs = 0.f;
-  // reset cost matrix to zero
-  cost_matrix.resize(GRID_LENGTH_E, GRID_LENGTH_Z);
-  cost_matrix.fill(NAN);
+  CostMatrixBuffers buffers;
+  getCostMatrix(histogram, goal, position, yaw_angle_histogram_frame_deg,
+                last_sent_waypoint, cost_params, only_yawed,
+                smoothing_margin_degrees, cost_matrix, image_data, true,
+                buffers);
+}
+
+template <int RES>
+void evaluateCostMatrix(const PolarHistogram<RES>& histogram,
+                        const Eigen::Vector3f& goal,
+                        const Eigen::Vector3f& position,
+                        float yaw_angle_histogram_frame_deg,
+                        const Eigen::Vector3f& last_sent_waypoint,
+                        const costParameters& cost_params,
+                        Eigen::MatrixXf& cost_matrix,
+                        Eigen::MatrixXf& distance_matrix) {
+  const int E_DIM = PolarHistogram<RES>::E_DIM;
+  const int Z_DIM = PolarHistogram<RES>::Z_DIM;
+  const HistogramLookupTable<RES>& lookup = HistogramLookupTable<RES>::get();
+  // row arrays live on the stack, the bound is the histogram width
+  typedef Eigen::Array<float, Eigen::Dynamic, 1, 0, Z_DIM, 1> RowArray;
+  typedef Eigen::Map<const Eigen::ArrayXf, 0, Eigen::InnerStride<>> RowMap;
+  typedef Eigen::Map<Eigen::ArrayXf, 0, Eigen::InnerStride<>> MatrixRowMap;
+  distance_matrix.resize(E_DIM, Z_DIM);
+  cost_matrix.resize(E_DIM, Z_DIM);
+
+  // the cost terms which are the same for every bin, see costFunction
+  const float goal_dist = (position - goal).norm();
+  PolarPoint last_wp_pol = cartesianToPolar(last_sent_waypoint, position);
+  last_wp_pol.r = goal_dist;
+  const Eigen::Vector3f projected_last_wp =
+      polarToCartesian(last_wp_pol, position);
+  const float yaw_rad = yaw_angle_histogram_frame_deg * DEG_TO_RAD;
+  const float yaw_sin = std::sin(yaw_rad);
+  const float yaw_cos = std::cos(yaw_rad);
 
   // fill in cost matrix
-  for (int e_index = 0; e_index < GRID_LENGTH_E; e_index++) {
+  for (int e_index = 0; e_index < E_DIM; e_index++) {
     // determine how many bins at this elevation angle would be equivalent to
     // a single bin at horizontal, then work in steps of that size
-    const float bin_width = std::cos(
-        histogramIndexToPolar(e_index, 0, ALPHA_RES, 1).e * DEG_TO_RAD);
-    const int step_size = static_cast<int>(std::round(1 / bin_width));
-
-    for (int z_index = 0; z_index < GRID_LENGTH_Z; z_index += step_size) {
-      float obstacle_distance = histogram.get_dist(e_index, z_index);
-      PolarPoint p_pol =
-          histogramIndexToPolar(e_index, z_index, ALPHA_RES, obstacle_distance);
-
-      costFunction(p_pol.e, p_pol.z, obstacle_distance, goal, position,
-                   yaw_angle_histogram_frame_deg, last_sent_waypoint,
-                   cost_params, distance_cost, other_costs);
-      cost_matrix(e_index, z_index) = other_costs;
-      distance_matrix(e_index, z_index) = distance_cost;
-    }
-    if (step_size > 1) {
-      // horizontally interpolate all of the un-calculated values
-      int last_index = 0;
-      for (int z_index = step_size; z_index < GRID_LENGTH_Z;
-           z_index += step_size) {
-        float other_costs_gradient =
-            (cost_matrix(e_index, z_index) - cost_matrix(e_index, last_index)) /
-            step_size;
-        float distance_cost_gradient = (distance_matrix(e_index, z_index) -
-                                        distance_matrix(e_index, last_index)) /
-                                       step_size;
-        for (int i = 1; i < step_size; i++) {
-          cost_matrix(e_index, last_index + i) =
-              cost_matrix(e_index, last_index) + other_costs_gradient * i;
-          distance_matrix(e_index, last_index + i) =
-              distance_matrix(e_index, last_index) + distance_cost_gradient * i;
-        }
-        last_index = z_index;
-      }
+    const float bin_width = lookup.elevationBinWidth(e_index);
+    const int step_size = azimuthStepSize(bin_width);
+    const int n_bins = (Z_DIM + step_size - 1) / step_size;
+    const Eigen::InnerStride<> step(step_size);
 
-      // special case the last columns wrapping around back to 0
-      int clamped_z_scale = GRID_LENGTH_Z - last_index;
-      float other_costs_gradient =
-          (cost_matrix(e_index, 0) - cost_matrix(e_index, last_index)) /
-          clamped_z_scale;
-      float distance_cost_gradient =
-          (distance_matrix(e_index, 0) - distance_matrix(e_index, last_index)) /
-          clamped_z_scale;
-
-      for (int i = 1; i < clamped_z_scale; i++) {
-        cost_matrix(e_index, last_index + i) =
-            cost_matrix(e_index, last_index) + other_costs_gradient * i;
-        distance_matrix(e_index, last_index + i) =
-            distance_matrix(e_index, last_index) + distance_cost_gradient * i;
-      }
+    // candidate directions and heading projected to the goal distance, the
+    // height is the same for the whole row
+    const RowArray candidate_x =
+        position.x() +
+        goal_dist * RowMap(lookup.binCenterXRow(e_index), n_bins, step);
+    const RowArray candidate_y =
+        position.y() +
+        goal_dist * RowMap(lookup.binCenterYRow(e_index), n_bins, step);
+    const float candidate_z =
+        position.z() + goal_dist * lookup.binCenter(e_index, 0).z();
+    const float heading_x = position.x() + goal_dist * (bin_width * yaw_sin);
+    const float heading_y = position.y() + goal_dist * (bin_width * yaw_cos);
+
+    float pitch_cost_up = 0.0f;
+    float pitch_cost_down = 0.0f;
+    if (candidate_z > goal.z()) {
+      pitch_cost_up =
+          cost_params.goal_cost_param * std::abs(goal.z() - candidate_z);
+    } else {
+      pitch_cost_down =
+          cost_params.goal_cost_param * std::abs(goal.z() - candidate_z);
     }
+    const float pitch_cost_smooth =
+        cost_params.smooth_cost_param *
+        std::abs(projected_last_wp.z() - candidate_z);
+
+    // the terms are summed in the order of costFunction
+    MatrixRowMap other_costs(cost_matrix.data() + e_index, n_bins,
+                             Eigen::InnerStride<>(step_size * E_DIM));
+    other_costs =
+        cost_params.goal_cost_param * ((goal.x() - candidate_x).square() +
+                                       (goal.y() - candidate_y).square())
+                                          .sqrt() +
+        cost_params.height_change_cost_param_adapted * pitch_cost_up +
+        cost_params.height_change_cost_param * pitch_cost_down +
+        cost_params.smooth_cost_param *
+            ((projected_last_wp.x() - candidate_x).square() +
+             (projected_last_wp.y() - candidate_y).square())
+                .sqrt() +
+        pitch_cost_smooth +
+        cost_params.heading_cost_param * ((heading_x - candidate_x).square() +
+                                          (heading_y - candidate_y).square())
+                                             .sqrt();
+
+    // the obstacle distance cost, then horizontally interpolate all of the
+    // un-calculated values
+    evaluateDistanceRow(histogram, e_index, step_size, distance_matrix);
+    if (step_size > 1) interpolateRow(cost_matrix, e_index, step_size);
   }
+}
 
-  unsigned int smooth_radius = ceil(smoothing_margin_degrees / ALPHA_RES);
-  smoothPolarMatrix(distance_matrix, smooth_radius);
+template <int RES>
+void getCostMatrix(const PolarHistogram<RES>& histogram,
+                   const Eigen::Vector3f& goal,
+                   const Eigen::Vector3f& position,
+                   const float yaw_angle_histogram_frame_deg,
+                   const Eigen::Vector3f& last_sent_waypoint,
+                   costParameters cost_params, bool only_yawed,
+                   const float smoothing_margin_degrees,
+                   Eigen::MatrixXf& cost_matrix,
+                   std::vector<uint8_t>& image_data, bool generate_image,
+                   CostMatrixBuffers& buffers) {
+  Eigen::MatrixXf& distance_matrix = buffers.distance_matrix;
+  evaluateCostMatrix(histogram, goal, position, yaw_angle_histogram_frame_deg,
+                     last_sent_waypoint, cost_params, cost_matrix,
+                     distance_matrix);
+
+  unsigned int smooth_radius = ceil(smoothing_margin_degrees / RES);
+  smoothPolarMatrix(distance_matrix, smooth_radius, buffers.box_buffer);
 
-  generateCostImage(cost_matrix, distance_matrix, image_data);
-  cost_matrix = cost_matrix + distance_matrix;
+  if (generate_image) {
+    generateCostImage(cost_matrix, distance_matrix, image_data);
+  }
+  cost_matrix += distance_matrix;
 }
 
 void generateCostImage(const Eigen::MatrixXf& cost_matrix,
@@ -305,10 +1510,10 @@ void generateCostImage(const Eigen::MatrixXf& cost_matrix,
                        std::vector<uint8_t>& image_data) {
   float max_val = std::max(cost_matrix.maxCoeff(), distance_matrix.maxCoeff());
   image_data.clear();
-  image_data.reserve(3 * GRID_LENGTH_E * GRID_LENGTH_Z);
+  image_data.reserve(3 * cost_matrix.size());
 
-  for (int e = GRID_LENGTH_E - 1; e >= 0; e--) {
-    for (int z = 0; z < GRID_LENGTH_Z; z++) {
+  for (int e = cost_matrix.rows() - 1; e >= 0; e--) {
+    for (int z = 0; z < cost_matrix.cols(); z++) {
       float distance_cost = 255.f * distance_matrix(e, z) / max_val;
       float other_cost = 255.f * cost_matrix(e, z) / max_val;
       image_data.push_back(
@@ -320,69 +1525,204 @@ void generateCostImage(const Eigen::MatrixXf& cost_matrix,
   }
 }
 
-int colorImageIndex(int e_ind, int z_ind, int color) {
+int colorImageIndex(int e_ind, int z_ind, int color, int res) {
   // color = 0 (red), color = 1 (green), color = 2 (blue)
-  return ((GRID_LENGTH_E - e_ind - 1) * GRID_LENGTH_Z + z_ind) * 3 + color;
+  const int e_dim = 180 / res;
+  const int z_dim = 360 / res;
+  return ((e_dim - e_ind - 1) * z_dim + z_ind) * 3 + color;
+}
+
+namespace {
+// moves the cells in increasing cost order to the candidates until there are
+// number_of_candidates, skipping cells whose bin center is closer than the
+// separation to a cheaper candidate. The cells hold the cost and the row major
+// bin index, only the selected cells are converted to polar directions
+template <int RES>
+void selectCandidates(unsigned int number_of_candidates,
+                      float min_separation_deg,
+                      std::vector<candidateDirection>& candidate_vector,
+                      CandidateSelectionBuffers& buffers) {
+  typedef std::pair<float, int> Cell;
+  const int Z_DIM = PolarHistogram<RES>::Z_DIM;
+  const HistogramLookupTable<RES>& lookup = HistogramLookupTable<RES>::get();
+  const float cos_min_separation = std::cos(min_separation_deg * DEG_TO_RAD);
+  std::vector<Cell>& cells = buffers.cells;
+  std::vector<int>& selected_cells = buffers.selected_cells;
+  selected_cells.clear();
+  candidate_vector.clear();
+
+  // lazy selection: the min-heap is built in linear time and only popped
+  // until enough candidates are found
+  std::make_heap(cells.begin(), cells.end(), std::greater<Cell>());
+  while (!cells.empty() && selected_cells.size() < number_of_candidates) {
+    std::pop_heap(cells.begin(), cells.end(), std::greater<Cell>());
+    const Cell cell = cells.back();
+    cells.pop_back();
+    const int e = cell.second / Z_DIM;
+    const int z = cell.second % Z_DIM;
+
+    if (min_separation_deg > 0.f) {
+      const Eigen::Vector3f& direction = lookup.binCenter(e, z);
+      bool too_close = false;
+      for (int selected_cell : selected_cells) {
+        if (direction.dot(lookup.binCenter(selected_cell / Z_DIM,
+                                           selected_cell % Z_DIM)) >
+            cos_min_separation) {
+          too_close = true;
+          break;
+        }
+      }
+      if (too_close) continue;
+    }
+    selected_cells.push_back(cell.second);
+    PolarPoint p_pol = histogramIndexToPolar(e, z, RES, 1.0);
+    candidate_vector.push_back(
+        candidateDirection(cell.first, p_pol.e, p_pol.z));
+  }
 }
+}  // namespace
 
+template <int RES>
 void getBestCandidatesFromCostMatrix(
     const Eigen::MatrixXf& matrix, unsigned int number_of_candidates,
     std::vector<candidateDirection>& candidate_vector) {
-  std::priority_queue<candidateDirection, std::vector<candidateDirection>,
-                      std::less<candidateDirection>>
-      queue;
-
-  for (int row_index = 0; row_index < matrix.rows(); row_index++) {
-    for (int col_index = 0; col_index < matrix.cols(); col_index++) {
-      PolarPoint p_pol =
-          histogramIndexToPolar(row_index, col_index, ALPHA_RES, 1.0);
-      float cost = matrix(row_index, col_index);
-      candidateDirection candidate(cost, p_pol.e, p_pol.z);
-
-      if (queue.size() < number_of_candidates) {
-        queue.push(candidate);
-      } else if (candidate < queue.top()) {
-        queue.push(candidate);
-        queue.pop();
+  CandidateSelectionBuffers buffers;
+  getBestCandidatesFromCostMatrix<RES>(matrix, number_of_candidates, 0.f,
+                                       candidate_vector, buffers);
+}
+
+template <int RES>
+void getBestCandidatesFromCostMatrix(
+    const Eigen::MatrixXf& matrix, unsigned int number_of_candidates,
+    float min_separation_deg, std::vector<candidateDirection>& candidate_vector,
+    CandidateSelectionBuffers& buffers) {
+  candidate_vector.clear();
+  candidate_vector.reserve(number_of_candidates);
+  if (number_of_candidates == 0) return;
+
+  // the cells are collected first, only the selected ones are converted
+  std::vector<std::pair<float, int>>& cells = buffers.cells;
+  cells.clear();
+  const int cols = matrix.cols();
+  for (int col_index = 0; col_index < cols; col_index++) {
+    // the columns are contiguous, once the heap is full a column is skipped
+    // if its vectorized minimum can't replace any of the cheapest cells
+    if (min_separation_deg <= 0.f && cells.size() == number_of_candidates &&
+        matrix.col(col_index).minCoeff() > cells.front().first) {
+      continue;
+    }
+    for (int row_index = 0; row_index < matrix.rows(); row_index++) {
+      const std::pair<float, int> cell(matrix(row_index, col_index),
+                                       row_index * cols + col_index);
+      if (min_separation_deg > 0.f) {
+        // every cell may be needed to replace the ones which are too close
+        cells.push_back(cell);
+      } else {
+        pushCheapest(cells, number_of_candidates, cell);
       }
     }
   }
-  // copy queue to vector and change order such that lowest cost is at the front
-  candidate_vector.clear();
-  candidate_vector.reserve(queue.size());
-  while (!queue.empty()) {
-    candidate_vector.push_back(queue.top());
-    queue.pop();
+
+  selectCandidates<RES>(number_of_candidates, min_separation_deg,
+                        candidate_vector, buffers);
+}
+
+namespace {
+// entries of a polar matrix column continued across the poles, with the
+// wrapping rules of padPolarMatrix: crossing a pole continues on the column
+// turned by 180 degrees azimuth in mirrored order
+struct PolarColumn {
+  const Eigen::MatrixXf& matrix;
+  int col;
+  int opposite_col;
+  inline float operator()(int e) const {
+    const int rows = matrix.rows();
+    if (e < 0) return matrix(-e - 1, opposite_col);
+    if (e >= rows) return matrix(2 * rows - 1 - e, opposite_col);
+    return matrix(e, col);
+  }
+};
+
+// entries of a polar matrix row, the azimuth wraps around
+struct PolarRow {
+  const Eigen::MatrixXf& matrix;
+  int row;
+  inline float operator()(int z) const {
+    if (z < 0) return matrix(row, z + matrix.cols());
+    if (z >= matrix.cols()) return matrix(row, z - matrix.cols());
+    return matrix(row, z);
+  }
+};
+
+// first box filter of width radius + 1 over the line entries in
+// [-radius, length + radius): box[b] is the sum of line(b - radius) to
+// line(b) for b in [0, length + radius)
+template <typename Line>
+void boxFilter(const Line& line, int length, int radius, float* box) {
+  double sum = 0.0;
+  for (int i = -radius; i <= 0; i++) {
+    sum += line(i);
+  }
+  box[0] = static_cast<float>(sum);
+  for (int b = 1; b < length + radius; b++) {
+    sum += line(b) - line(b - radius - 1);
+    box[b] = static_cast<float>(sum);
   }
-  std::reverse(candidate_vector.begin(), candidate_vector.end());
 }
 
+// second box filter of width radius + 1 over the output of boxFilter, the two
+// box filters together apply the conic kernel of getConicKernel
+void secondBoxFilter(const float* box, int length, int radius, float* out,
+                     int out_stride) {
+  const double scale = 1.0 / (1 + radius);
+  double sum = 0.0;
+  for (int b = 0; b <= radius; b++) {
+    sum += box[b];
+  }
+  out[0] = static_cast<float>(sum * scale);
+  for (int i = 1; i < length; i++) {
+    sum += box[i + radius] - box[i - 1];
+    out[i * out_stride] = static_cast<float>(sum * scale);
+  }
+}
+}  // namespace
+
 void smoothPolarMatrix(Eigen::MatrixXf& matrix, unsigned int smoothing_radius) {
-  // pad matrix by smoothing radius respecting all wrapping rules
-  Eigen::MatrixXf matrix_padded;
-  padPolarMatrix(matrix, smoothing_radius, matrix_padded);
-  Eigen::ArrayXf kernel1d = getConicKernel(smoothing_radius);
-
-  Eigen::ArrayXf temp_col(matrix_padded.rows());
-  for (int col_index = 0; col_index < matrix_padded.cols(); col_index++) {
-    temp_col = matrix_padded.col(col_index);
-    for (int row_index = 0; row_index < matrix.rows(); row_index++) {
-      float smooth_val =
-          (temp_col.segment(row_index, 2 * smoothing_radius + 1) * kernel1d)
-              .sum();
-      matrix_padded(row_index + smoothing_radius, col_index) = smooth_val;
-    }
+  Eigen::VectorXf box_buffer;
+  smoothPolarMatrix(matrix, smoothing_radius, box_buffer);
+}
+
+void smoothPolarMatrix(Eigen::MatrixXf& matrix, unsigned int smoothing_radius,
+                       Eigen::VectorXf& box_buffer) {
+  const int rows = matrix.rows();
+  const int cols = matrix.cols();
+  const int radius = static_cast<int>(smoothing_radius);
+  if (cols % 2 > 0) {
+    ROS_ERROR("invalid resolution: 180 mod (2* resolution) must be zero");
   }
+  // the box sums of two columns or of one row
+  const int box_length = std::max(2 * (rows + radius), cols + radius);
+  if (box_buffer.size() < box_length) box_buffer.resize(box_length);
+  float* box = box_buffer.data();
+  float* box_opposite = box + rows + radius;
 
-  Eigen::ArrayXf temp_row(matrix_padded.cols());
-  for (int row_index = 0; row_index < matrix.rows(); row_index++) {
-    temp_row = matrix_padded.row(row_index + smoothing_radius);
-    for (int col_index = 0; col_index < matrix.cols(); col_index++) {
-      float smooth_val =
-          (temp_row.segment(col_index, 2 * smoothing_radius + 1) * kernel1d)
-              .sum();
-      matrix(row_index, col_index) = smooth_val;
-    }
+  // elevation pass: a column and the column turned by 180 degrees continue
+  // each other across the poles, they are filtered together such that both
+  // are read before either is overwritten
+  const int half_cols = cols / 2;
+  for (int col = 0; col < half_cols; col++) {
+    const int opposite_col = col + half_cols;
+    boxFilter(PolarColumn{matrix, col, opposite_col}, rows, radius, box);
+    boxFilter(PolarColumn{matrix, opposite_col, col}, rows, radius,
+              box_opposite);
+    secondBoxFilter(box, rows, radius, &matrix(0, col), 1);
+    secondBoxFilter(box_opposite, rows, radius, &matrix(0, opposite_col), 1);
+  }
+
+  // azimuth pass: the box sums hold everything read from the row
+  for (int row = 0; row < rows; row++) {
+    boxFilter(PolarRow{matrix, row}, cols, radius, box);
+    secondBoxFilter(box, cols, radius, &matrix(row, 0), rows);
   }
 }
 
@@ -456,15 +1796,33 @@ void costFunction(float e_angle, float z_angle, float obstacle_distance,
                   costParameters cost_params, float& distance_cost,
                   float& other_costs) {
   float goal_dist = (position - goal).norm();
-  PolarPoint p_pol(e_angle, z_angle, goal_dist);
-  Eigen::Vector3f projected_candidate = polarToCartesian(p_pol, position);
-  PolarPoint heading_pol(e_angle, yaw_angle_histogram_frame_deg, goal_dist);
-  Eigen::Vector3f projected_heading = polarToCartesian(heading_pol, position);
-  Eigen::Vector3f projected_goal = goal;
+  const Eigen::Vector3f origin = Eigen::Vector3f::Zero();
+  Eigen::Vector3f candidate_direction =
+      polarToCartesian(PolarPoint(e_angle, z_angle, 1.f), origin);
+  Eigen::Vector3f heading_direction = polarToCartesian(
+      PolarPoint(e_angle, yaw_angle_histogram_frame_deg, 1.f), origin);
   PolarPoint last_wp_pol = cartesianToPolar(last_sent_waypoint, position);
   last_wp_pol.r = goal_dist;
   Eigen::Vector3f projected_last_wp = polarToCartesian(last_wp_pol, position);
 
+  costFunction(candidate_direction, heading_direction, obstacle_distance, goal,
+               position, projected_last_wp, cost_params, distance_cost,
+               other_costs);
+}
+
+void costFunction(const Eigen::Vector3f& candidate_direction,
+                  const Eigen::Vector3f& heading_direction,
+                  float obstacle_distance, const Eigen::Vector3f& goal,
+                  const Eigen::Vector3f& position,
+                  const Eigen::Vector3f& projected_last_wp,
+                  const costParameters& cost_params, float& distance_cost,
+                  float& other_costs) {
+  float goal_dist = (position - goal).norm();
+  Eigen::Vector3f projected_candidate =
+      position + goal_dist * candidate_direction;
+  Eigen::Vector3f projected_heading = position + goal_dist * heading_direction;
+  const Eigen::Vector3f& projected_goal = goal;
+
   // goal costs
   float yaw_cost =
       cost_params.goal_cost_param *
@@ -495,10 +1853,7 @@ void costFunction(float e_angle, float z_angle, float obstacle_distance,
           .norm();
 
   // distance cost
-  distance_cost = 0.0f;
-  if (obstacle_distance > 0.0f) {
-    distance_cost = 700.0f / obstacle_distance;
-  }
+  distance_cost = obstacleDistanceCost(obstacle_distance);
 
   // combine costs
   other_costs = 0.0f;
@@ -586,12 +1941,13 @@ bool getDirectionFromTree(
   return tree_available;
 }
 
-void printHistogram(Histogram& histogram) {
+template <int RES>
+void printHistogram(const PolarHistogram<RES>& histogram) {
   std::cout << "------------------------------------------Histogram------------"
                "------------------------------------\n";
-  for (int e = 0; e < GRID_LENGTH_E; e++) {
-    for (int z = 0; z < GRID_LENGTH_Z; z++) {
-      int val = floor(histogram.get_dist(e, z));
+  for (int e = 0; e < PolarHistogram<RES>::E_DIM; e++) {
+    for (int z = 0; z < PolarHistogram<RES>::Z_DIM; z++) {
+      int val = floor(histogram.dist(e, z));
       if (val > 99) {
         std::cout << val << " ";
       } else if (val > 9) {
@@ -605,4 +1961,64 @@ void printHistogram(Histogram& histogram) {
   std::cout << "_______________________________________________________________"
                "____________________________________\n";
 }
+
+// compile the histogram, cost and candidate functions for every supported bin
+// size, the planner selects one of them at runtime
+#define INSTANTIATE_HISTOGRAM_FUNCTIONS(RES)                                  \
+  template void calculateFOV<RES>(float, float, std::vector<int>&, int&,      \
+                                  int&, float, float);                        \
+  template void calculateFOV<RES>(float, float, FOVMask&, int&, int&, float,  \
+                                  float);                                     \
+  template void reprojectHistogram<RES>(                                      \
+      pcl::PointCloud<pcl::PointXYZ>&, std::vector<int>&,                     \
+      const PolarHistogram<RES>&, const Eigen::Vector3f&,                     \
+      const Eigen::Vector3f&, float, int);                                    \
+  template void propagateHistogram<RES>(                                      \
+      PolarHistogram<RES>&, const PolarHistogram<RES>&,                       \
+      const Eigen::Vector3f&, const Eigen::Vector3f&, float, int);            \
+  template void generateNewHistogram<RES>(                                    \
+      PolarHistogram<RES>&, const pcl::PointCloud<pcl::PointXYZ>&,            \
+      const Eigen::Vector3f&);                                                \
+  template void combinedHistogram<RES>(                                       \
+      bool&, PolarHistogram<RES>&, const PolarHistogram<RES>&, bool,          \
+      const std::vector<int>&, int, int);                                     \
+  template void generateCombinedHistogram<RES>(                               \
+      PolarHistogram<RES>&, bool&, const pcl::PointCloud<pcl::PointXYZ>&,     \
+      const PolarHistogram<RES>&, const Eigen::Vector3f&,                     \
+      const Eigen::Vector3f&, float, int, bool, const FOVMask&, int, int);    \
+  template void generateCombinedHistogram<RES>(                               \
+      PolarHistogram<RES>&, bool&, const ObstacleIndex&,                      \
+      const PolarHistogram<RES>&, const Eigen::Vector3f&,                     \
+      const Eigen::Vector3f&, float, int, bool, const FOVMask&, int, int);    \
+  template void updateHistogramSlices<RES>(                                   \
+      PolarHistogram<RES>&, bool&, const pcl::PointCloud<pcl::PointXYZ>&,     \
+      const PolarHistogram<RES>&, const Eigen::Vector3f&,                     \
+      const Eigen::Vector3f&, float, int, bool, const FOVMask&, int, int);    \
+  template void compressHistogramElevation<RES>(PolarHistogram<RES>&,         \
+                                                const PolarHistogram<RES>&);  \
+  template void evaluateCostMatrix<RES>(                                      \
+      const PolarHistogram<RES>&, const Eigen::Vector3f&,                     \
+      const Eigen::Vector3f&, float, const Eigen::Vector3f&,                  \
+      const costParameters&, Eigen::MatrixXf&, Eigen::MatrixXf&);             \
+  template void getCostMatrix<RES>(                                           \
+      const PolarHistogram<RES>&, const Eigen::Vector3f&,                     \
+      const Eigen::Vector3f&, const float, const Eigen::Vector3f&,            \
+      costParameters, bool, const float, Eigen::MatrixXf&,                    \
+      std::vector<uint8_t>&, bool, CostMatrixBuffers&);                       \
+  template void getCostMatrix<RES>(                                           \
+      const PolarHistogram<RES>&, const Eigen::Vector3f&,                     \
+      const Eigen::Vector3f&, const float, const Eigen::Vector3f&,            \
+      costParameters, bool, const float, Eigen::MatrixXf&,                    \
+      std::vector<uint8_t>&);                                                 \
+  template void getBestCandidatesFromCostMatrix<RES>(                         \
+      const Eigen::MatrixXf&, unsigned int,                                   \
+      std::vector<candidateDirection>&);                                      \
+  template void getBestCandidatesFromCostMatrix<RES>(                         \
+      const Eigen::MatrixXf&, unsigned int, float,                            \
+      std::vector<candidateDirection>&, CandidateSelectionBuffers&);          \
+  template void printHistogram<RES>(const PolarHistogram<RES>&);
+
+INSTANTIATE_HISTOGRAM_FUNCTIONS(ALPHA_RES_FINE)
+INSTANTIATE_HISTOGRAM_FUNCTIONS(ALPHA_RES)
+INSTANTIATE_HISTOGRAM_FUNCTIONS(ALPHA_RES_COARSE)
 }
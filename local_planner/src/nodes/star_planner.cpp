@@ -5,9 +5,33 @@
 
 #include <ros/console.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+
 namespace avoidance {
 
-StarPlanner::StarPlanner() : tree_age_(0) {}
+StarPlanner::StarPlanner()
+    : pointcloud_(new pcl::PointCloud<pcl::PointXYZ>()),
+      clock_(new SteadyClock()),
+      tree_age_(0) {}
+
+template <>
+PolarHistogram<ALPHA_RES_FINE>& StarPlanner::memoryHistogram<ALPHA_RES_FINE>() {
+  return memory_histogram_fine_;
+}
+
+template <>
+PolarHistogram<ALPHA_RES>& StarPlanner::memoryHistogram<ALPHA_RES>() {
+  return memory_histogram_;
+}
+
+template <>
+PolarHistogram<ALPHA_RES_COARSE>&
+StarPlanner::memoryHistogram<ALPHA_RES_COARSE>() {
+  return memory_histogram_coarse_;
+}
 
 // set parameters changed by dynamic rconfigure
 void StarPlanner::dynamicReconfigureSetStarParams(
@@ -15,10 +39,17 @@ void StarPlanner::dynamicReconfigureSetStarParams(
   children_per_node_ = config.children_per_node_;
   n_expanded_nodes_ = config.n_expanded_nodes_;
   tree_node_distance_ = static_cast<float>(config.tree_node_distance_);
+  tree_voxel_size_ = static_cast<float>(config.tree_voxel_size_);
+  tree_expansion_batch_ = config.tree_expansion_batch_;
+  tree_warm_start_ = config.tree_warm_start_;
+  tree_time_budget_ms_ = static_cast<float>(config.tree_time_budget_ms_);
   tree_discount_factor_ = static_cast<float>(config.tree_discount_factor_);
   max_path_length_ = static_cast<float>(config.max_path_length_);
   smoothing_margin_degrees_ =
       static_cast<float>(config.smoothing_margin_degrees_);
+  histogram_resolution_ = isSupportedResolution(config.histogram_resolution_)
+                              ? config.histogram_resolution_
+                              : ALPHA_RES;
 }
 
 void StarPlanner::setParams(costParameters cost_params) {
@@ -40,7 +71,7 @@ void StarPlanner::setPose(const Eigen::Vector3f& pos, float curr_yaw) {
 }
 
 void StarPlanner::setCloud(
-    const pcl::PointCloud<pcl::PointXYZ>& cropped_cloud) {
+    const pcl::PointCloud<pcl::PointXYZ>::ConstPtr& cropped_cloud) {
   pointcloud_ = cropped_cloud;
 }
 
@@ -49,18 +80,29 @@ void StarPlanner::setGoal(const Eigen::Vector3f& goal) {
   tree_age_ = 1000;
 }
 
-void StarPlanner::setReprojectedPoints(
-    const pcl::PointCloud<pcl::PointXYZ>& reprojected_points,
-    const std::vector<int>& reprojected_points_age) {
-  reprojected_points_ = reprojected_points;
-  reprojected_points_age_ = reprojected_points_age;
+template <int RES>
+void StarPlanner::setObstacleMemory(const PolarHistogram<RES>& histogram,
+                                    const Eigen::Vector3f& position,
+                                    int max_age, float max_dist) {
+  memoryHistogram<RES>() = histogram;
+  memory_position_ = position;
+  memory_max_age_ = max_age;
+  memory_max_dist_ = max_dist;
 }
 
+template void StarPlanner::setObstacleMemory<ALPHA_RES_FINE>(
+    const PolarHistogram<ALPHA_RES_FINE>&, const Eigen::Vector3f&, int, float);
+template void StarPlanner::setObstacleMemory<ALPHA_RES>(
+    const PolarHistogram<ALPHA_RES>&, const Eigen::Vector3f&, int, float);
+template void StarPlanner::setObstacleMemory<ALPHA_RES_COARSE>(
+    const PolarHistogram<ALPHA_RES_COARSE>&, const Eigen::Vector3f&, int,
+    float);
+
 float StarPlanner::treeCostFunction(int node_number) {
-  int origin = tree_[node_number].origin_;
-  float e = tree_[node_number].last_e_;
-  float z = tree_[node_number].last_z_;
-  Eigen::Vector3f origin_position = tree_[origin].getPosition();
+  int origin = tree_.origin[node_number];
+  float e = tree_.last_e[node_number];
+  float z = tree_.last_z[node_number];
+  Eigen::Vector3f origin_position = tree_.position[origin];
   PolarPoint goal_pol = cartesianToPolar(goal_, origin_position);
 
   float target_cost =
@@ -69,10 +111,10 @@ float StarPlanner::treeCostFunction(int node_number) {
           indexAngleDifference(e, goal_pol.e);  // include effective direction?
   float turning_cost =
       5.0f *
-      indexAngleDifference(z, tree_[0].yaw_);  // maybe include pitching cost?
+      indexAngleDifference(z, tree_.yaw[0]);  // maybe include pitching cost?
 
-  float last_e = tree_[origin].last_e_;
-  float last_z = tree_[origin].last_z_;
+  float last_e = tree_.last_e[origin];
+  float last_z = tree_.last_z[origin];
 
   float smooth_cost = 5.0f * (2.0f * indexAngleDifference(z, last_z) +
                               5.0f * indexAngleDifference(e, last_e));
@@ -80,156 +122,307 @@ float StarPlanner::treeCostFunction(int node_number) {
   float smooth_cost_to_old_tree = 0.0f;
   if (tree_age_ < 10) {
     int partner_node_idx =
-        path_node_positions_.size() - 1 - tree_[node_number].depth_;
+        path_node_positions_.size() - 1 - tree_.depth[node_number];
     if (partner_node_idx >= 0) {
       Eigen::Vector3f partner_node_position =
           path_node_positions_[partner_node_idx];
-      Eigen::Vector3f node_position = tree_[node_number].getPosition();
+      Eigen::Vector3f node_position = tree_.position[node_number];
       float dist = (partner_node_position - node_position).norm();
       smooth_cost_to_old_tree =
           200.0f * dist /
-          (0.5f * static_cast<float>(tree_[node_number].depth_));
+          (0.5f * static_cast<float>(tree_.depth[node_number]));
     }
   }
 
   return std::pow(tree_discount_factor_,
-                  static_cast<float>(tree_[node_number].depth_)) *
+                  static_cast<float>(tree_.depth[node_number])) *
          (target_cost + smooth_cost + smooth_cost_to_old_tree + turning_cost);
 }
 float StarPlanner::treeHeuristicFunction(int node_number) {
-  Eigen::Vector3f node_position = tree_[node_number].getPosition();
+  Eigen::Vector3f node_position = tree_.position[node_number];
   PolarPoint goal_pol = cartesianToPolar(goal_, node_position);
 
-  int origin = tree_[node_number].origin_;
-  Eigen::Vector3f origin_position = tree_[origin].getPosition();
+  int origin = tree_.origin[node_number];
+  Eigen::Vector3f origin_position = tree_.position[origin];
   float origin_goal_dist = (goal_ - origin_position).norm();
   float goal_dist = (goal_ - node_position).norm();
   float goal_cost = (goal_dist / origin_goal_dist - 0.9f) * 5000.0f;
 
   float smooth_cost =
-      10.0f * (indexAngleDifference(goal_pol.z, tree_[node_number].last_z_) +
-               indexAngleDifference(goal_pol.e, tree_[node_number].last_e_));
+      10.0f * (indexAngleDifference(goal_pol.z, tree_.last_z[node_number]) +
+               indexAngleDifference(goal_pol.e, tree_.last_e[node_number]));
 
   return std::pow(tree_discount_factor_,
-                  static_cast<float>(tree_[node_number].depth_)) *
+                  static_cast<float>(tree_.depth[node_number])) *
          (smooth_cost + goal_cost);
 }
 
-void StarPlanner::buildLookAheadTree() {
-  std::clock_t start_time = std::clock();
-  tree_.clear();
-  closed_set_.clear();
+void StarPlanner::setClock(std::shared_ptr<MonotonicClock> clock) {
+  clock_ = clock;
+}
 
-  // insert first node
-  tree_.push_back(TreeNode(0, 0, position_));
-  tree_.back().setCosts(treeHeuristicFunction(0), treeHeuristicFunction(0));
-  tree_.back().yaw_ = curr_yaw_histogram_frame_deg_;
-  tree_.back().last_z_ = tree_.back().yaw_;
+int StarPlanner::buildLookAheadTree() {
+  switch (histogram_resolution_) {
+    case ALPHA_RES_FINE:
+      return buildLookAheadTreeImpl<ALPHA_RES_FINE>();
+    case ALPHA_RES_COARSE:
+      return buildLookAheadTreeImpl<ALPHA_RES_COARSE>();
+    default:
+      return buildLookAheadTreeImpl<ALPHA_RES>();
+  }
+}
 
-  int origin = 0;
+template <int RES>
+void StarPlanner::expandNode(int origin, float min_candidate_separation_deg,
+                             ExpansionWorkspace& workspace) {
+  const Eigen::Vector3f origin_position = tree_.position[origin];
+  bool hist_is_empty = false;  // unused
+
+  // build new histogram
+  PolarHistogram<RES> histogram;
+  FOVMask z_FOV_mask;
+  int e_FOV_min, e_FOV_max;
+  calculateFOV<RES>(h_FOV_, v_FOV_, z_FOV_mask, e_FOV_min, e_FOV_max,
+                    tree_.yaw[origin],
+                    0.0f);  // assume pitch is zero at every node
+
+  if (tree_voxel_size_ > 0.f) {
+    generateCombinedHistogram(histogram, hist_is_empty, obstacle_index_,
+                              memoryHistogram<RES>(), memory_position_,
+                              origin_position, memory_max_dist_,
+                              memory_max_age_, false, z_FOV_mask, e_FOV_min,
+                              e_FOV_max);
+  } else {
+    generateCombinedHistogram(histogram, hist_is_empty, *pointcloud_,
+                              memoryHistogram<RES>(), memory_position_,
+                              origin_position, memory_max_dist_,
+                              memory_max_age_, false, z_FOV_mask, e_FOV_min,
+                              e_FOV_max);
+  }
 
-  for (int n = 0; n < n_expanded_nodes_; n++) {
-    Eigen::Vector3f origin_position = tree_[origin].getPosition();
-    int old_origin = tree_[origin].origin_;
-    Eigen::Vector3f origin_origin_position = tree_[old_origin].getPosition();
-    bool hist_is_empty = false;  // unused
-
-    // build new histogram
-    std::vector<int> z_FOV_idx;
-    int e_FOV_min, e_FOV_max;
-    calculateFOV(h_FOV_, v_FOV_, z_FOV_idx, e_FOV_min, e_FOV_max,
-                 tree_[origin].yaw_,
-                 0.0f);  // assume pitch is zero at every node
-
-    Histogram propagated_histogram = Histogram(2 * ALPHA_RES);
-    Histogram histogram = Histogram(ALPHA_RES);
-
-    propagateHistogram(propagated_histogram, reprojected_points_,
-                       reprojected_points_age_, origin_position);
-    generateNewHistogram(histogram, pointcloud_, origin_position);
-    combinedHistogram(hist_is_empty, histogram, propagated_histogram, false,
-                      z_FOV_idx, e_FOV_min, e_FOV_max);
-
-    // calculate candidates
-    Eigen::MatrixXf cost_matrix;
-    std::vector<uint8_t> cost_image_data;
-    std::vector<candidateDirection> candidate_vector;
-    getCostMatrix(histogram, goal_, origin_position, tree_[origin].yaw_,
-                  projected_last_wp_, cost_params_, false,
-                  smoothing_margin_degrees_, cost_matrix, cost_image_data);
-    getBestCandidatesFromCostMatrix(cost_matrix, children_per_node_,
-                                    candidate_vector);
-
-    // add candidates as nodes
-    if (candidate_vector.empty()) {
-      tree_[origin].total_cost_ = HUGE_VAL;
-    } else {
-      // insert new nodes
-      int depth = tree_[origin].depth_ + 1;
-      int children = 0;
-      for (candidateDirection candidate : candidate_vector) {
-        PolarPoint p_pol(candidate.elevation_angle, candidate.azimuth_angle,
-                         tree_node_distance_);
-
-        // check if another close node has been added
-        Eigen::Vector3f node_location =
-            polarToCartesian(p_pol, origin_position);
-        int close_nodes = 0;
-        for (size_t i = 0; i < tree_.size(); i++) {
-          float dist = (tree_[i].getPosition() - node_location).norm();
-          if (dist < 0.2f) {
-            close_nodes++;
-          }
-        }
-
-        if (children < children_per_node_ && close_nodes == 0) {
-          tree_.push_back(TreeNode(origin, depth, node_location));
-          tree_.back().last_e_ = p_pol.e;
-          tree_.back().last_z_ = p_pol.z;
-          float h = treeHeuristicFunction(tree_.size() - 1);
-          float c = treeCostFunction(tree_.size() - 1);
-          tree_.back().heuristic_ = h;
-          tree_.back().total_cost_ =
-              tree_[origin].total_cost_ - tree_[origin].heuristic_ + c + h;
-          Eigen::Vector3f diff = node_location - origin_position;
-          float yaw_radians = atan2(diff.y(), diff.x());
-          tree_.back().yaw_ =
-              std::round((-yaw_radians * 180.0f / M_PI_F)) + 90.0f;
-          children++;
-        }
+  // calculate candidates
+  getCostMatrix(histogram, goal_, origin_position, tree_.yaw[origin],
+                projected_last_wp_, cost_params_, false,
+                smoothing_margin_degrees_, workspace.cost_matrix,
+                workspace.cost_image_data, false,
+                workspace.cost_matrix_buffers);
+  getBestCandidatesFromCostMatrix<RES>(
+      workspace.cost_matrix, children_per_node_, min_candidate_separation_deg,
+      workspace.candidate_vector, workspace.selection_buffers);
+}
+
+void StarPlanner::addChildren(
+    int origin, const std::vector<candidateDirection>& candidate_vector,
+    float min_node_distance) {
+  const Eigen::Vector3f origin_position = tree_.position[origin];
+
+  // add candidates as nodes
+  if (candidate_vector.empty()) {
+    tree_.total_cost[origin] = HUGE_VAL;
+  } else {
+    // insert new nodes
+    int children = 0;
+    for (candidateDirection candidate : candidate_vector) {
+      PolarPoint p_pol(candidate.elevation_angle, candidate.azimuth_angle,
+                       tree_node_distance_);
+
+      // check if another close node has been added
+      Eigen::Vector3f node_location = polarToCartesian(p_pol, origin_position);
+      if (children < children_per_node_ &&
+          !node_grid_.hasNodeWithin(node_location, min_node_distance)) {
+        addNode(origin, p_pol, node_location);
+        openNode(tree_.size() - 1);
+        children++;
       }
     }
+  }
+
+  closed_set_.push_back(origin);
+}
 
-    closed_set_.push_back(origin);
+void StarPlanner::addNode(int origin, const PolarPoint& p_pol,
+                          const Eigen::Vector3f& node_location) {
+  const Eigen::Vector3f origin_position = tree_.position[origin];
+  const int node =
+      tree_.addNode(origin, tree_.depth[origin] + 1, node_location);
+  tree_.last_e[node] = p_pol.e;
+  tree_.last_z[node] = p_pol.z;
+  float h = treeHeuristicFunction(node);
+  float c = treeCostFunction(node);
+  tree_.heuristic[node] = h;
+  tree_.total_cost[node] =
+      tree_.total_cost[origin] - tree_.heuristic[origin] + c + h;
+  Eigen::Vector3f diff = node_location - origin_position;
+  float yaw_radians = atan2(diff.y(), diff.x());
+  tree_.yaw[node] = std::round((-yaw_radians * 180.0f / M_PI_F)) + 90.0f;
+  node_grid_.insert(node_location);
+}
 
-    // find best node to continue
-    float minimal_cost = HUGE_VAL;
-    for (size_t i = 0; i < tree_.size(); i++) {
-      bool closed = false;
-      for (size_t j = 0; j < closed_set_.size(); j++) {
-        if (closed_set_[j] == (int)i) {
-          closed = true;
-        }
-      }
+void StarPlanner::openNode(int node) {
+  float node_distance = (tree_.position[node] - position_).norm();
+  if (tree_.total_cost[node] < HUGE_VAL && node_distance < max_path_length_) {
+    open_nodes_.push_back(std::make_pair(tree_.total_cost[node], node));
+    std::push_heap(open_nodes_.begin(), open_nodes_.end(),
+                   std::greater<std::pair<float, int>>());
+  }
+}
 
-      float node_distance = (tree_[i].getPosition() - position_).norm();
-      if (tree_[i].total_cost_ < minimal_cost && !closed &&
-          node_distance < max_path_length_) {
-        minimal_cost = tree_[i].total_cost_;
-        origin = i;
+int StarPlanner::reusePreviousPath(float min_node_distance) {
+  // the previous path is stored from its end to its root. The node closest
+  // to the vehicle is replaced by the new root, the end of the path is
+  // replanned from the node before it
+  int closest = 0;
+  float closest_distance = HUGE_VAL;
+  for (size_t i = 0; i < path_node_positions_.size(); i++) {
+    float distance = (path_node_positions_[i] - position_).norm();
+    if (distance < closest_distance) {
+      closest_distance = distance;
+      closest = i;
+    }
+  }
+
+  // the cost of the nodes compares them with the path node of the same depth
+  path_node_positions_.resize(closest + 1);
+  path_node_positions_[closest] = position_;
+
+  // the branch is cut at the first segment passing an obstacle closer than
+  // half the node distance, or which is much longer than a regular segment
+  const pcl::PointCloud<pcl::PointXYZ>& obstacles =
+      tree_voxel_size_ > 0.f ? obstacle_index_.centroids : *pointcloud_;
+  const float clearance = 0.5f * tree_node_distance_;
+  int origin = 0;
+  for (int i = closest - 1; i > 0; i--) {
+    const Eigen::Vector3f origin_position = tree_.position[origin];
+    const Eigen::Vector3f& node_location = path_node_positions_[i];
+    float distance = (node_location - origin_position).norm();
+    if (distance < min_node_distance || distance > 2.f * tree_node_distance_ ||
+        !isSegmentClear(obstacles, origin_position, node_location,
+                        clearance)) {
+      break;
+    }
+    addNode(origin, cartesianToPolar(node_location, origin_position),
+            node_location);
+    origin = tree_.size() - 1;
+  }
+  return origin;
+}
+
+void StarPlanner::selectOpenNodes(size_t n_nodes) {
+  if (open_nodes_.empty()) return;
+
+  // ties go to the older node
+  expansion_origins_.clear();
+  while (expansion_origins_.size() < n_nodes && !open_nodes_.empty()) {
+    std::pop_heap(open_nodes_.begin(), open_nodes_.end(),
+                  std::greater<std::pair<float, int>>());
+    expansion_origins_.push_back(open_nodes_.back().second);
+    open_nodes_.pop_back();
+  }
+}
+
+template <int RES>
+int StarPlanner::buildLookAheadTreeImpl() {
+  const MonotonicClock::time_point start_time = clock_->now();
+  // the budget includes the preparation of the tree
+  const bool has_deadline = tree_time_budget_ms_ > 0.f;
+  const MonotonicClock::time_point deadline =
+      start_time + std::chrono::duration_cast<MonotonicClock::duration>(
+                       std::chrono::duration<float, std::milli>(
+                           tree_time_budget_ms_));
+  tree_.clear();
+  closed_set_.clear();
+  tree_.reserve(1 + path_node_positions_.size() +
+                n_expanded_nodes_ * children_per_node_);
+  closed_set_.reserve(n_expanded_nodes_);
+
+  // nodes closer than this to an existing node are not added. Siblings are
+  // at least the corresponding angle apart, so that no candidate is wasted
+  const float min_node_distance = 0.2f;
+  const float min_candidate_separation_deg =
+      2.f * RAD_TO_DEG *
+      std::asin(std::min(1.f, 0.5f * min_node_distance / tree_node_distance_));
+
+  // insert first node
+  tree_.addNode(0, 0, position_);
+  tree_.heuristic[0] = treeHeuristicFunction(0);
+  tree_.total_cost[0] = tree_.heuristic[0];
+  tree_.yaw[0] = curr_yaw_histogram_frame_deg_;
+  tree_.last_z[0] = tree_.yaw[0];
+  node_grid_.reset(position_, min_node_distance, tree_.capacity());
+  node_grid_.insert(position_);
+  open_nodes_.clear();
+
+  // every expanded node bins the voxels of the index instead of all points
+  if (tree_voxel_size_ > 0.f) {
+    buildObstacleIndex(*pointcloud_, position_, tree_voxel_size_,
+                       obstacle_index_);
+  }
+
+  // the cheapest open nodes are expanded concurrently, their children are
+  // added in the order of the node costs
+  const size_t batch_size = std::max(1, tree_expansion_batch_);
+  if (expansion_workspaces_.size() < batch_size) {
+    expansion_workspaces_.resize(batch_size);
+  }
+  if (batch_size > 1 &&
+      (!expansion_pool_ || expansion_pool_->concurrency() != batch_size)) {
+    expansion_pool_.reset(new ThreadPool(batch_size - 1));
+  }
+  auto expand = [this, min_candidate_separation_deg](size_t i) {
+    expandNode<RES>(expansion_origins_[i], min_candidate_separation_deg,
+                    expansion_workspaces_[i]);
+  };
+
+  // the root and the nodes of the reused path count as expanded, the
+  // expansion starts at the end of the reused path
+  expansion_origins_.assign(1, 0);
+  int n = 0;
+  if (tree_warm_start_ && tree_age_ < 10 && n_expanded_nodes_ > 0) {
+    const int n_reused = reusePreviousPath(min_node_distance);
+    if (n_reused > 0) {
+      for (int i = 0; i < n_reused; i++) {
+        closed_set_.push_back(i);
       }
+      expansion_origins_.assign(1, n_reused);
+      n = std::min(n_reused, n_expanded_nodes_ - 1);
     }
   }
+  while (n < n_expanded_nodes_) {
+    if (expansion_origins_.size() > 1) {
+      expansion_pool_->parallelFor(expansion_origins_.size(), expand);
+    } else {
+      expand(0);
+    }
+
+    for (size_t i = 0; i < expansion_origins_.size(); i++) {
+      addChildren(expansion_origins_[i],
+                  expansion_workspaces_[i].candidate_vector, min_node_distance);
+    }
+    n += expansion_origins_.size();
+
+    // find best nodes to continue, the cheapest one ends the path
+    selectOpenNodes(std::max(
+        1, std::min(static_cast<int>(batch_size), n_expanded_nodes_ - n)));
+
+    // anytime search: the path found so far is used once the time is up
+    if (has_deadline && n < n_expanded_nodes_ && clock_->now() >= deadline) {
+      ROS_DEBUG("\033[0;35m[SP] Time budget of %.1fms used up after %d of %d "
+                "expanded nodes\033[0m",
+                (double)tree_time_budget_ms_, n, n_expanded_nodes_);
+      break;
+    }
+  }
+
   // smoothing between trees
-  int tree_end = origin;
+  int tree_end = expansion_origins_.front();
   path_node_positions_.clear();
   path_node_origins_.clear();
   while (tree_end > 0) {
     path_node_origins_.push_back(tree_end);
-    path_node_positions_.push_back(tree_[tree_end].getPosition());
-    tree_end = tree_[tree_end].origin_;
+    path_node_positions_.push_back(tree_.position[tree_end]);
+    tree_end = tree_.origin[tree_end];
   }
-  path_node_positions_.push_back(tree_[0].getPosition());
+  path_node_positions_.push_back(tree_.position[0]);
   path_node_origins_.push_back(0);
   tree_age_ = 0;
 
@@ -238,12 +431,14 @@ void StarPlanner::buildLookAheadTree() {
       "calculated in %2.2fms.\033[0m",
       (double)tree_.size(), (double)path_node_positions_.size(),
       (double)closed_set_.size(),
-      (std::clock() - start_time) / (double)(CLOCKS_PER_SEC / 1000));
+      std::chrono::duration<double, std::milli>(clock_->now() - start_time)
+          .count());
   for (int j = 0; j < path_node_positions_.size(); j++) {
     ROS_DEBUG("\033[0;35m[SP] node %.0f : [ %f, %f, %f]\033[0m", (double)j,
               (double)path_node_positions_[j].x(),
               (double)path_node_positions_[j].y(),
               (double)path_node_positions_[j].z());
   }
+  return closed_set_.size();
 }
 }
@@ -0,0 +1,72 @@
+#include "local_planner/thread_pool.h"
+
+namespace avoidance {
+
+ThreadPool::ThreadPool(size_t n_workers) {
+  workers_.reserve(n_workers);
+  for (size_t i = 0; i < n_workers; i++) {
+    workers_.emplace_back(&ThreadPool::workerFunction, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    should_exit_ = true;
+  }
+  work_cv_.notify_all();
+  for (std::thread& worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::parallelFor(size_t n,
+                             const std::function<void(size_t)>& task) {
+  if (n == 0) return;
+  if (workers_.empty() || n == 1) {
+    for (size_t i = 0; i < n; i++) task(i);
+    return;
+  }
+
+  std::lock_guard<std::mutex> loop_lock(loop_mutex_);
+  std::unique_lock<std::mutex> lock(mutex_);
+  task_ = &task;
+  n_iterations_ = n;
+  next_iteration_ = 0;
+  n_finished_ = 0;
+  generation_++;
+  work_cv_.notify_all();
+
+  runIterations(lock);
+  done_cv_.wait(lock, [this] { return n_finished_ == n_iterations_; });
+  task_ = nullptr;
+}
+
+void ThreadPool::workerFunction() {
+  // the first loop can be started before this thread gets to run, compare
+  // against the generation at construction of the pool
+  unsigned long last_generation = 0;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    work_cv_.wait(lock, [&] {
+      return should_exit_ || generation_ != last_generation;
+    });
+    if (should_exit_) return;
+    last_generation = generation_;
+    runIterations(lock);
+  }
+}
+
+void ThreadPool::runIterations(std::unique_lock<std::mutex>& lock) {
+  while (task_ != nullptr && next_iteration_ < n_iterations_) {
+    const size_t i = next_iteration_++;
+    const std::function<void(size_t)>& task = *task_;
+    lock.unlock();
+    task(i);
+    lock.lock();
+    if (++n_finished_ == n_iterations_) {
+      done_cv_.notify_one();
+    }
+  }
+}
+}
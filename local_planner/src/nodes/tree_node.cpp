@@ -1,33 +1,104 @@
 #include "local_planner/tree_node.h"
 
+#include <cmath>
+
 namespace avoidance {
 
-TreeNode::TreeNode()
-    : total_cost_{0.0f},
-      heuristic_{0.0f},
-      last_e_{0.0f},
-      last_z_{0.0f},
-      origin_{0},
-      depth_{0},
-      yaw_{0.0f} {
-  position_ = Eigen::Vector3f::Zero();
+int Tree::addNode(int from, int d, const Eigen::Vector3f& pos) {
+  position.push_back(pos);
+  total_cost.push_back(0.f);
+  heuristic.push_back(0.f);
+  last_e.push_back(0.f);
+  last_z.push_back(0.f);
+  yaw.push_back(0.f);
+  origin.push_back(from);
+  depth.push_back(d);
+  return static_cast<int>(origin.size()) - 1;
+}
+
+void Tree::clear() {
+  position.clear();
+  total_cost.clear();
+  heuristic.clear();
+  last_e.clear();
+  last_z.clear();
+  yaw.clear();
+  origin.clear();
+  depth.clear();
+}
+
+void Tree::reserve(size_t n_nodes) {
+  position.reserve(n_nodes);
+  total_cost.reserve(n_nodes);
+  heuristic.reserve(n_nodes);
+  last_e.reserve(n_nodes);
+  last_z.reserve(n_nodes);
+  yaw.reserve(n_nodes);
+  origin.reserve(n_nodes);
+  depth.reserve(n_nodes);
+}
+
+namespace {
+// the key packs the cell indices relative to the origin into 21 bits each
+uint64_t cellKey(int64_t x, int64_t y, int64_t z) {
+  const int64_t offset = 1 << 20;
+  return ((static_cast<uint64_t>(x + offset) & 0x1FFFFF) << 42) |
+         ((static_cast<uint64_t>(y + offset) & 0x1FFFFF) << 21) |
+         (static_cast<uint64_t>(z + offset) & 0x1FFFFF);
+}
+}
+
+void TreeNodeGrid::reset(const Eigen::Vector3f& origin, float cell_size,
+                         size_t max_nodes) {
+  origin_ = origin;
+  inv_cell_size_ = 1.f / cell_size;
+
+  // power of two table with linear probing, at most half of it is used
+  table_bits_ = 4;
+  while ((size_t(1) << table_bits_) < 2 * max_nodes) table_bits_++;
+  keys_.resize(size_t(1) << table_bits_);
+  last_node_.assign(keys_.size(), -1);
+  positions_.clear();
+  previous_node_.clear();
 }
 
-TreeNode::TreeNode(int from, int d, const Eigen::Vector3f& pos)
-    : total_cost_{0.0f},
-      heuristic_{0.0f},
-      last_e_{0.0f},
-      last_z_{0.0f},
-      origin_{from},
-      depth_{d},
-      yaw_{0.0f} {
-  position_ = pos;
+size_t TreeNodeGrid::findSlot(uint64_t key) const {
+  const size_t table_mask = keys_.size() - 1;
+  size_t slot = (key * 0x9E3779B97F4A7C15ull) >> (64 - table_bits_);
+  while (last_node_[slot] != -1 && keys_[slot] != key) {
+    slot = (slot + 1) & table_mask;
+  }
+  return slot;
 }
 
-void TreeNode::setCosts(float h, float c) {
-  heuristic_ = h;
-  total_cost_ = c;
+void TreeNodeGrid::insert(const Eigen::Vector3f& position) {
+  const Eigen::Vector3f cell = (position - origin_) * inv_cell_size_;
+  const uint64_t key = cellKey(std::floor(cell.x()), std::floor(cell.y()),
+                               std::floor(cell.z()));
+  const size_t slot = findSlot(key);
+  keys_[slot] = key;
+  previous_node_.push_back(last_node_[slot]);
+  last_node_[slot] = positions_.size();
+  positions_.push_back(position);
 }
 
-Eigen::Vector3f TreeNode::getPosition() { return position_; }
+bool TreeNodeGrid::hasNodeWithin(const Eigen::Vector3f& position,
+                                 float radius) const {
+  const Eigen::Vector3f cell = (position - origin_) * inv_cell_size_;
+  const int64_t x = std::floor(cell.x());
+  const int64_t y = std::floor(cell.y());
+  const int64_t z = std::floor(cell.z());
+  for (int64_t dx = -1; dx <= 1; dx++) {
+    for (int64_t dy = -1; dy <= 1; dy++) {
+      for (int64_t dz = -1; dz <= 1; dz++) {
+        const size_t slot = findSlot(cellKey(x + dx, y + dy, z + dz));
+        for (int node = last_node_[slot]; node != -1;
+             node = previous_node_[node]) {
+          if ((positions_[node] - position).norm() < radius) return true;
+        }
+      }
+    }
+  }
+  return false;
+}
 }
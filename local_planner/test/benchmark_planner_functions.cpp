@@ -0,0 +1,242 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+#include "../include/local_planner/planner_functions.h"
+
+#include "../include/local_planner/common.h"
+#include "test_helpers.h"
+
+// Microbenchmarks of the per-cycle pipeline stages. They are built into a
+// separate executable which is not run with the unit tests, since the timings
+// are meaningless under valgrind and on loaded CI machines:
+// rosrun local_planner local_planner-benchmark
+
+using namespace avoidance;
+
+TEST(PlannerFunctionsBenchmark, filterPointCloud) {
+  // GIVEN: a 640x480 cloud, roughly half of it inside the histogram box
+  std::srand(42);
+  Eigen::Vector3f position(0.f, 0.f, 5.f);
+  Box histogram_box(5.f);
+  histogram_box.setBoxLimits(position, 5.f);
+  std::vector<pcl::PointCloud<pcl::PointXYZ>> complete_cloud(1);
+  for (int i = 0; i < 640 * 480; i++) {
+    complete_cloud[0].push_back(
+        pcl::PointXYZ(randomFloat(0.f, 8.f), randomFloat(-6.f, 6.f),
+                      position.z() + randomFloat(-3.f, 3.f)));
+  }
+
+  // WHEN: we filter the cloud
+  pcl::PointCloud<pcl::PointXYZ> cropped_cloud;
+  Eigen::Vector3f closest_point;
+  float distance_to_closest_point;
+  int counter_backoff;
+  double median_ms = medianRunTime(
+      [&]() {
+        filterPointCloud(cropped_cloud, closest_point,
+                         distance_to_closest_point, counter_backoff,
+                         complete_cloud, 20, 1.f, histogram_box, position,
+                         0.2f);
+      },
+      200);
+  std::cout << "filterPointCloud: " << complete_cloud[0].size() << " points, "
+            << cropped_cloud.size() << " kept, median " << median_ms << " ms"
+            << std::endl;
+
+  // THEN: a full resolution frame should be processed within a millisecond.
+  // The AVX2 kernel is selected at runtime and meets this, the four lane SSE2
+  // kernel is bound by the memory traffic of reading and compacting the frame
+  // and takes 1.0 - 1.3 ms
+  EXPECT_LT(median_ms, 1.0) << "expected miss on CPUs without AVX2";
+}
+
+template <int RES>
+void benchmarkCostMatrix() {
+  // GIVEN: a histogram with obstacles in a quarter of the bins
+  std::srand(42);
+  PolarHistogram<RES> histogram;
+  for (int e = 0; e < PolarHistogram<RES>::E_DIM; e++) {
+    for (int z = 0; z < PolarHistogram<RES>::Z_DIM; z++) {
+      if (std::rand() % 4 == 0) histogram.set_dist(e, z, 3.f);
+    }
+  }
+  Eigen::Vector3f position(0.f, 0.f, 2.f);
+  Eigen::Vector3f goal(10.f, 15.f, 4.f);
+  Eigen::Vector3f last_sent_waypoint(0.5f, 0.5f, 2.f);
+  float heading = 30.f;
+  costParameters cost_params;
+
+  // WHEN: we evaluate the costs per bin and as row wise array expressions
+  Eigen::MatrixXf cost_matrix, distance_matrix;
+  cost_matrix.resize(PolarHistogram<RES>::E_DIM, PolarHistogram<RES>::Z_DIM);
+  distance_matrix.resize(cost_matrix.rows(), cost_matrix.cols());
+  double per_bin_ms = medianRunTime(
+      [&]() {
+        for (int e = 0; e < PolarHistogram<RES>::E_DIM; e++) {
+          for (int z = 0; z < PolarHistogram<RES>::Z_DIM; z++) {
+            PolarPoint p_pol = histogramIndexToPolar(e, z, RES, 1.f);
+            costFunction(p_pol.e, p_pol.z, histogram.dist(e, z), goal,
+                         position, heading, last_sent_waypoint, cost_params,
+                         distance_matrix(e, z), cost_matrix(e, z));
+          }
+        }
+      },
+      200);
+  double row_wise_ms = medianRunTime(
+      [&]() {
+        evaluateCostMatrix(histogram, goal, position, heading,
+                           last_sent_waypoint, cost_params, cost_matrix,
+                           distance_matrix);
+      },
+      200);
+  std::cout << "evaluateCostMatrix: " << RES << " deg bins, per bin "
+            << per_bin_ms << " ms, row wise " << row_wise_ms << " ms"
+            << std::endl;
+
+  // THEN: the row wise evaluation should be faster
+  EXPECT_LT(row_wise_ms, per_bin_ms);
+}
+
+TEST(PlannerFunctionsBenchmark, evaluateCostMatrix) {
+  benchmarkCostMatrix<ALPHA_RES_FINE>();
+  benchmarkCostMatrix<ALPHA_RES>();
+}
+
+TEST(PlannerFunctionsBenchmark, smoothPolarMatrix) {
+  // GIVEN: a cost matrix at the fine bin size
+  std::srand(42);
+  const int rows = PolarHistogram<ALPHA_RES_FINE>::E_DIM;
+  const int cols = PolarHistogram<ALPHA_RES_FINE>::Z_DIM;
+  const Eigen::MatrixXf input = Eigen::MatrixXf::Random(rows, cols);
+  Eigen::MatrixXf matrix = input;
+  Eigen::VectorXf box_buffer;
+
+  // WHEN: we smooth it with small and large radii
+  std::vector<double> run_times_ms;
+  for (unsigned int radius : {2u, 10u, 30u}) {
+    run_times_ms.push_back(medianRunTime(
+        [&]() {
+          matrix = input;
+          smoothPolarMatrix(matrix, radius, box_buffer);
+        },
+        200));
+    std::cout << "smoothPolarMatrix: " << rows << "x" << cols << ", radius "
+              << radius << ", median " << run_times_ms.back() << " ms"
+              << std::endl;
+  }
+
+  // THEN: the run time should not grow with the radius
+  EXPECT_LT(run_times_ms.back(), 2.0 * run_times_ms.front());
+}
+
+TEST(PlannerFunctionsBenchmark, getBestCandidatesFromCostMatrix) {
+  // GIVEN: a cost matrix at the fine bin size and a number of children
+  std::srand(42);
+  const int rows = PolarHistogram<ALPHA_RES_FINE>::E_DIM;
+  const int cols = PolarHistogram<ALPHA_RES_FINE>::Z_DIM;
+  const Eigen::MatrixXf matrix =
+      Eigen::MatrixXf::Random(rows, cols).cwiseAbs() * 100.f;
+  const unsigned int n_candidates = 50;
+  std::vector<candidateDirection> candidate_vector;
+  candidate_vector.reserve(n_candidates);
+  CandidateSelectionBuffers buffers;
+
+  // WHEN: we convert every cell to a candidate and keep the cheapest ones, and
+  // when we select the cheapest cells before converting them
+  double per_cell_ms = medianRunTime(
+      [&]() {
+        candidate_vector.clear();
+        for (int e = 0; e < rows; e++) {
+          for (int z = 0; z < cols; z++) {
+            PolarPoint p_pol = histogramIndexToPolar(e, z, ALPHA_RES_FINE, 1.f);
+            candidate_vector.push_back(
+                candidateDirection(matrix(e, z), p_pol.e, p_pol.z));
+            std::push_heap(candidate_vector.begin(), candidate_vector.end());
+            if (candidate_vector.size() > n_candidates) {
+              std::pop_heap(candidate_vector.begin(), candidate_vector.end());
+              candidate_vector.pop_back();
+            }
+          }
+        }
+        std::sort_heap(candidate_vector.begin(), candidate_vector.end());
+      },
+      200);
+  double selection_ms = medianRunTime(
+      [&]() {
+        getBestCandidatesFromCostMatrix<ALPHA_RES_FINE>(
+            matrix, n_candidates, 0.f, candidate_vector, buffers);
+      },
+      200);
+  double separated_ms = medianRunTime(
+      [&]() {
+        getBestCandidatesFromCostMatrix<ALPHA_RES_FINE>(
+            matrix, n_candidates, 10.f, candidate_vector, buffers);
+      },
+      200);
+  std::cout << "getBestCandidatesFromCostMatrix: " << n_candidates << " of "
+            << rows * cols << " cells, per cell " << per_cell_ms
+            << " ms, selection " << selection_ms << " ms, with separation "
+            << separated_ms << " ms" << std::endl;
+
+  // THEN: selecting before converting should be faster
+  EXPECT_LT(selection_ms, per_cell_ms);
+}
+
+TEST(PlannerFunctionsBenchmark, generateCombinedHistogramFromObstacleIndex) {
+  // GIVEN: a cropped cloud of a depth camera frame looking at two walls and
+  // the positions of the nodes of a search tree
+  std::srand(42);
+  const Eigen::Vector3f position(0.f, 0.f, 5.f);
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  for (int i = 0; i < 20000; i++) {
+    const float wall_y = i % 2 == 0 ? 3.f : 5.f;
+    cloud.push_back(pcl::PointXYZ(randomFloat(-4.f, 4.f), wall_y,
+                                  position.z() + randomFloat(-2.f, 2.f)));
+  }
+  std::vector<Eigen::Vector3f> node_positions;
+  for (int i = 0; i < 25; i++) {
+    node_positions.push_back(position +
+                             Eigen::Vector3f(randomFloat(-1.f, 1.f),
+                                             randomFloat(0.f, 2.f),
+                                             randomFloat(-1.f, 1.f)));
+  }
+  int e_FOV_min, e_FOV_max;
+  FOVMask z_FOV_mask;
+  calculateFOV<ALPHA_RES>(90.f, 45.f, z_FOV_mask, e_FOV_min, e_FOV_max, 0.f,
+                          0.f);
+  PolarHistogram<ALPHA_RES> memory, histogram;
+  bool hist_empty;
+
+  // WHEN: we build the histograms of all nodes from the cloud, and from the
+  // index built once for the tree
+  double cloud_ms = medianRunTime(
+      [&]() {
+        for (const Eigen::Vector3f& node_position : node_positions) {
+          generateCombinedHistogram(histogram, hist_empty, cloud, memory,
+                                    position, node_position, 15.f, 10, false,
+                                    z_FOV_mask, e_FOV_min, e_FOV_max);
+        }
+      },
+      20);
+  ObstacleIndex index;
+  double index_ms = medianRunTime(
+      [&]() {
+        buildObstacleIndex(cloud, position, 0.1f, index);
+        for (const Eigen::Vector3f& node_position : node_positions) {
+          generateCombinedHistogram(histogram, hist_empty, index, memory,
+                                    position, node_position, 15.f, 10, false,
+                                    z_FOV_mask, e_FOV_min, e_FOV_max);
+        }
+      },
+      20);
+  std::cout << "generateCombinedHistogram: " << node_positions.size()
+            << " nodes, " << cloud.size() << " points, from the cloud "
+            << cloud_ms << " ms, from " << index.centroids.size()
+            << " voxels " << index_ms << " ms" << std::endl;
+
+  // THEN: binning the voxels should be faster, including the index build
+  EXPECT_LT(index_ms, cloud_ms);
+}
@@ -0,0 +1,262 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+#include "../include/local_planner/common.h"
+#include "../include/local_planner/star_planner.h"
+#include "../include/local_planner/tree_node.h"
+#include "test_helpers.h"
+
+// Scaling benchmark of the search tree, part of the local_planner-benchmark
+// executable
+
+using namespace avoidance;
+
+TEST(StarPlannerBenchmark, buildLookAheadTree) {
+  // GIVEN: a vehicle in front of a wall and a goal behind it
+  ros::Time::init();
+  std::srand(42);
+  const Eigen::Vector3f position(0.f, 0.f, 5.f);
+  const Eigen::Vector3f goal(0.f, 20.f, 5.f);
+  pcl::PointCloud<pcl::PointXYZ>::Ptr cloud(
+      new pcl::PointCloud<pcl::PointXYZ>());
+  for (int i = 0; i < 5000; i++) {
+    cloud->push_back(pcl::PointXYZ(randomFloat(-3.f, 3.f), 4.f,
+                                   position.z() + randomFloat(-2.f, 2.f)));
+  }
+
+  // WHEN: we grow the number of expanded nodes and the branching factor. The
+  // setup of the tree is measured without expansions and subtracted. A tree of
+  // five expansions with the same branching factor is the baseline: expanding
+  // a node and adding its children takes time in proportion to the branching
+  // factor, only the growth beyond that comes from the size of the tree
+  std::vector<double> expansion_ratios;
+  for (int size : {25, 50, 100, 200}) {
+    std::vector<double> median_ms;
+    size_t tree_size = 0;
+    const int n_baseline = 5;
+    for (int n_expanded : {0, n_baseline, size}) {
+      StarPlanner star_planner;
+      avoidance::LocalPlannerNodeConfig config =
+          avoidance::LocalPlannerNodeConfig::__getDefault__();
+      config.n_expanded_nodes_ = n_expanded;
+      config.children_per_node_ = size;
+      config.max_path_length_ = 20.0;
+      star_planner.dynamicReconfigureSetStarParams(config, 1);
+      star_planner.setParams(costParameters());
+      star_planner.setFOV(270.f, 45.f);
+      star_planner.setObstacleMemory(Histogram(), position, 10, 20.f);
+      star_planner.setPose(position, 90.f);
+      star_planner.setCloud(cloud);
+
+      median_ms.push_back(medianRunTime(
+          [&]() {
+            star_planner.setGoal(goal);
+            star_planner.buildLookAheadTree();
+          },
+          n_expanded < size ? 51 : 11));
+      tree_size = star_planner.tree_.size();
+    }
+    const double baseline_ms = (median_ms[1] - median_ms[0]) / n_baseline;
+    const double expansion_ms = (median_ms[2] - median_ms[0]) / size;
+    expansion_ratios.push_back(expansion_ms / baseline_ms);
+    std::cout << "buildLookAheadTree: " << size << " expanded nodes with "
+              << size << " children, " << tree_size << " nodes, "
+              << expansion_ms << " ms per expansion, baseline "
+              << baseline_ms << " ms" << std::endl;
+  }
+
+  // THEN: the time per expansion should stay near the baseline of the same
+  // branching factor, independently of the size of the tree
+  for (double ratio : expansion_ratios) {
+    EXPECT_LT(ratio, 1.5);
+  }
+}
+
+TEST(StarPlannerBenchmark, buildLookAheadTreeBatched) {
+  // GIVEN: a vehicle in front of a wall, a goal behind it and the number of
+  // cores of the machine
+  ros::Time::init();
+  std::srand(42);
+  const Eigen::Vector3f position(0.f, 0.f, 5.f);
+  const Eigen::Vector3f goal(0.f, 20.f, 5.f);
+  pcl::PointCloud<pcl::PointXYZ>::Ptr cloud(
+      new pcl::PointCloud<pcl::PointXYZ>());
+  for (int i = 0; i < 20000; i++) {
+    cloud->push_back(pcl::PointXYZ(randomFloat(-4.f, 4.f),
+                                   randomFloat(3.f, 8.f),
+                                   position.z() + randomFloat(-2.f, 2.f)));
+  }
+  const unsigned int n_cores = std::thread::hardware_concurrency();
+
+  // WHEN: we expand the same number of nodes one after the other and in
+  // batches
+  std::vector<double> run_times_ms;
+  for (int batch : {1, 2, 4, 8}) {
+    StarPlanner star_planner;
+    avoidance::LocalPlannerNodeConfig config =
+        avoidance::LocalPlannerNodeConfig::__getDefault__();
+    config.n_expanded_nodes_ = 40;
+    config.max_path_length_ = 20.0;
+    config.tree_expansion_batch_ = batch;
+    star_planner.dynamicReconfigureSetStarParams(config, 1);
+    star_planner.setParams(costParameters());
+    star_planner.setFOV(270.f, 45.f);
+    star_planner.setObstacleMemory(Histogram(), position, 10, 20.f);
+    star_planner.setPose(position, 90.f);
+    star_planner.setCloud(cloud);
+
+    run_times_ms.push_back(medianRunTime(
+        [&]() {
+          star_planner.setGoal(goal);
+          star_planner.buildLookAheadTree();
+        },
+        11));
+    std::cout << "buildLookAheadTree: " << n_cores << " cores, batches of "
+              << batch << ", " << star_planner.closed_set_.size()
+              << " expanded nodes, median " << run_times_ms.back()
+              << " ms, speedup " << run_times_ms.front() / run_times_ms.back()
+              << std::endl;
+  }
+
+  // THEN: with four cores, batches of four should expand the nodes clearly
+  // faster. With fewer cores the batches can not run concurrently and should
+  // cost little more than the sequential expansion
+  if (n_cores >= 4) {
+    EXPECT_LT(run_times_ms[2], 0.6 * run_times_ms[0]);
+  } else {
+    EXPECT_LT(run_times_ms[2], 1.25 * run_times_ms[0]);
+  }
+}
+
+TEST(StarPlannerBenchmark, buildLookAheadTreeWarmStart) {
+  // GIVEN: a vehicle approaching a wall with a gap, the goal behind the wall
+  ros::Time::init();
+  std::srand(42);
+  const Eigen::Vector3f start(0.f, 0.f, 5.f);
+  const Eigen::Vector3f goal(0.f, 20.f, 5.f);
+  pcl::PointCloud<pcl::PointXYZ>::Ptr cloud(
+      new pcl::PointCloud<pcl::PointXYZ>());
+  for (int i = 0; i < 5000; i++) {
+    float x = randomFloat(-4.f, 4.f);
+    if (x > 0.5f && x < 1.5f) continue;
+    cloud->push_back(pcl::PointXYZ(x, 4.f, start.z() + randomFloat(-2.f, 2.f)));
+  }
+
+  // WHEN: we plan a cycle after every 5 cm the vehicle moves along the path,
+  // with and without reusing the previous path
+  std::vector<double> cycle_times_ms;
+  std::vector<double> heading_changes_deg;
+  for (bool warm_start : {false, true}) {
+    StarPlanner star_planner;
+    avoidance::LocalPlannerNodeConfig config =
+        avoidance::LocalPlannerNodeConfig::__getDefault__();
+    config.tree_warm_start_ = warm_start;
+    star_planner.dynamicReconfigureSetStarParams(config, 1);
+    star_planner.setParams(costParameters());
+    star_planner.setFOV(270.f, 45.f);
+    star_planner.setObstacleMemory(Histogram(), start, 10, 20.f);
+    star_planner.setCloud(cloud);
+    star_planner.setGoal(goal);
+
+    Eigen::Vector3f position = start;
+    Eigen::Vector3f last_heading = Eigen::Vector3f::Zero();
+    std::vector<double> run_times;
+    double heading_change_deg = 0.0;
+    int n_compared = 0;
+    for (int cycle = 0; cycle < 40; cycle++) {
+      star_planner.setPose(position, 90.f);
+      auto start_time = std::chrono::steady_clock::now();
+      star_planner.buildLookAheadTree();
+      auto end_time = std::chrono::steady_clock::now();
+      run_times.push_back(
+          std::chrono::duration<double, std::milli>(end_time - start_time)
+              .count());
+
+      // change of the direction to the first path node, which the vehicle
+      // follows
+      const std::vector<Eigen::Vector3f>& path =
+          star_planner.path_node_positions_;
+      if (path.size() < 2) continue;
+      const Eigen::Vector3f heading =
+          (path[path.size() - 2] - position).normalized();
+      if (cycle > 0) {
+        heading_change_deg +=
+            RAD_TO_DEG * std::acos(std::min(1.f, heading.dot(last_heading)));
+        n_compared++;
+      }
+      last_heading = heading;
+      position += 0.05f * heading;
+    }
+    std::sort(run_times.begin(), run_times.end());
+    cycle_times_ms.push_back(run_times[run_times.size() / 2]);
+    heading_changes_deg.push_back(heading_change_deg / std::max(n_compared, 1));
+    std::cout << "buildLookAheadTree: warm start " << warm_start
+              << ", median " << cycle_times_ms.back()
+              << " ms per cycle, mean heading change "
+              << heading_changes_deg.back() << " deg" << std::endl;
+  }
+
+  // THEN: reusing the path should be faster and the heading more stable
+  EXPECT_LT(cycle_times_ms[1], cycle_times_ms[0]);
+  EXPECT_LT(heading_changes_deg[1], heading_changes_deg[0]);
+}
+
+TEST(StarPlannerBenchmark, buildLookAheadTreeTimeBudget) {
+  // GIVEN: a vehicle in front of walls of a growing number of points and a
+  // planner which may expand up to 200 nodes within 10ms
+  ros::Time::init();
+  std::srand(42);
+  const Eigen::Vector3f position(0.f, 0.f, 5.f);
+  const Eigen::Vector3f goal(0.f, 20.f, 5.f);
+  const double budget_ms = 10.0;
+
+  // WHEN: we build the tree with and without the time budget
+  std::vector<double> budget_times_ms;
+  for (int n_points : {2000, 8000, 32000}) {
+    pcl::PointCloud<pcl::PointXYZ>::Ptr cloud(
+        new pcl::PointCloud<pcl::PointXYZ>());
+    for (int i = 0; i < n_points; i++) {
+      cloud->push_back(pcl::PointXYZ(randomFloat(-4.f, 4.f),
+                                     randomFloat(3.f, 8.f),
+                                     position.z() + randomFloat(-2.f, 2.f)));
+    }
+    for (double budget : {0.0, budget_ms}) {
+      StarPlanner star_planner;
+      avoidance::LocalPlannerNodeConfig config =
+          avoidance::LocalPlannerNodeConfig::__getDefault__();
+      config.n_expanded_nodes_ = 200;
+      config.max_path_length_ = 20.0;
+      config.tree_time_budget_ms_ = budget;
+      star_planner.dynamicReconfigureSetStarParams(config, 1);
+      star_planner.setParams(costParameters());
+      star_planner.setFOV(270.f, 45.f);
+      star_planner.setObstacleMemory(Histogram(), position, 10, 20.f);
+      star_planner.setPose(position, 90.f);
+      star_planner.setCloud(cloud);
+
+      int n_expanded = 0;
+      double median_ms = medianRunTime(
+          [&]() {
+            star_planner.setGoal(goal);
+            n_expanded = star_planner.buildLookAheadTree();
+          },
+          5);
+      if (budget > 0.0) budget_times_ms.push_back(median_ms);
+      std::cout << "buildLookAheadTree: " << n_points << " points, budget "
+                << budget << " ms, " << n_expanded << " expanded nodes, "
+                << star_planner.path_node_positions_.size()
+                << " path nodes, median " << median_ms << " ms" << std::endl;
+    }
+  }
+
+  // THEN: the time budget should bound the cycle time independently of the
+  // number of points, up to the last expansion
+  for (double time_ms : budget_times_ms) {
+    EXPECT_LT(time_ms, 1.5 * budget_ms);
+  }
+}
@@ -377,6 +377,31 @@ TEST(Common, IndexPolarIndex) {
   }
 }
 
+TEST(Common, approxAtan2) {
+  // GIVEN: directions all around the circle
+  float max_error = 0.f;
+  for (int i = 0; i <= 100000; i++) {
+    double angle = -M_PI + 2.0 * M_PI * i / 100000.0;
+    float y = static_cast<float>(3.7 * std::sin(angle));
+    float x = static_cast<float>(3.7 * std::cos(angle));
+
+    // WHEN: we compute the approximate angle
+    float approx = approxAtan2(y, x);
+
+    // THEN: it should be within the documented error of the exact one
+    float error = std::abs(approx - std::atan2(y, x));
+    max_error = std::max(max_error, std::min(error, 2.f * M_PI_F - error));
+  }
+  EXPECT_LE(max_error, ATAN2_APPROX_MAX_ERROR_RAD);
+
+  // AND: the zero vector and the axes should map to the exact angles
+  EXPECT_FLOAT_EQ(0.f, approxAtan2(0.f, 0.f));
+  EXPECT_FLOAT_EQ(0.f, approxAtan2(0.f, 2.f));
+  EXPECT_FLOAT_EQ(M_PI_F / 2.f, approxAtan2(2.f, 0.f));
+  EXPECT_FLOAT_EQ(-M_PI_F / 2.f, approxAtan2(-2.f, 0.f));
+  EXPECT_FLOAT_EQ(M_PI_F, approxAtan2(0.f, -2.f));
+}
+
 TEST(Common, wrapPolar) {
   // GIVEN: some polar points with elevation and azimuth angles which need to be
   // wrapped
@@ -0,0 +1,44 @@
+#ifndef TEST_HELPERS_H
+#define TEST_HELPERS_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <vector>
+
+// Helpers shared by the unit tests and the benchmarks
+
+/**
+* @brief     draws a uniformly distributed number from std::rand, so that the
+*            sequence is reproducible after seeding with std::srand
+* @param[in] min, lower bound of the interval
+* @param[in] max, upper bound of the interval
+* @returns   random number in [min, max]
+**/
+inline float randomFloat(float min, float max) {
+  return min + (max - min) * static_cast<float>(std::rand()) / RAND_MAX;
+}
+
+/**
+* @brief     runs the function repeatedly and measures it with
+*            std::chrono::steady_clock
+* @param[in] function, callable without arguments
+* @param[in] iterations, number of runs
+* @returns   median run time [ms]
+**/
+template <typename Function>
+double medianRunTime(Function function, int iterations) {
+  std::vector<double> run_times;
+  run_times.reserve(iterations);
+  for (int i = 0; i < iterations; i++) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    auto end = std::chrono::steady_clock::now();
+    run_times.push_back(
+        std::chrono::duration<double, std::milli>(end - start).count());
+  }
+  std::sort(run_times.begin(), run_times.end());
+  return run_times[run_times.size() / 2];
+}
+
+#endif  // TEST_HELPERS_H
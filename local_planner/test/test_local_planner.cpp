@@ -1,10 +1,57 @@
 #include <gtest/gtest.h>
 
+#include <atomic>
 #include <cmath>
+#include <cstdlib>
 
 #include "../include/local_planner/common.h"
 #include "../include/local_planner/local_planner.h"
 
+#ifdef __GLIBC__
+// Allocation counting hook: the malloc family is interposed for the whole test
+// binary and forwards to glibc. This catches operator new as well as the
+// Eigen allocations, which call malloc directly.
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+}
+
+namespace {
+std::atomic<bool> count_allocations(false);
+std::atomic<size_t> n_allocations(0);
+
+void countAllocation() {
+  if (count_allocations) n_allocations++;
+}
+
+// returns the number of heap allocations made while running function
+template <typename Function>
+size_t countAllocations(Function function) {
+  n_allocations = 0;
+  count_allocations = true;
+  function();
+  count_allocations = false;
+  return n_allocations;
+}
+}
+
+extern "C" {
+void* malloc(size_t size) {
+  countAllocation();
+  return __libc_malloc(size);
+}
+void* calloc(size_t n, size_t size) {
+  countAllocation();
+  return __libc_calloc(n, size);
+}
+void* realloc(void* ptr, size_t size) {
+  countAllocation();
+  return __libc_realloc(ptr, size);
+}
+}
+#endif  // __GLIBC__
+
 // Stateless tests:
 // Create some hardcoded scan data of obstacles in different positions
 // For each one check that the planner response is correct
@@ -206,3 +253,236 @@ TEST_F(LocalPlannerTests, obstacles_left) {
   }
   EXPECT_LT(node_min_y, min_y);
 }
+
+TEST_F(LocalPlannerTests, histogramResolutions) {
+  // GIVEN: a local planner and a scan with obstacles everywhere in front
+  float distance = 2.f;
+  float fov_half_y = distance * std::tan(planner.h_FOV_ * M_PI_F / 180.f / 2.f);
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  for (float y = -fov_half_y; y <= fov_half_y; y += 0.01f) {
+    for (float z = -1.f; z <= 1.f; z += 0.1f) {
+      cloud.push_back(pcl::PointXYZ(distance, y, z + 30.f));
+    }
+  }
+  planner.complete_cloud_.push_back(std::move(cloud));
+
+  for (int res : {ALPHA_RES_FINE, ALPHA_RES_COARSE, 7}) {
+    // WHEN: we select the bin size and run the local planner
+    avoidance::LocalPlannerNodeConfig config =
+        avoidance::LocalPlannerNodeConfig::__getDefault__();
+    config.send_obstacles_fcu_ = true;
+    config.histogram_resolution_ = res;
+    planner.dynamicReconfigureSetParams(config, 1);
+    planner.runPlanner();
+    planner.runPlanner();
+
+    // THEN: the unsupported bin size should fall back to the default one
+    const int expected_res = isSupportedResolution(res) ? res : ALPHA_RES;
+    ASSERT_EQ(expected_res, planner.getHistogramResolution());
+
+    // AND: the scan and the images should have the size of the bin size
+    const size_t e_dim = 180 / expected_res;
+    const size_t z_dim = 360 / expected_res;
+    sensor_msgs::LaserScan scan;
+    planner.sendObstacleDistanceDataToFcu(scan);
+    EXPECT_EQ(z_dim, scan.ranges.size());
+    EXPECT_NEAR(expected_res * M_PI / 180.0, scan.angle_increment, 1e-6);
+    EXPECT_EQ(e_dim * z_dim, planner.histogram_image_data_.size());
+    EXPECT_EQ(3 * e_dim * z_dim, planner.cost_image_data_.size());
+
+    // AND: the obstacle should be seen and avoided
+    avoidanceOutput output = planner.getAvoidanceOutput();
+    EXPECT_TRUE(output.obstacle_ahead) << "resolution: " << res;
+    ASSERT_GE(output.path_node_positions.size(), 2) << "resolution: " << res;
+    float node_max_y = 0.f;
+    float node_min_y = 0.f;
+    for (auto it = output.path_node_positions.rbegin();
+         it != output.path_node_positions.rend(); ++it) {
+      auto node = *it;
+      if (node.x() > distance) break;
+      if (node.y() > node_max_y) node_max_y = node.y();
+      if (node.y() < node_min_y) node_min_y = node.y();
+    }
+    EXPECT_TRUE(node_max_y > fov_half_y || node_min_y < -fov_half_y)
+        << "resolution: " << res;
+  }
+}
+
+TEST_F(LocalPlannerTests, cameraSlicesKeepTheCloudsOfOtherCameras) {
+  // GIVEN: a camera looking forward at a wall and one looking backward
+  float distance = 2.f;
+  float fov_half_y = distance * std::tan(planner.h_FOV_ * M_PI_F / 180.f / 2.f);
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  for (float y = -fov_half_y; y <= fov_half_y; y += 0.01f) {
+    for (float z = -1.f; z <= 1.f; z += 0.1f) {
+      cloud.push_back(pcl::PointXYZ(distance, y, z + 30.f));
+    }
+  }
+  planner.h_FOV_ *= 2.f;
+  planner.complete_cloud_.push_back(cloud);
+  planner.complete_cloud_.emplace_back();
+  planner.camera_slices_.resize(2);
+  planner.camera_slices_[0].direction = PolarPoint(0.f, 90.f, 1.f);
+  planner.camera_slices_[1].direction = PolarPoint(0.f, -90.f, 1.f);
+  auto expectWall = [this, distance](bool wall) {
+    sensor_msgs::LaserScan scan;
+    planner.sendObstacleDistanceDataToFcu(scan);
+    for (size_t i = 10; i <= 19; i++) {
+      if (wall) {
+        EXPECT_LT(scan.ranges[i], distance * 1.5f) << "index: " << i;
+      } else {
+        EXPECT_GT(scan.ranges[i], scan.range_max) << "index: " << i;
+      }
+    }
+  };
+
+  // WHEN: both cameras deliver a cloud
+  planner.camera_slices_[0].updated = true;
+  planner.camera_slices_[1].updated = true;
+  planner.runPlanner();
+
+  // THEN: the wall should be seen
+  expectWall(true);
+
+  // WHEN: only the backward camera delivers and the forward cloud is outdated
+  planner.complete_cloud_[0].clear();
+  planner.camera_slices_[0].updated = false;
+  planner.runPlanner();
+
+  // THEN: the wall should be kept in the obstacle memory
+  expectWall(true);
+
+  // WHEN: the forward camera delivers a cloud without the wall
+  planner.camera_slices_[0].updated = true;
+  planner.runPlanner();
+
+  // THEN: the wall should be gone
+  expectWall(false);
+}
+
+TEST_F(LocalPlannerTests, debugImagesOnlyOnRequest) {
+  // GIVEN: a local planner and a scan with an obstacle in front
+  float distance = 2.f;
+  float fov_half_y = distance * std::tan(planner.h_FOV_ * M_PI_F / 180.f / 2.f);
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  for (float y = -fov_half_y; y <= fov_half_y; y += 0.01f) {
+    for (float z = -1.f; z <= 1.f; z += 0.1f) {
+      cloud.push_back(pcl::PointXYZ(distance, y, z + 30.f));
+    }
+  }
+  planner.complete_cloud_.push_back(std::move(cloud));
+
+  // WHEN: we run the planner without requesting the debug images
+  planner.generate_histogram_image_ = false;
+  planner.generate_cost_image_ = false;
+  planner.runPlanner();
+  planner.runPlanner();
+
+  // THEN: the obstacle should be seen, but no image should be generated
+  EXPECT_TRUE(planner.getAvoidanceOutput().obstacle_ahead);
+  EXPECT_TRUE(planner.histogram_image_data_.empty());
+  EXPECT_TRUE(planner.cost_image_data_.empty());
+
+  // WHEN: we request them in the next run
+  planner.generate_histogram_image_ = true;
+  planner.generate_cost_image_ = true;
+  planner.runPlanner();
+
+  // THEN: both images should be generated
+  const size_t n_bins = GRID_LENGTH_E * GRID_LENGTH_Z;
+  EXPECT_EQ(n_bins, planner.histogram_image_data_.size());
+  EXPECT_EQ(3 * n_bins, planner.cost_image_data_.size());
+}
+
+TEST_F(LocalPlannerTests, finalCloudIsSharedNotCopied) {
+  // GIVEN: a local planner using VFH* and a scan with an obstacle in front
+  avoidance::LocalPlannerNodeConfig config =
+      avoidance::LocalPlannerNodeConfig::__getDefault__();
+  config.use_VFH_star_ = true;
+  planner.dynamicReconfigureSetParams(config, 1);
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  for (float y = -1.f; y <= 1.f; y += 0.01f) {
+    for (float z = -1.f; z <= 1.f; z += 0.1f) {
+      cloud.push_back(pcl::PointXYZ(2.f, y, z + 30.f));
+    }
+  }
+  planner.complete_cloud_.push_back(std::move(cloud));
+
+  // WHEN: we run the local planner until it builds a tree and read its cloud
+  planner.runPlanner();
+  planner.runPlanner();
+  pcl::PointCloud<pcl::PointXYZ>::ConstPtr final_cloud =
+      planner.getFinalCloud();
+
+  // THEN: the cloud should be held by the planner, the star planner and the
+  // reader, none of them has a copy
+  ASSERT_FALSE(final_cloud->points.empty());
+  EXPECT_EQ(3, final_cloud.use_count());
+  EXPECT_EQ(final_cloud.get(), planner.getFinalCloud().get());
+
+  // WHEN: the reader holds the cloud while the obstacle moves closer
+  const std::vector<pcl::PointXYZ> points = final_cloud->points;
+  for (pcl::PointXYZ& point : planner.complete_cloud_[0]) {
+    point.x = 1.5f;
+  }
+  for (int i = 0; i < 3; i++) {
+    planner.runPlanner();
+  }
+
+  // THEN: the held cloud should not be modified by the later cycles
+  EXPECT_NE(final_cloud.get(), planner.getFinalCloud().get());
+  ASSERT_EQ(points.size(), final_cloud->points.size());
+  for (size_t i = 0; i < points.size(); i++) {
+    EXPECT_FLOAT_EQ(2.f, final_cloud->points[i].x);
+    EXPECT_FLOAT_EQ(points[i].y, final_cloud->points[i].y);
+  }
+  EXPECT_FLOAT_EQ(1.5f, planner.getFinalCloud()->points.front().x);
+}
+
+#ifdef __GLIBC__
+TEST_F(LocalPlannerTests, steadyStateCycleDoesNotAllocate) {
+  // GIVEN: a local planner and a scan with an obstacle in front, such that the
+  // histograms, the cost matrix and the search tree are built in every cycle
+  float distance = 2.f;
+  float fov_half_y = distance * std::tan(planner.h_FOV_ * M_PI_F / 180.f / 2.f);
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  for (float y = -fov_half_y; y <= fov_half_y; y += 0.01f) {
+    for (float z = -1.f; z <= 1.f; z += 0.1f) {
+      cloud.push_back(pcl::PointXYZ(distance, y, z + 30.f));
+    }
+  }
+  planner.complete_cloud_.push_back(std::move(cloud));
+
+  // enabled log statements are allowed to allocate
+  ros::console::set_logger_level(ROSCONSOLE_DEFAULT_NAME,
+                                 ros::console::levels::Warn);
+  ros::console::notifyLoggerLevelsChanged();
+
+  for (bool use_vfh_star : {true, false}) {
+    avoidance::LocalPlannerNodeConfig config =
+        avoidance::LocalPlannerNodeConfig::__getDefault__();
+    config.send_obstacles_fcu_ = true;
+    config.downsample_cloud_ = true;
+    config.use_VFH_star_ = use_vfh_star;
+    planner.dynamicReconfigureSetParams(config, 1);
+
+    // WHEN: the planner has run until its workspaces reached their final size
+    for (int i = 0; i < 3; i++) {
+      planner.runPlanner();
+    }
+
+    // THEN: further planning cycles shouldn't allocate
+    size_t n = countAllocations([this]() {
+      for (int i = 0; i < 3; i++) {
+        planner.runPlanner();
+      }
+    });
+    EXPECT_EQ(0u, n) << "use_VFH_star_: " << use_vfh_star;
+  }
+  EXPECT_TRUE(planner.getAvoidanceOutput().obstacle_ahead);
+
+  ros::console::set_logger_level(ROSCONSOLE_DEFAULT_NAME,
+                                 ros::console::levels::Info);
+  ros::console::notifyLoggerLevelsChanged();
+}
+#endif  // __GLIBC__
@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 
+#include "../include/local_planner/local_planner.h"
 #include "../include/local_planner/local_planner_node.h"
 
 using namespace avoidance;
@@ -53,3 +54,36 @@ TEST(LocalPlannerNodeTests, failsafe) {
               static_cast<int>(MAV_STATE::MAV_STATE_FLIGHT_TERMINATION));
   }
 }
+
+TEST(LocalPlannerNodeTests, asyncUpdateRequiresRecentCloud) {
+  ros::Time::init();
+  LocalPlannerNode Node(false);
+  Node.async_pointcloud_processing_ = true;
+  Node.planner_rate_ = 10.0;
+  Node.max_pointcloud_age_ = 0.5;
+  Node.cameras_.resize(2);
+
+  // no cloud received yet
+  EXPECT_FALSE(Node.canUpdatePlannerAsync());
+
+  // one camera is lagging, the other delivers
+  ros::Time now = ros::Time::now();
+  Node.cameras_[0].planner_cloud_stamp_ = now - ros::Duration(2.0);
+  Node.cameras_[1].cloud_stamp_ = now - ros::Duration(0.1);
+  Node.cameras_[1].cloud_updated_ = true;
+  EXPECT_TRUE(Node.canUpdatePlannerAsync());
+
+  // all clouds are outdated
+  Node.cameras_[1].cloud_stamp_ = now - ros::Duration(1.0);
+  EXPECT_FALSE(Node.canUpdatePlannerAsync());
+
+  // only the histogram slice of the delivering camera is rebuilt
+  Node.cameras_[1].cloud_stamp_ = now - ros::Duration(0.1);
+  Node.cameras_[1].direction_ = PolarPoint(0.f, 90.f, 1.f);
+  Node.local_planner_->complete_cloud_.resize(2);
+  Node.updatePointCloudsAsync();
+  ASSERT_EQ(2, Node.local_planner_->camera_slices_.size());
+  EXPECT_FALSE(Node.local_planner_->camera_slices_[0].updated);
+  EXPECT_TRUE(Node.local_planner_->camera_slices_[1].updated);
+  EXPECT_FLOAT_EQ(90.f, Node.local_planner_->camera_slices_[1].direction.z);
+}
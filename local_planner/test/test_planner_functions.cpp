@@ -1,16 +1,21 @@
 #include <gtest/gtest.h>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
 
 #include "../include/local_planner/planner_functions.h"
 
 #include "../include/local_planner/common.h"
+#include "test_helpers.h"
+
+#include <sensor_msgs/image_encodings.h>
 
 using namespace avoidance;
 
 TEST(PlannerFunctions, generateNewHistogramEmpty) {
   // GIVEN: an empty pointcloud
   pcl::PointCloud<pcl::PointXYZ> empty_cloud;
-  Histogram histogram_output = Histogram(ALPHA_RES);
+  Histogram histogram_output;
   geometry_msgs::PoseStamped location;
   location.pose.position.x = 0;
   location.pose.position.y = 0;
@@ -30,7 +35,7 @@ TEST(PlannerFunctions, generateNewHistogramEmpty) {
 
 TEST(PlannerFunctions, generateNewHistogramSpecificCells) {
   // GIVEN: a pointcloud with an object of one cell size
-  Histogram histogram_output = Histogram(ALPHA_RES);
+  Histogram histogram_output;
   Eigen::Vector3f location(0.0f, 0.0f, 0.0f);
   float distance = 1.0f;
 
@@ -79,6 +84,50 @@ TEST(PlannerFunctions, generateNewHistogramSpecificCells) {
   }
 }
 
+TEST(PlannerFunctions, binPointBatchMatchesExactBins) {
+  // GIVEN: a random cloud whose size is not a multiple of the batch size
+  std::srand(42);
+  Eigen::Vector3f position(1.f, -2.f, 3.f);
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  for (int i = 0; i < 20003; i++) {
+    cloud.push_back(pcl::PointXYZ(position.x() + randomFloat(-10.f, 10.f),
+                                  position.y() + randomFloat(-10.f, 10.f),
+                                  position.z() + randomFloat(-10.f, 10.f)));
+  }
+  const float max_error_deg = ATAN2_APPROX_MAX_ERROR_RAD * RAD_TO_DEG + 1e-3f;
+
+  for (int res : {ALPHA_RES_FINE, ALPHA_RES, 2 * ALPHA_RES, ALPHA_RES_COARSE}) {
+    // WHEN: we bin the points in batches
+    PointBinBatch batch;
+    int n_total = 0;
+    for (size_t i = 0; i < cloud.points.size(); i += PointBinBatch::SIZE) {
+      int n = binPointBatch(cloud, i, position, res, batch);
+      ASSERT_EQ(std::min<size_t>(PointBinBatch::SIZE, cloud.size() - i), n);
+      n_total += n;
+
+      for (int k = 0; k < n; k++) {
+        // THEN: every point should be in the bin of the exact computation,
+        // unless it is closer to a bin edge than the approximation error
+        PolarPoint p_pol = cartesianToPolar(toEigen(cloud[i + k]), position);
+        Eigen::Vector2i p_ind = polarToHistogramIndex(p_pol, res);
+        EXPECT_NEAR((toEigen(cloud[i + k]) - position).norm(),
+                    batch.distance[k], 1e-5f);
+        if (p_ind.y() != batch.e_index[k]) {
+          float e = (p_pol.e + 90.f) / res;
+          EXPECT_LT(std::abs(e - std::round(e)) * res, max_error_deg);
+        }
+        if (p_ind.x() != batch.z_index[k]) {
+          float z = (p_pol.z + 180.f) / res;
+          EXPECT_LT(std::abs(z - std::round(z)) * res, max_error_deg);
+        }
+      }
+    }
+    EXPECT_EQ(static_cast<int>(cloud.size()), n_total);
+  }
+  PointBinBatch batch;
+  EXPECT_EQ(0, binPointBatch(cloud, cloud.size(), position, ALPHA_RES, batch));
+}
+
 TEST(PlannerFunctions, calculateFOV) {
   // GIVEN: the horizontal and vertical Field of View, the vehicle yaw and pitc
   float h_fov = 90.0f;
@@ -148,6 +197,337 @@ TEST(PlannerFunctions, calculateFOV) {
   }
 }
 
+TEST(PlannerFunctions, calculateFOVMask) {
+  // GIVEN: the Field of View of a wrapped and a not wrapped azimuth range
+  float h_fov = 90.0f;
+  float v_fov = 45.0f;
+  float pitch = 0.0f;
+
+  for (float yaw : {270.f, 210.f, -140.f, -235.f, 0.f}) {
+    // WHEN: we calculate the Field of View as index list and as bitmask
+    std::vector<int> z_FOV_idx;
+    FOVMask z_FOV_mask;
+    z_FOV_mask.set();
+    int e_FOV_min, e_FOV_max, e_FOV_min_mask, e_FOV_max_mask;
+    calculateFOV(h_fov, v_fov, z_FOV_idx, e_FOV_min, e_FOV_max, yaw, pitch);
+    calculateFOV(h_fov, v_fov, z_FOV_mask, e_FOV_min_mask, e_FOV_max_mask, yaw,
+                 pitch);
+
+    // THEN: exactly the azimuth indices of the list should be set
+    EXPECT_EQ(e_FOV_min, e_FOV_min_mask);
+    EXPECT_EQ(e_FOV_max, e_FOV_max_mask);
+    EXPECT_EQ(z_FOV_idx.size(), z_FOV_mask.count());
+    for (int z : z_FOV_idx) {
+      EXPECT_TRUE(z_FOV_mask[z]);
+    }
+  }
+}
+
+// histogram with random distance and age in a third of the bins
+template <int RES>
+void fillRandomHistogram(PolarHistogram<RES>& histogram) {
+  for (int e = 0; e < PolarHistogram<RES>::E_DIM; e++) {
+    for (int z = 0; z < PolarHistogram<RES>::Z_DIM; z++) {
+      if (std::rand() % 3 == 0) {
+        histogram.set_dist(e, z, 1.f + 7.f * std::rand() / RAND_MAX);
+        histogram.set_age(e, z, std::rand() % 15);
+      } else {
+        histogram.set_dist(e, z, 0.f);
+        histogram.set_age(e, z, 0);
+      }
+    }
+  }
+}
+
+template <int RES>
+void expectPropagatedHistogramMatchesReprojectedPoints() {
+  std::srand(RES);
+  PolarHistogram<RES> previous_histogram;
+  fillRandomHistogram(previous_histogram);
+  Eigen::Vector3f previous_position(1.f, -2.f, 3.f);
+  Eigen::Vector3f position(1.5f, -1.f, 3.2f);
+  const float max_dist = 12.f;
+  const int max_age = 10;
+
+  // reference: bin the reprojected points at half resolution
+  pcl::PointCloud<pcl::PointXYZ> reprojected_points;
+  std::vector<int> reprojected_points_age;
+  reprojectHistogram(reprojected_points, reprojected_points_age,
+                     previous_histogram, previous_position, position, max_dist,
+                     max_age);
+  ASSERT_GT(reprojected_points.size(), 0u);
+  PolarHistogram<2 * RES> sums;
+  Eigen::MatrixXi counter = Eigen::MatrixXi::Zero(
+      PolarHistogram<2 * RES>::E_DIM, PolarHistogram<2 * RES>::Z_DIM);
+  PointBinBatch batch;
+  for (size_t i = 0; i < reprojected_points.size(); i += PointBinBatch::SIZE) {
+    int n = binPointBatch(reprojected_points, i, position, 2 * RES, batch);
+    for (int k = 0; k < n; k++) {
+      const int e = batch.e_index[k];
+      const int z = batch.z_index[k];
+      counter(e, z) += 1;
+      sums.set_age(e, z, sums.age(e, z) + reprojected_points_age[i + k]);
+      sums.set_dist(e, z, sums.dist(e, z) + batch.distance[k]);
+    }
+  }
+
+  // WHEN: we warp the previous histogram to the current position
+  PolarHistogram<RES> propagated_histogram;
+  propagateHistogram(propagated_histogram, previous_histogram,
+                     previous_position, position, max_dist, max_age);
+
+  // THEN: cells with at least 6 points should hold their mean age and
+  // distance, all others should be empty
+  int n_occupied = 0;
+  for (int e = 0; e < PolarHistogram<RES>::E_DIM; e++) {
+    for (int z = 0; z < PolarHistogram<RES>::Z_DIM; z++) {
+      const int n = counter(e / 2, z / 2);
+      if (n >= 6) {
+        EXPECT_EQ(sums.dist(e / 2, z / 2) / n, propagated_histogram.dist(e, z));
+        EXPECT_EQ(sums.age(e / 2, z / 2) / n, propagated_histogram.age(e, z));
+        n_occupied++;
+      } else {
+        EXPECT_EQ(0.f, propagated_histogram.dist(e, z));
+        EXPECT_EQ(0, propagated_histogram.age(e, z));
+      }
+    }
+  }
+  EXPECT_GT(n_occupied, 0);
+}
+
+TEST(PlannerFunctions, propagateHistogramMatchesReprojectedPoints) {
+  // GIVEN: the histogram of the previous iteration and a new position
+  // WHEN: we warp it to the new position
+  // THEN: it should match binning the reprojected bin corners
+  expectPropagatedHistogramMatchesReprojectedPoints<ALPHA_RES_FINE>();
+  expectPropagatedHistogramMatchesReprojectedPoints<ALPHA_RES>();
+  expectPropagatedHistogramMatchesReprojectedPoints<ALPHA_RES_COARSE>();
+}
+
+template <int RES>
+void expectCombinedHistogramMatchesSeparateSteps(bool waypoint_outside_FOV) {
+  std::srand(RES);
+  Eigen::Vector3f previous_position(1.f, -2.f, 3.f);
+  Eigen::Vector3f position(1.5f, -1.f, 3.2f);
+  const float max_dist = 12.f;
+  const int max_age = 10;
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  for (int i = 0; i < 2001; i++) {
+    cloud.push_back(pcl::PointXYZ(position.x() + randomFloat(-8.f, 8.f),
+                                  position.y() + randomFloat(0.f, 8.f),
+                                  position.z() + randomFloat(-3.f, 3.f)));
+  }
+  PolarHistogram<RES> previous_histogram;
+  fillRandomHistogram(previous_histogram);
+  int e_FOV_min, e_FOV_max;
+  std::vector<int> z_FOV_idx;
+  FOVMask z_FOV_mask;
+  calculateFOV<RES>(90.f, 45.f, z_FOV_idx, e_FOV_min, e_FOV_max, 30.f, 0.f);
+  calculateFOV<RES>(90.f, 45.f, z_FOV_mask, e_FOV_min, e_FOV_max, 30.f, 0.f);
+
+  PolarHistogram<RES> propagated_histogram, expected_histogram;
+  bool expected_hist_empty;
+  propagateHistogram(propagated_histogram, previous_histogram,
+                     previous_position, position, max_dist, max_age);
+  generateNewHistogram(expected_histogram, cloud, position);
+  combinedHistogram(expected_hist_empty, expected_histogram,
+                    propagated_histogram, waypoint_outside_FOV, z_FOV_idx,
+                    e_FOV_min, e_FOV_max);
+
+  // the histogram is rebuilt in place from the previous one
+  PolarHistogram<RES> histogram = previous_histogram;
+  bool hist_empty = true;
+  generateCombinedHistogram(histogram, hist_empty, cloud, histogram,
+                            previous_position, position, max_dist, max_age,
+                            waypoint_outside_FOV, z_FOV_mask, e_FOV_min,
+                            e_FOV_max);
+
+  EXPECT_EQ(expected_hist_empty, hist_empty);
+  int n_occupied = 0;
+  for (int e = 0; e < PolarHistogram<RES>::E_DIM; e++) {
+    for (int z = 0; z < PolarHistogram<RES>::Z_DIM; z++) {
+      EXPECT_EQ(expected_histogram.dist(e, z), histogram.dist(e, z));
+      EXPECT_EQ(expected_histogram.age(e, z), histogram.age(e, z));
+      if (histogram.dist(e, z) > 0.f) n_occupied++;
+    }
+  }
+  EXPECT_GT(n_occupied, 0);
+}
+
+TEST(PlannerFunctions, generateCombinedHistogramMatchesSeparateSteps) {
+  // GIVEN: a current frame cloud and the histogram of the previous iteration
+  // WHEN: we build the combined histogram in a single sweep
+  // THEN: it should be identical to the one of the separate steps
+  expectCombinedHistogramMatchesSeparateSteps<ALPHA_RES_FINE>(false);
+  expectCombinedHistogramMatchesSeparateSteps<ALPHA_RES>(false);
+  expectCombinedHistogramMatchesSeparateSteps<ALPHA_RES>(true);
+  expectCombinedHistogramMatchesSeparateSteps<ALPHA_RES_COARSE>(false);
+}
+
+TEST(PlannerFunctions, updateHistogramSlices) {
+  // GIVEN: the histogram of the previous iteration, a cloud with points all
+  // around and the slice of the only camera with a new cloud
+  std::srand(ALPHA_RES);
+  const Eigen::Vector3f previous_position(1.f, -2.f, 3.f);
+  const Eigen::Vector3f position(1.2f, -1.8f, 3.f);
+  Histogram previous_histogram;
+  fillRandomHistogram(previous_histogram);
+  pcl::PointCloud<pcl::PointXYZ> cloud, slice_cloud;
+  FOVMask z_slice_mask;
+  int e_slice_min, e_slice_max;
+  calculateFOV<ALPHA_RES>(60.f, 45.f, z_slice_mask, e_slice_min, e_slice_max,
+                          -30.f, 0.f);
+  for (int e = 0; e < GRID_LENGTH_E; e++) {
+    for (int z = 0; z < GRID_LENGTH_Z; z++) {
+      if (std::rand() % 3 > 0) continue;
+      PolarPoint p_pol =
+          histogramIndexToPolar(e, z, ALPHA_RES, randomFloat(1.f, 8.f));
+      const pcl::PointXYZ point = toXYZ(polarToCartesian(p_pol, position));
+      cloud.push_back(point);
+      if (z_slice_mask[z] && e > e_slice_min && e < e_slice_max) {
+        slice_cloud.push_back(point);
+      }
+    }
+  }
+
+  // WHEN: we update the slice of the camera, and when we build the combined
+  // histogram from the points inside the slice only
+  Histogram histogram, expected_histogram;
+  bool hist_empty, expected_hist_empty;
+  updateHistogramSlices(histogram, hist_empty, cloud, previous_histogram,
+                        previous_position, position, 12.f, 10, false,
+                        z_slice_mask, e_slice_min, e_slice_max);
+  generateCombinedHistogram(expected_histogram, expected_hist_empty,
+                            slice_cloud, previous_histogram, previous_position,
+                            position, 12.f, 10, false, z_slice_mask,
+                            e_slice_min, e_slice_max);
+
+  // THEN: the points outside the slice should be left out, the histogram
+  // there should be the one of the previous iteration
+  EXPECT_LT(slice_cloud.size(), cloud.size());
+  EXPECT_EQ(expected_hist_empty, hist_empty);
+  for (int e = 0; e < GRID_LENGTH_E; e++) {
+    for (int z = 0; z < GRID_LENGTH_Z; z++) {
+      EXPECT_FLOAT_EQ(expected_histogram.dist(e, z), histogram.dist(e, z));
+      EXPECT_EQ(expected_histogram.age(e, z), histogram.age(e, z));
+    }
+  }
+}
+
+TEST(PlannerFunctions, buildObstacleIndex) {
+  // GIVEN: a cloud with two clusters of points in different voxels
+  const Eigen::Vector3f origin(1.f, 2.f, 3.f);
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  cloud.push_back(toXYZ(origin + Eigen::Vector3f(0.01f, 0.01f, 0.01f)));
+  cloud.push_back(toXYZ(origin + Eigen::Vector3f(0.03f, 0.05f, 0.07f)));
+  cloud.push_back(toXYZ(origin + Eigen::Vector3f(2.05f, -1.05f, 0.05f)));
+  cloud.push_back(toXYZ(origin + Eigen::Vector3f(0.02f, 0.03f, 0.04f)));
+
+  // WHEN: we build the index with 10 cm voxels
+  ObstacleIndex index;
+  buildObstacleIndex(cloud, origin, 0.1f, index);
+
+  // THEN: every occupied voxel should hold the centroid and the number of its
+  // points, up to the rounding of the float coordinate sums
+  ASSERT_EQ(2, index.centroids.size());
+  ASSERT_EQ(2, index.weights.size());
+  EXPECT_EQ(3, index.weights[0]);
+  EXPECT_EQ(1, index.weights[1]);
+  EXPECT_NEAR(origin.x() + 0.02f, index.centroids.points[0].x, 1e-5f);
+  EXPECT_NEAR(origin.y() + 0.03f, index.centroids.points[0].y, 1e-5f);
+  EXPECT_NEAR(origin.z() + 0.04f, index.centroids.points[0].z, 1e-5f);
+  EXPECT_FLOAT_EQ(cloud.points[2].x, index.centroids.points[1].x);
+
+  // WHEN: we rebuild the index from an empty cloud
+  buildObstacleIndex(pcl::PointCloud<pcl::PointXYZ>(), origin, 0.1f, index);
+
+  // THEN: it should be empty
+  EXPECT_EQ(0, index.centroids.size());
+  EXPECT_TRUE(index.weights.empty());
+}
+
+TEST(PlannerFunctions, generateCombinedHistogramFromObstacleIndex) {
+  // GIVEN: a dense cloud of a wall and the index built from it
+  const Eigen::Vector3f origin(0.f, 0.f, 5.f);
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  for (float x = -4.f; x <= 4.f; x += 0.02f) {
+    for (float z = 3.f; z <= 7.f; z += 0.02f) {
+      cloud.push_back(pcl::PointXYZ(x, 5.f, z));
+    }
+  }
+  ObstacleIndex index;
+  buildObstacleIndex(cloud, origin, 0.1f, index);
+  EXPECT_LT(index.centroids.size(), cloud.size() / 10);
+
+  // WHEN: we build the histogram of a tree node from the cloud and from the
+  // index
+  const Eigen::Vector3f node_position(0.5f, 1.f, 5.f);
+  int e_FOV_min, e_FOV_max;
+  FOVMask z_FOV_mask;
+  calculateFOV<ALPHA_RES>(90.f, 45.f, z_FOV_mask, e_FOV_min, e_FOV_max, 30.f,
+                          0.f);
+  PolarHistogram<ALPHA_RES> empty_memory, from_cloud, from_index;
+  bool cloud_hist_empty, index_hist_empty;
+  generateCombinedHistogram(from_cloud, cloud_hist_empty, cloud, empty_memory,
+                            origin, node_position, 15.f, 10, false, z_FOV_mask,
+                            e_FOV_min, e_FOV_max);
+  generateCombinedHistogram(from_index, index_hist_empty, index, empty_memory,
+                            origin, node_position, 15.f, 10, false, z_FOV_mask,
+                            e_FOV_min, e_FOV_max);
+
+  // THEN: the same bins should be occupied, apart from single bins at the
+  // edges of the wall. The bin distances are only approximated: a centroid is
+  // closer than the mean of its points and a voxel on a bin border moves all
+  // of its points into one bin. Both shift the bin mean by less than the
+  // voxel size, here by about 3 cm at most
+  EXPECT_FALSE(cloud_hist_empty);
+  EXPECT_FALSE(index_hist_empty);
+  int n_occupied = 0, n_mismatch = 0;
+  for (int e = 0; e < PolarHistogram<ALPHA_RES>::E_DIM; e++) {
+    for (int z = 0; z < PolarHistogram<ALPHA_RES>::Z_DIM; z++) {
+      const bool cloud_occupied = from_cloud.dist(e, z) > 0.f;
+      const bool index_occupied = from_index.dist(e, z) > 0.f;
+      if (cloud_occupied) n_occupied++;
+      if (cloud_occupied != index_occupied) {
+        n_mismatch++;
+      } else if (cloud_occupied) {
+        EXPECT_NEAR(from_cloud.dist(e, z), from_index.dist(e, z), 0.1f);
+      }
+    }
+  }
+  EXPECT_GT(n_occupied, 100);
+  EXPECT_LT(n_mismatch, n_occupied / 10);
+
+  // WHEN: the range of the obstacle memory ends before the wall
+  generateCombinedHistogram(from_cloud, cloud_hist_empty, cloud, empty_memory,
+                            origin, node_position, 3.f, 10, false, z_FOV_mask,
+                            e_FOV_min, e_FOV_max);
+  generateCombinedHistogram(from_index, index_hist_empty, index, empty_memory,
+                            origin, node_position, 3.f, 10, false, z_FOV_mask,
+                            e_FOV_min, e_FOV_max);
+
+  // THEN: the index should leave the voxels out, unlike the cloud
+  EXPECT_FALSE(cloud_hist_empty);
+  EXPECT_TRUE(index_hist_empty);
+}
+
+TEST(PlannerFunctions, isSegmentClear) {
+  // GIVEN: a segment and obstacles beside it and beyond its end
+  const Eigen::Vector3f start(1.f, 1.f, 2.f);
+  const Eigen::Vector3f end(1.f, 3.f, 2.f);
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  cloud.push_back(pcl::PointXYZ(1.6f, 2.f, 2.f));
+  cloud.push_back(pcl::PointXYZ(1.f, 3.7f, 2.f));
+
+  // WHEN: we check the segment for different clearances
+  // THEN: it should be clear as long as every obstacle is farther away
+  EXPECT_TRUE(isSegmentClear(cloud, start, end, 0.5f));
+  EXPECT_FALSE(isSegmentClear(cloud, start, end, 0.65f));
+  EXPECT_FALSE(isSegmentClear(cloud, end, end, 0.75f));
+  EXPECT_TRUE(isSegmentClear(pcl::PointCloud<pcl::PointXYZ>(), start, end,
+                             10.f));
+}
+
 TEST(PlannerFunctionsTests, filterPointCloud) {
   // GIVEN: two point clouds
   const Eigen::Vector3f position(1.5f, 1.0f, 4.5f);
@@ -209,6 +589,276 @@ TEST(PlannerFunctionsTests, filterPointCloud) {
   EXPECT_EQ(0, cropped_cloud2.points.size());
 }
 
+TEST(PlannerFunctionsTests, filterPointCloudMatchesSequentialFilter) {
+  // GIVEN: two random clouds whose sizes are not multiples of the vector
+  // width, containing NaN points, duplicated points and points on the limits
+  std::srand(42);
+  Eigen::Vector3f position(1.f, -2.f, 3.f);
+  Box histogram_box(5.f);
+  histogram_box.setBoxLimits(position, 4.f);
+  const float min_dist_backoff = 1.5f;
+  const float min_realsense_dist = 0.3f;
+
+  std::vector<pcl::PointCloud<pcl::PointXYZ>> complete_cloud(2);
+  complete_cloud[0].header.frame_id = "/local_origin";
+  for (int c = 0; c < 2; c++) {
+    for (int i = 0; i < 1001 + 2 * c; i++) {
+      complete_cloud[c].push_back(
+          pcl::PointXYZ(position.x() + randomFloat(-7.f, 7.f),
+                        position.y() + randomFloat(-7.f, 7.f),
+                        position.z() + randomFloat(-7.f, 7.f)));
+    }
+    complete_cloud[c].points[10 + c] = pcl::PointXYZ(NAN, 1.f, 1.f);
+    complete_cloud[c].points[20 + c] = pcl::PointXYZ(NAN, NAN, NAN);
+    complete_cloud[c].points[30 + c] =
+        pcl::PointXYZ(position.x() + 5.f, position.y(), position.z());
+  }
+  // the same closest point twice, the first one is expected to be returned
+  complete_cloud[0].points[6] =
+      pcl::PointXYZ(position.x() + 0.4f, position.y(), position.z());
+  complete_cloud[1].points[1] = complete_cloud[0].points[6];
+
+  // WHEN: we filter the clouds and run the sequential reference filter
+  pcl::PointCloud<pcl::PointXYZ> cropped_cloud;
+  Eigen::Vector3f closest_point;
+  float distance_to_closest_point;
+  int counter_backoff;
+  filterPointCloud(cropped_cloud, closest_point, distance_to_closest_point,
+                   counter_backoff, complete_cloud, 0, min_dist_backoff,
+                   histogram_box, position, min_realsense_dist);
+
+  std::vector<Eigen::Vector3f> expected_points;
+  Eigen::Vector3f expected_closest_point;
+  float expected_distance = HUGE_VAL;
+  int expected_backoff = 0;
+  for (const auto& cloud : complete_cloud) {
+    for (const pcl::PointXYZ& xyz : cloud) {
+      if (std::isnan(xyz.x) || std::isnan(xyz.y) || std::isnan(xyz.z) ||
+          !histogram_box.isPointWithinBox(xyz.x, xyz.y, xyz.z)) {
+        continue;
+      }
+      float distance = (position - toEigen(xyz)).norm();
+      if (distance > min_realsense_dist && distance < histogram_box.radius_) {
+        expected_points.push_back(toEigen(xyz));
+        if (distance < expected_distance) {
+          expected_distance = distance;
+          expected_closest_point = toEigen(xyz);
+        }
+        if (distance < min_dist_backoff) expected_backoff++;
+      }
+    }
+  }
+
+  // THEN: the result should be identical to the sequential filter, including
+  // the order of the points
+  ASSERT_EQ(expected_points.size(), cropped_cloud.points.size());
+  EXPECT_EQ(expected_points.size(), cropped_cloud.width);
+  EXPECT_EQ("/local_origin", cropped_cloud.header.frame_id);
+  for (size_t i = 0; i < expected_points.size(); i++) {
+    EXPECT_EQ(expected_points[i], toEigen(cropped_cloud.points[i]));
+  }
+  EXPECT_EQ(expected_backoff, counter_backoff);
+  EXPECT_FLOAT_EQ(expected_distance, distance_to_closest_point);
+  EXPECT_EQ(expected_closest_point, closest_point);
+}
+
+TEST(PlannerFunctions, downsamplePointCloud) {
+  // GIVEN: a cloud with a cluster of points close to the vehicle, two points
+  // close to each other at 1m and two points at the same spacing at 10m
+  Eigen::Vector3f position(0.f, 0.f, 0.f);
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  cloud.push_back(pcl::PointXYZ(0.59f, 0.05f, 0.05f));
+  cloud.push_back(pcl::PointXYZ(0.55f, 0.01f, 0.01f));
+  cloud.push_back(pcl::PointXYZ(0.57f, 0.08f, 0.02f));
+  cloud.push_back(pcl::PointXYZ(1.05f, 0.05f, 0.05f));
+  cloud.push_back(pcl::PointXYZ(1.05f, 0.35f, 0.05f));
+  cloud.push_back(pcl::PointXYZ(10.1f, 0.4f, 0.1f));
+  cloud.push_back(pcl::PointXYZ(10.1f, 0.1f, 0.1f));
+
+  // WHEN: we downsample it with a voxel size which grows with distance
+  downsamplePointCloud(cloud, position, 0.1f, 0.1f, 0);
+
+  // THEN: each cluster should be represented by the point closest to the
+  // vehicle, only the points at 1m should be kept separately
+  ASSERT_EQ(4, cloud.points.size());
+  EXPECT_EQ(4, cloud.width);
+  EXPECT_EQ(Eigen::Vector3f(0.55f, 0.01f, 0.01f), toEigen(cloud.points[0]));
+  EXPECT_EQ(Eigen::Vector3f(1.05f, 0.05f, 0.05f), toEigen(cloud.points[1]));
+  EXPECT_EQ(Eigen::Vector3f(1.05f, 0.35f, 0.05f), toEigen(cloud.points[2]));
+  EXPECT_EQ(Eigen::Vector3f(10.1f, 0.1f, 0.1f), toEigen(cloud.points[3]));
+
+  // GIVEN: a dense cloud
+  cloud.clear();
+  for (float x = 1.f; x < 3.f; x += 0.02f) {
+    for (float y = -1.f; y < 1.f; y += 0.02f) {
+      cloud.push_back(pcl::PointXYZ(x, y, 0.5f));
+    }
+  }
+
+  // WHEN: we downsample it with a point budget
+  downsamplePointCloud(cloud, position, 0.05f, 0.f, 300);
+
+  // THEN: the cloud should not exceed the budget but still cover the area
+  EXPECT_LE(cloud.points.size(), 300);
+  EXPECT_GT(cloud.points.size(), 50);
+}
+
+TEST(PlannerFunctions, transformPointCloudMsg) {
+  // GIVEN: a pointcloud message with padding between the points, a NaN point
+  // and a transformation to the target frame
+  std::vector<Eigen::Vector3f> points = {Eigen::Vector3f(1.f, 2.f, 3.f),
+                                         Eigen::Vector3f(NAN, NAN, NAN),
+                                         Eigen::Vector3f(-4.f, 0.5f, 2.f),
+                                         Eigen::Vector3f(0.f, 0.f, 7.f)};
+  sensor_msgs::PointCloud2 msg;
+  msg.header.frame_id = "camera_link";
+  msg.height = 2;
+  msg.width = 2;
+  msg.point_step = 16;
+  msg.row_step = msg.width * msg.point_step;
+  const std::vector<std::string> names = {"x", "y", "z"};
+  for (size_t i = 0; i < names.size(); i++) {
+    sensor_msgs::PointField field;
+    field.name = names[i];
+    field.offset = 4 * i;
+    field.datatype = sensor_msgs::PointField::FLOAT32;
+    field.count = 1;
+    msg.fields.push_back(field);
+  }
+  msg.data.resize(msg.row_step * msg.height, 0);
+  for (size_t i = 0; i < points.size(); i++) {
+    std::memcpy(&msg.data[i * msg.point_step], points[i].data(),
+                3 * sizeof(float));
+  }
+
+  Eigen::Affine3f transform = Eigen::Affine3f::Identity();
+  transform.rotate(Eigen::AngleAxisf(M_PI_F / 2.f, Eigen::Vector3f::UnitZ()));
+  transform.pretranslate(Eigen::Vector3f(10.f, 0.f, -1.f));
+
+  // WHEN: we convert the message into a buffer which already contains points
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  for (int i = 0; i < 10; i++) {
+    cloud.push_back(pcl::PointXYZ(1.f, 1.f, 1.f));
+  }
+  bool success =
+      transformPointCloudMsg(cloud, msg, transform, "/local_origin");
+
+  // THEN: the buffer should only contain the valid points transformed into the
+  // target frame
+  ASSERT_TRUE(success);
+  ASSERT_EQ(3, cloud.points.size());
+  EXPECT_EQ(3, cloud.width);
+  EXPECT_EQ("/local_origin", cloud.header.frame_id);
+  int i = 0;
+  for (const Eigen::Vector3f& p : points) {
+    if (std::isnan(p.x())) continue;
+    Eigen::Vector3f expected = transform * p;
+    EXPECT_NEAR(expected.x(), cloud.points[i].x, 1e-5);
+    EXPECT_NEAR(expected.y(), cloud.points[i].y, 1e-5);
+    EXPECT_NEAR(expected.z(), cloud.points[i].z, 1e-5);
+    i++;
+  }
+
+  // WHEN: the message is truncated, or its layout doesn't fit its fields
+  sensor_msgs::PointCloud2 truncated = msg;
+  truncated.data.resize(truncated.data.size() - 1);
+  sensor_msgs::PointCloud2 short_rows = msg;
+  short_rows.row_step = short_rows.width * short_rows.point_step - 1;
+  sensor_msgs::PointCloud2 short_points = msg;
+  short_points.point_step = 10;
+  short_points.row_step = short_points.width * short_points.point_step;
+
+  // THEN: the conversion should fail without reading past the data
+  for (const sensor_msgs::PointCloud2& malformed :
+       {truncated, short_rows, short_points}) {
+    cloud.push_back(pcl::PointXYZ(1.f, 1.f, 1.f));
+    EXPECT_FALSE(
+        transformPointCloudMsg(cloud, malformed, transform, "/local_origin"));
+    EXPECT_EQ(0, cloud.points.size());
+  }
+
+  // WHEN: the message does not contain a z field
+  msg.fields.pop_back();
+  success = transformPointCloudMsg(cloud, msg, transform, "/local_origin");
+
+  // THEN: the conversion should fail and the buffer should be empty
+  EXPECT_FALSE(success);
+  EXPECT_EQ(0, cloud.points.size());
+}
+
+TEST(PlannerFunctions, depthImageToPointCloud) {
+  // GIVEN: the intrinsics of a 6x4 pixel camera and a depth image with some
+  // pixels without measurement
+  sensor_msgs::CameraInfo camera_info;
+  camera_info.width = 6;
+  camera_info.height = 4;
+  camera_info.K = {{2.0, 0.0, 3.0, 0.0, 4.0, 2.0, 0.0, 0.0, 1.0}};
+  const int stride = 2;
+
+  sensor_msgs::Image image;
+  image.width = 6;
+  image.height = 4;
+  image.encoding = sensor_msgs::image_encodings::TYPE_16UC1;
+  image.step = image.width * sizeof(uint16_t);
+  std::vector<uint16_t> depth_mm = {1000, 0, 2000, 0, 0,    0,  //
+                                    0,    0, 0,    0, 0,    0,  //
+                                    500,  0, 0,    0, 3000, 0,  //
+                                    0,    0, 0,    0, 0,    0};
+  image.data.resize(depth_mm.size() * sizeof(uint16_t));
+  std::memcpy(image.data.data(), depth_mm.data(), image.data.size());
+
+  Eigen::Affine3f transform = Eigen::Affine3f::Identity();
+  transform.rotate(Eigen::AngleAxisf(M_PI_F / 2.f, Eigen::Vector3f::UnitX()));
+  transform.pretranslate(Eigen::Vector3f(1.f, 2.f, 3.f));
+
+  // WHEN: we compute the pixel rays and project the image
+  std::vector<Eigen::Vector3f> pixel_rays;
+  computePixelRays(pixel_rays, camera_info, stride);
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  bool success = depthImageToPointCloud(cloud, image, pixel_rays, stride,
+                                        transform, "/local_origin");
+
+  // THEN: only the sampled pixels with a valid depth should be projected
+  // along their rays, and the result should be transformed
+  ASSERT_EQ(3 * 2, pixel_rays.size());
+  EXPECT_TRUE(pixel_rays[0].isApprox(Eigen::Vector3f(-1.5f, -0.5f, 1.f)));
+  ASSERT_TRUE(success);
+  ASSERT_EQ(4, cloud.points.size());
+  EXPECT_EQ("/local_origin", cloud.header.frame_id);
+  std::vector<Eigen::Vector3f> expected = {
+      1.0f * Eigen::Vector3f(-1.5f, -0.5f, 1.f),
+      2.0f * Eigen::Vector3f(-0.5f, -0.5f, 1.f),
+      0.5f * Eigen::Vector3f(-1.5f, 0.f, 1.f),
+      3.0f * Eigen::Vector3f(0.5f, 0.f, 1.f)};
+  for (size_t i = 0; i < expected.size(); i++) {
+    EXPECT_TRUE(toEigen(cloud.points[i]).isApprox(transform * expected[i]))
+        << "point " << i;
+  }
+
+  // WHEN: the image is truncated or its rows are shorter than its width
+  sensor_msgs::Image truncated = image;
+  truncated.data.resize(truncated.data.size() - 1);
+  sensor_msgs::Image short_rows = image;
+  short_rows.step = short_rows.width * sizeof(uint16_t) - 1;
+
+  // THEN: the conversion should fail without reading past the data
+  for (const sensor_msgs::Image& malformed : {truncated, short_rows}) {
+    cloud.push_back(pcl::PointXYZ(1.f, 1.f, 1.f));
+    EXPECT_FALSE(depthImageToPointCloud(cloud, malformed, pixel_rays, stride,
+                                        transform, "/local_origin"));
+    EXPECT_EQ(0, cloud.points.size());
+  }
+
+  // WHEN: the image has a different size than the camera info
+  image.width = 8;
+  success = depthImageToPointCloud(cloud, image, pixel_rays, stride, transform,
+                                   "/local_origin");
+
+  // THEN: the conversion should fail
+  EXPECT_FALSE(success);
+  EXPECT_EQ(0, cloud.points.size());
+}
+
 TEST(PlannerFunctions, testDirectionTree) {
   // GIVEN: the node positions in a tree and some possible vehicle positions
   float n1_x = 0.8f;
@@ -382,6 +1032,56 @@ TEST(PlannerFunctions, getBestCandidatesFromCostMatrix) {
   EXPECT_FLOAT_EQ(4.7, candidate_vector[3].cost);
 }
 
+TEST(PlannerFunctions, getBestCandidatesFromCostMatrixSelection) {
+  // GIVEN: a random cost matrix
+  std::srand(3);
+  Eigen::MatrixXf matrix =
+      Eigen::MatrixXf::Random(GRID_LENGTH_E, GRID_LENGTH_Z).cwiseAbs();
+  const unsigned int n_candidates = 20;
+
+  // WHEN: we select the cheapest candidates with and without a minimal
+  // separation
+  std::vector<candidateDirection> candidates, separated_candidates;
+  CandidateSelectionBuffers buffers;
+  getBestCandidatesFromCostMatrix<ALPHA_RES>(matrix, n_candidates, 0.f,
+                                             candidates, buffers);
+  const float min_separation_deg = 15.f;
+  getBestCandidatesFromCostMatrix<ALPHA_RES>(
+      matrix, n_candidates, min_separation_deg, separated_candidates, buffers);
+
+  // THEN: the candidates should be the cheapest cells in increasing order
+  std::vector<float> costs(matrix.data(), matrix.data() + matrix.size());
+  std::sort(costs.begin(), costs.end());
+  ASSERT_EQ(n_candidates, candidates.size());
+  for (size_t i = 0; i < candidates.size(); i++) {
+    EXPECT_FLOAT_EQ(costs[i], candidates[i].cost);
+    PolarPoint p_pol(candidates[i].elevation_angle,
+                     candidates[i].azimuth_angle, 1.f);
+    Eigen::Vector2i index = polarToHistogramIndex(p_pol, ALPHA_RES);
+    EXPECT_FLOAT_EQ(matrix(index.y(), index.x()), candidates[i].cost);
+  }
+
+  // and the separated candidates should start with the cheapest cell, be
+  // sorted and at least the separation apart
+  ASSERT_EQ(n_candidates, separated_candidates.size());
+  EXPECT_FLOAT_EQ(costs[0], separated_candidates[0].cost);
+  for (size_t i = 0; i < separated_candidates.size(); i++) {
+    const candidateDirection& c_i = separated_candidates[i];
+    Eigen::Vector3f direction_i = polarToCartesian(
+        PolarPoint(c_i.elevation_angle, c_i.azimuth_angle, 1.f),
+        Eigen::Vector3f::Zero());
+    for (size_t j = 0; j < i; j++) {
+      const candidateDirection& c_j = separated_candidates[j];
+      EXPECT_LE(c_j.cost, c_i.cost);
+      Eigen::Vector3f direction_j = polarToCartesian(
+          PolarPoint(c_j.elevation_angle, c_j.azimuth_angle, 1.f),
+          Eigen::Vector3f::Zero());
+      EXPECT_LE(direction_i.dot(direction_j),
+                std::cos(min_separation_deg * DEG_TO_RAD) + 1e-5f);
+    }
+  }
+}
+
 TEST(PlannerFunctions, smoothPolarMatrix) {
   // GIVEN: a smoothing radius and a known cost matrix with one costly cell,
   // otherwise all zeros.
@@ -446,6 +1146,46 @@ TEST(PlannerFunctions, smoothMatrix) {
   EXPECT_LT((expected_matrix - matrix).cwiseAbs().maxCoeff(), 1e-5);
 }
 
+TEST(PlannerFunctions, smoothPolarMatrixMatchesConicKernel) {
+  // GIVEN: random matrices of two sizes
+  std::srand(7);
+  for (int rows : {10, 60}) {
+    Eigen::MatrixXf matrix = Eigen::MatrixXf::Random(rows, 2 * rows) * 100.f;
+    for (unsigned int radius : {0u, 1u, 4u, 10u}) {
+      // WHEN: we smooth it with the running sums and with the conic kernel
+      // applied to the padded matrix
+      Eigen::MatrixXf smoothed = matrix;
+      smoothPolarMatrix(smoothed, radius);
+
+      const int r = static_cast<int>(radius);
+      Eigen::ArrayXf kernel = getConicKernel(r);
+      Eigen::MatrixXf matrix_padded;
+      padPolarMatrix(matrix, radius, matrix_padded);
+      Eigen::MatrixXf elevation_smoothed(matrix.rows(), matrix.cols() + 2 * r);
+      for (int e = 0; e < matrix.rows(); e++) {
+        for (int z = 0; z < elevation_smoothed.cols(); z++) {
+          elevation_smoothed(e, z) =
+              (matrix_padded.block(e, z, 2 * r + 1, 1).array() * kernel).sum();
+        }
+      }
+      Eigen::MatrixXf expected(matrix.rows(), matrix.cols());
+      for (int e = 0; e < matrix.rows(); e++) {
+        for (int z = 0; z < matrix.cols(); z++) {
+          expected(e, z) = (elevation_smoothed.block(e, z, 1, 2 * r + 1)
+                                .array()
+                                .transpose() *
+                            kernel)
+                               .sum();
+        }
+      }
+
+      // THEN: both should match
+      EXPECT_LT((expected - smoothed).cwiseAbs().maxCoeff(), 1e-3)
+          << "rows " << rows << " radius " << radius;
+    }
+  }
+}
+
 TEST(PlannerFunctions, getCostMatrixNoObstacles) {
   // GIVEN: a position, goal and an empty histogram
   Eigen::Vector3f position(0.f, 0.f, 0.f);
@@ -458,7 +1198,7 @@ TEST(PlannerFunctions, getCostMatrixNoObstacles) {
   cost_params.height_change_cost_param = 4.f;
   cost_params.height_change_cost_param_adapted = 4.f;
   Eigen::MatrixXf cost_matrix;
-  Histogram histogram = Histogram(ALPHA_RES);
+  Histogram histogram;
   float smoothing_radius = 30.f;
 
   // WHEN: we calculate the cost matrix from the input data
@@ -529,6 +1269,71 @@ TEST(PlannerFunctions, getCostMatrixNoObstacles) {
   EXPECT_TRUE(row4);
 }
 
+template <int RES>
+void expectCostMatrixMatchesCostFunction() {
+  std::srand(RES);
+  const HistogramLookupTable<RES>& lookup = HistogramLookupTable<RES>::get();
+  for (int trial = 0; trial < 5; trial++) {
+    Eigen::Vector3f position(randomFloat(-5.f, 5.f), randomFloat(-5.f, 5.f),
+                             randomFloat(0.f, 5.f));
+    Eigen::Vector3f goal(randomFloat(-20.f, 20.f), randomFloat(-20.f, 20.f),
+                         randomFloat(0.f, 10.f));
+    Eigen::Vector3f last_sent_waypoint =
+        position + Eigen::Vector3f(randomFloat(-1.f, 1.f),
+                                   randomFloat(-1.f, 1.f),
+                                   randomFloat(-0.5f, 0.5f));
+    float heading = randomFloat(-180.f, 180.f);
+    costParameters cost_params;
+    cost_params.goal_cost_param = randomFloat(0.f, 5.f);
+    cost_params.heading_cost_param = randomFloat(0.f, 1.f);
+    cost_params.smooth_cost_param = randomFloat(0.f, 3.f);
+    cost_params.height_change_cost_param = randomFloat(0.f, 5.f);
+    cost_params.height_change_cost_param_adapted = randomFloat(0.f, 5.f);
+    PolarHistogram<RES> histogram;
+    for (int e = 0; e < PolarHistogram<RES>::E_DIM; e++) {
+      for (int z = 0; z < PolarHistogram<RES>::Z_DIM; z++) {
+        if (std::rand() % 4 == 0) {
+          histogram.set_dist(e, z, randomFloat(1.f, 8.f));
+        }
+      }
+    }
+
+    // WHEN: we evaluate the cost matrix
+    Eigen::MatrixXf cost_matrix, distance_matrix;
+    evaluateCostMatrix(histogram, goal, position, heading, last_sent_waypoint,
+                       cost_params, cost_matrix, distance_matrix);
+
+    // THEN: every evaluated bin should equal costFunction. The results are
+    // bit for bit equal unless the compiler fuses multiply-adds differently
+    PolarPoint last_wp_pol = cartesianToPolar(last_sent_waypoint, position);
+    last_wp_pol.r = (position - goal).norm();
+    Eigen::Vector3f projected_last_wp = polarToCartesian(last_wp_pol, position);
+    const float yaw_rad = heading * DEG_TO_RAD;
+    for (int e = 0; e < PolarHistogram<RES>::E_DIM; e++) {
+      const float bin_width = lookup.elevationBinWidth(e);
+      const int step_size = static_cast<int>(std::round(1 / bin_width));
+      const Eigen::Vector3f heading_direction(bin_width * std::sin(yaw_rad),
+                                              bin_width * std::cos(yaw_rad),
+                                              lookup.binCenter(e, 0).z());
+      for (int z = 0; z < PolarHistogram<RES>::Z_DIM; z += step_size) {
+        float distance_cost, other_costs;
+        costFunction(lookup.binCenter(e, z), heading_direction,
+                     histogram.dist(e, z), goal, position, projected_last_wp,
+                     cost_params, distance_cost, other_costs);
+        EXPECT_FLOAT_EQ(other_costs, cost_matrix(e, z));
+        EXPECT_FLOAT_EQ(distance_cost, distance_matrix(e, z));
+      }
+    }
+  }
+}
+
+TEST(PlannerFunctions, evaluateCostMatrixMatchesCostFunction) {
+  // GIVEN: random positions, goals, cost parameters and obstacles
+  expectCostMatrixMatchesCostFunction<ALPHA_RES_FINE>();
+  expectCostMatrixMatchesCostFunction<ALPHA_RES>();
+  expectCostMatrixMatchesCostFunction<ALPHA_RES_COARSE>();
+}
+
 TEST(PlannerFunctions, CostfunctionGoalCost) {
   // GIVEN: a scenario with two different goal locations
   Eigen::Vector3f position(0.f, 0.f, 0.f);
@@ -665,7 +1470,7 @@ TEST(PlannerFunctions, CostfunctionSmoothingCost) {
 
 TEST(Histogram, HistogramDownsampleCorrectUsage) {
   // GIVEN: a histogram of the correct resolution
-  Histogram histogram = Histogram(ALPHA_RES);
+  Histogram histogram;
   histogram.set_dist(0, 0, 1.3);
   histogram.set_dist(1, 0, 1.3);
   histogram.set_dist(0, 1, 1.3);
@@ -676,34 +1481,36 @@ TEST(Histogram, HistogramDownsampleCorrectUsage) {
   histogram.set_age(3, 3, 3);
 
   // WHEN: we downsample the histogram to have a larger bin size
-  histogram.downsample();
+  PolarHistogram<2 * ALPHA_RES> low_res_histogram;
+  downsample(histogram, low_res_histogram);
 
   // THEN: The downsampled histogram should fuse four cells of the regular
   // resolution histogram into one
   for (int i = 0; i < GRID_LENGTH_E / 2; ++i) {
     for (int j = 0; j < GRID_LENGTH_Z / 2; ++j) {
       if (i == 0 && j == 0) {
-        EXPECT_FLOAT_EQ(1.3, histogram.get_dist(i, j));
-        EXPECT_FLOAT_EQ(0.0, histogram.get_age(i, j));
+        EXPECT_FLOAT_EQ(1.3, low_res_histogram.get_dist(i, j));
+        EXPECT_FLOAT_EQ(0.0, low_res_histogram.get_age(i, j));
       } else if (i == 1 && j == 1) {
-        EXPECT_FLOAT_EQ(3, histogram.get_age(i, j));
-        EXPECT_FLOAT_EQ(0.0, histogram.get_dist(i, j));
+        EXPECT_FLOAT_EQ(3, low_res_histogram.get_age(i, j));
+        EXPECT_FLOAT_EQ(0.0, low_res_histogram.get_dist(i, j));
       } else {
-        EXPECT_FLOAT_EQ(0.0, histogram.get_dist(i, j));
-        EXPECT_FLOAT_EQ(0.0, histogram.get_age(i, j));
+        EXPECT_FLOAT_EQ(0.0, low_res_histogram.get_dist(i, j));
+        EXPECT_FLOAT_EQ(0.0, low_res_histogram.get_age(i, j));
       }
     }
   }
 }
 
 TEST(Histogram, HistogramUpsampleCorrectUsage) {
-  // GIVEN: a histogram of the correct resolution
-  Histogram histogram = Histogram(ALPHA_RES * 2);
-  histogram.set_dist(0, 0, 1.3);
-  histogram.set_age(1, 1, 3);
+  // GIVEN: a histogram with the larger bin size
+  PolarHistogram<2 * ALPHA_RES> low_res_histogram;
+  low_res_histogram.set_dist(0, 0, 1.3);
+  low_res_histogram.set_age(1, 1, 3);
 
   // WHEN: we upsample the histogram to have regular bin size
-  histogram.upsample();
+  Histogram histogram;
+  upsample(low_res_histogram, histogram);
 
   // THEN: The upsampled histogram should split every cell of the lower
   // resolution histogram into four cells
@@ -725,13 +1532,54 @@ TEST(Histogram, HistogramUpsampleCorrectUsage) {
   }
 }
 
-TEST(Histogram, HistogramUpDownpsampleInorrectUsage) {
-  // GIVEN: a histogram of the correct resolution
-  Histogram low_res_histogram = Histogram(ALPHA_RES * 2);
-  Histogram high_res_histogram = Histogram(ALPHA_RES);
+TEST(Histogram, HistogramIndexWrapping) {
+  // GIVEN: a histogram with a cell set in each corner
+  Histogram histogram;
+  histogram.set_dist(0, 0, 1.f);
+  histogram.set_dist(Histogram::E_DIM - 1, Histogram::Z_DIM - 1, 2.f);
+  histogram.set_age(0, Histogram::Z_DIM - 1, 3);
+
+  // THEN: the wrapped getters should wrap the indices around both dimensions,
+  // while the unchecked ones access the cells directly
+  EXPECT_EQ(GRID_LENGTH_E, Histogram::E_DIM);
+  EXPECT_EQ(GRID_LENGTH_Z, Histogram::Z_DIM);
+  EXPECT_FLOAT_EQ(1.f, histogram.get_dist(Histogram::E_DIM, Histogram::Z_DIM));
+  EXPECT_FLOAT_EQ(2.f, histogram.get_dist(-1, -1));
+  EXPECT_EQ(3, histogram.get_age(0, -1));
+  EXPECT_FLOAT_EQ(1.f, histogram.dist(0, 0));
+  EXPECT_FLOAT_EQ(2.f,
+                  histogram.dist(Histogram::E_DIM - 1, Histogram::Z_DIM - 1));
+  EXPECT_EQ(3, histogram.age(0, Histogram::Z_DIM - 1));
+}
+
+TEST(Histogram, HistogramLookupTable) {
+  // GIVEN: the lookup tables of a fine and a coarse histogram
+  const HistogramLookupTable<ALPHA_RES_FINE>& fine =
+      HistogramLookupTable<ALPHA_RES_FINE>::get();
+  const HistogramLookupTable<ALPHA_RES_COARSE>& coarse =
+      HistogramLookupTable<ALPHA_RES_COARSE>::get();
+  const Eigen::Vector3f origin(0.f, 0.f, 0.f);
+
+  // THEN: the bin centers should match the polar conversion of the bin index
+  for (int e = 0; e < HistogramLookupTable<ALPHA_RES_FINE>::E_DIM; e += 7) {
+    for (int z = 0; z < HistogramLookupTable<ALPHA_RES_FINE>::Z_DIM; z += 11) {
+      PolarPoint p_pol = histogramIndexToPolar(e, z, ALPHA_RES_FINE, 1.f);
+      Eigen::Vector3f expected = polarToCartesian(p_pol, origin);
+      EXPECT_TRUE(expected.isApprox(fine.binCenter(e, z), 1e-5f));
+      EXPECT_EQ(e, polarToHistogramIndex(p_pol, ALPHA_RES_FINE).y());
+      EXPECT_EQ(z, polarToHistogramIndex(p_pol, ALPHA_RES_FINE).x());
+      EXPECT_NEAR(std::cos(p_pol.e * DEG_TO_RAD), fine.elevationBinWidth(e),
+                  1e-6f);
+    }
+  }
 
-  // THEN: We expect the functions to throw if the input histogram has the wrong
-  // resolution
-  EXPECT_THROW(low_res_histogram.downsample(), std::logic_error);
-  EXPECT_THROW(high_res_histogram.upsample(), std::logic_error);
+  // AND: the corners should be the bin centers shifted by half a bin
+  int e = 10, z = 20;
+  PolarPoint corner = histogramIndexToPolar(e, z, ALPHA_RES_COARSE, 1.f);
+  corner.e += ALPHA_RES_COARSE / 2.f;
+  corner.z -= ALPHA_RES_COARSE / 2.f;
+  EXPECT_TRUE(polarToCartesian(corner, origin)
+                  .isApprox(coarse.binCorner(e + 1, z), 1e-5f));
+  EXPECT_NEAR(1.f, coarse.binCorner(0, 0).norm(), 1e-6f);
+  EXPECT_NEAR(-1.f, coarse.binCorner(0, 0).z(), 1e-6f);
 }
@@ -1,16 +1,134 @@
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
 
 #include "../include/local_planner/common.h"
+#include "../include/local_planner/monotonic_clock.h"
 #include "../include/local_planner/star_planner.h"
 #include "../include/local_planner/tree_node.h"
 
 using namespace avoidance;
 
+// clock which advances by a fixed step every time it is read
+class SteppingClock : public MonotonicClock {
+ public:
+  explicit SteppingClock(duration step) : step_(step) {}
+  time_point now() override {
+    time_ += step_;
+    return time_;
+  }
+
+ private:
+  duration step_;
+  time_point time_;
+};
+
 class StarPlannerBasicTests : public ::testing::Test, public StarPlanner {
   void SetUp() override{};
   void TearDown() override{};
 };
 
+// The tree expansion as it was before the batched expansion: the cheapest
+// node is found by a scan over the whole tree and expanded, then the
+// candidates are compared with every node of the tree. Serves as reference
+// for a batch of one node in the scene of StarPlannerTests
+class SequentialStarPlanner : public StarPlanner {
+ public:
+  void buildSequentialTree(const avoidance::LocalPlannerNodeConfig& config,
+                           const pcl::PointCloud<pcl::PointXYZ>& cloud,
+                           const Eigen::Vector3f& position,
+                           const Eigen::Vector3f& goal, float h_FOV,
+                           float v_FOV) {
+    const float node_distance = config.tree_node_distance_;
+    const float min_node_distance = 0.2f;
+    const float min_candidate_separation_deg =
+        2.f * RAD_TO_DEG *
+        std::asin(std::min(1.f, 0.5f * min_node_distance / node_distance));
+    ObstacleIndex obstacle_index;
+    buildObstacleIndex(cloud, position, config.tree_voxel_size_,
+                       obstacle_index);
+
+    tree_.clear();
+    closed_set_.clear();
+    // the vehicle yaw of the scene is zero, like the angles of a new node
+    tree_.addNode(0, 0, position);
+    tree_.heuristic[0] = treeHeuristicFunction(0);
+    tree_.total_cost[0] = tree_.heuristic[0];
+
+    int origin = 0;
+    for (int n = 0; n < config.n_expanded_nodes_; n++) {
+      const Eigen::Vector3f origin_position = tree_.position[origin];
+      Histogram histogram;
+      bool hist_is_empty = false;
+      FOVMask z_FOV_mask;
+      int e_FOV_min, e_FOV_max;
+      calculateFOV<ALPHA_RES>(h_FOV, v_FOV, z_FOV_mask, e_FOV_min, e_FOV_max,
+                              tree_.yaw[origin], 0.f);
+      generateCombinedHistogram(histogram, hist_is_empty, obstacle_index,
+                                memoryHistogram<ALPHA_RES>(), position,
+                                origin_position, 20.f, 10, false, z_FOV_mask,
+                                e_FOV_min, e_FOV_max);
+      Eigen::MatrixXf cost_matrix;
+      std::vector<uint8_t> cost_image_data;
+      getCostMatrix(histogram, goal, origin_position, tree_.yaw[origin],
+                    Eigen::Vector3f::Zero(), costParameters(), false,
+                    config.smoothing_margin_degrees_, cost_matrix,
+                    cost_image_data);
+      std::vector<candidateDirection> candidate_vector;
+      CandidateSelectionBuffers buffers;
+      getBestCandidatesFromCostMatrix<ALPHA_RES>(
+          cost_matrix, config.children_per_node_,
+          min_candidate_separation_deg, candidate_vector, buffers);
+
+      if (candidate_vector.empty()) {
+        tree_.total_cost[origin] = HUGE_VAL;
+      }
+      int children = 0;
+      for (const candidateDirection& candidate : candidate_vector) {
+        PolarPoint p_pol(candidate.elevation_angle, candidate.azimuth_angle,
+                         node_distance);
+        Eigen::Vector3f node_location =
+            polarToCartesian(p_pol, origin_position);
+        bool close_node = false;
+        for (const Eigen::Vector3f& node_position : tree_.position) {
+          if ((node_position - node_location).norm() < min_node_distance) {
+            close_node = true;
+          }
+        }
+        if (children < config.children_per_node_ && !close_node) {
+          const int node = tree_.addNode(origin, tree_.depth[origin] + 1,
+                                         node_location);
+          tree_.last_e[node] = p_pol.e;
+          tree_.last_z[node] = p_pol.z;
+          float h = treeHeuristicFunction(node);
+          float c = treeCostFunction(node);
+          tree_.heuristic[node] = h;
+          tree_.total_cost[node] =
+              tree_.total_cost[origin] - tree_.heuristic[origin] + c + h;
+          Eigen::Vector3f diff = node_location - origin_position;
+          float yaw_radians = atan2(diff.y(), diff.x());
+          tree_.yaw[node] =
+              std::round((-yaw_radians * 180.0f / M_PI_F)) + 90.0f;
+          children++;
+        }
+      }
+      closed_set_.push_back(origin);
+
+      float minimal_cost = HUGE_VAL;
+      for (size_t i = 0; i < tree_.size(); i++) {
+        bool closed = std::find(closed_set_.begin(), closed_set_.end(), i) !=
+                      closed_set_.end();
+        float node_distance_to_vehicle = (tree_.position[i] - position).norm();
+        if (tree_.total_cost[i] < minimal_cost && !closed &&
+            node_distance_to_vehicle < config.max_path_length_) {
+          minimal_cost = tree_.total_cost[i];
+          origin = i;
+        }
+      }
+    }
+  }
+};
+
 class StarPlannerTests : public ::testing::Test {
  public:
   StarPlanner star_planner;
@@ -20,6 +138,7 @@ class StarPlannerTests : public ::testing::Test {
   float obstacle_y = 2.0f;
   Eigen::Vector3f goal;
   Eigen::Vector3f position;
+  pcl::PointCloud<pcl::PointXYZ>::Ptr cloud;
 
   void SetUp() override {
     ros::Time::init();
@@ -38,24 +157,26 @@ class StarPlannerTests : public ::testing::Test {
     goal.y() = 14.0f;
     goal.z() = 4.0f;
 
-    pcl::PointCloud<pcl::PointXYZ> cloud;
+    cloud.reset(new pcl::PointCloud<pcl::PointXYZ>());
     for (float x = obstacle_min_x; x < obstacle_max_x; x += 0.05f) {
       for (float z = goal.z() - obstacle_half_height;
            z < goal.z() + obstacle_half_height; z += 0.05f) {
-        cloud.push_back(pcl::PointXYZ(x, obstacle_y, z));
+        cloud->push_back(pcl::PointXYZ(x, obstacle_y, z));
       }
     }
+    setScene(star_planner);
+  }
+
+  void setScene(StarPlanner& planner) {
     costParameters cost_params;
-    const pcl::PointCloud<pcl::PointXYZ> reprojected_points;
-    const std::vector<int> reprojected_points_age;
-
-    star_planner.setParams(cost_params);
-    star_planner.setFOV(270.0f, 45.0f);
-    star_planner.setReprojectedPoints(reprojected_points,
-                                      reprojected_points_age);
-    star_planner.setPose(position, 0.0f);
-    star_planner.setGoal(goal);
-    star_planner.setCloud(cloud);
+    const Histogram empty_histogram;
+
+    planner.setParams(cost_params);
+    planner.setFOV(270.0f, 45.0f);
+    planner.setObstacleMemory(empty_histogram, position, 10, 20.0f);
+    planner.setPose(position, 0.0f);
+    planner.setGoal(goal);
+    planner.setCloud(cloud);
   }
   void TearDown() override {}
 };
@@ -69,9 +190,8 @@ TEST_F(StarPlannerTests, buildTree) {
   // WHEN: we build the tree for 15 times
   for (size_t i = 0; i < 15; i++) {
     star_planner.buildLookAheadTree();
-    for (auto node : star_planner.tree_) {
+    for (const Eigen::Vector3f& n : star_planner.tree_.position) {
       // THEN: we expect each tree node position not to be close to the obstacle
-      Eigen::Vector3f n = node.getPosition();
       bool node_inside_obstacle =
           n.x() > obstacle_min_x && n.x() < obstacle_max_x &&
           n.y() > obstacle_y - 0.1f && n.y() < obstacle_y + 0.1f &&
@@ -89,11 +209,258 @@ TEST_F(StarPlannerTests, buildTree) {
 
     // we set the vehicle position to be the first node position after the
     // origin for the next algorithm iterarion
-    position = star_planner.tree_[1].getPosition();
+    position = star_planner.tree_.position[1];
     star_planner.setPose(position, 0.0);
   }
 }
 
+TEST_F(StarPlannerTests, buildTreeBatched) {
+  // GIVEN: a vehicle position, a goal, an obstacle in between and a planner
+  // which expands four nodes concurrently
+  avoidance::LocalPlannerNodeConfig config =
+      avoidance::LocalPlannerNodeConfig::__getDefault__();
+  config.children_per_node_ = 2;
+  config.n_expanded_nodes_ = 10;
+  config.tree_expansion_batch_ = 4;
+  star_planner.dynamicReconfigureSetStarParams(config, 1);
+
+  // WHEN: we build the tree twice, resetting the goal in between such that
+  // the first tree does not bias the second one
+  star_planner.buildLookAheadTree();
+  Tree first_tree = star_planner.tree_;
+  const std::vector<Eigen::Vector3f> first_path =
+      star_planner.path_node_positions_;
+  star_planner.setGoal(goal);
+  star_planner.buildLookAheadTree();
+
+  // THEN: every node should be expanded once and no node should be close to
+  // the obstacle
+  EXPECT_EQ(10u, star_planner.closed_set_.size());
+  EXPECT_GT(star_planner.tree_.size(), 10u);
+  EXPECT_GT(star_planner.path_node_positions_.size(), 2u);
+  for (const Eigen::Vector3f& n : star_planner.tree_.position) {
+    bool node_inside_obstacle =
+        n.x() > obstacle_min_x && n.x() < obstacle_max_x &&
+        n.y() > obstacle_y - 0.1f && n.y() < obstacle_y + 0.1f &&
+        n.z() > 4.0f - obstacle_half_height &&
+        n.z() < 4.0f + obstacle_half_height;
+    EXPECT_FALSE(node_inside_obstacle);
+  }
+
+  // THEN: the children should be merged in the same order every time
+  ASSERT_EQ(first_tree.size(), star_planner.tree_.size());
+  for (size_t i = 0; i < first_tree.size(); i++) {
+    EXPECT_EQ(first_tree.origin[i], star_planner.tree_.origin[i]);
+    EXPECT_EQ(first_tree.position[i], star_planner.tree_.position[i]);
+  }
+  EXPECT_EQ(first_path, star_planner.path_node_positions_);
+}
+
+TEST_F(StarPlannerTests, buildTreeBatchOfOneMatchesSequentialExpansion) {
+  // GIVEN: a planner which expands batches of one node and the reference of
+  // the sequential expansion in the same scene, with enough children and
+  // expanded nodes for the open nodes to compete
+  avoidance::LocalPlannerNodeConfig config =
+      avoidance::LocalPlannerNodeConfig::__getDefault__();
+  config.children_per_node_ = 8;
+  config.n_expanded_nodes_ = 30;
+  config.tree_expansion_batch_ = 1;
+  star_planner.dynamicReconfigureSetStarParams(config, 1);
+  SequentialStarPlanner reference;
+  reference.dynamicReconfigureSetStarParams(config, 1);
+  setScene(reference);
+
+  // WHEN: we build both trees
+  star_planner.buildLookAheadTree();
+  reference.buildSequentialTree(config, *cloud, position, goal, 270.0f, 45.0f);
+
+  // THEN: the nodes should be expanded in the same order and the trees should
+  // be identical
+  EXPECT_EQ(reference.closed_set_, star_planner.closed_set_);
+  ASSERT_EQ(reference.tree_.size(), star_planner.tree_.size());
+  for (size_t i = 0; i < reference.tree_.size(); i++) {
+    EXPECT_EQ(reference.tree_.origin[i], star_planner.tree_.origin[i]);
+    EXPECT_EQ(reference.tree_.position[i], star_planner.tree_.position[i]);
+  }
+}
+
+TEST_F(StarPlannerTests, buildTreeWarmStart) {
+  // GIVEN: a planner reusing the previous path and a first tree
+  avoidance::LocalPlannerNodeConfig config =
+      avoidance::LocalPlannerNodeConfig::__getDefault__();
+  config.children_per_node_ = 2;
+  config.n_expanded_nodes_ = 10;
+  config.tree_warm_start_ = true;
+  star_planner.dynamicReconfigureSetStarParams(config, 1);
+  star_planner.buildLookAheadTree();
+  const std::vector<Eigen::Vector3f> first_path =
+      star_planner.path_node_positions_;
+  ASSERT_GT(first_path.size(), 3u);
+
+  // WHEN: the vehicle moves a few centimeters along the path
+  const Eigen::Vector3f first_node = first_path[first_path.size() - 2];
+  position += 0.05f * (first_node - position).normalized();
+  star_planner.setPose(position, 0.0f);
+  star_planner.buildLookAheadTree();
+
+  // THEN: the tree should start at the vehicle and continue along the nodes
+  // of the previous path up to the one before its end. These nodes are not
+  // expanded again
+  auto isInTree = [this](const Eigen::Vector3f& p) {
+    for (const Eigen::Vector3f& n : star_planner.tree_.position) {
+      if (n == p) return true;
+    }
+    return false;
+  };
+  EXPECT_EQ(position, star_planner.tree_.position[0]);
+  const int n_reused = first_path.size() - 2;
+  for (int i = 1; i <= n_reused; i++) {
+    EXPECT_EQ(first_path[first_path.size() - 1 - i],
+              star_planner.tree_.position[i]);
+    EXPECT_EQ(i - 1, star_planner.tree_.origin[i]);
+    EXPECT_EQ(i - 1, star_planner.closed_set_[i - 1]);
+  }
+  EXPECT_EQ(n_reused, star_planner.closed_set_[n_reused]);
+  EXPECT_EQ(10u, star_planner.closed_set_.size());
+
+  // WHEN: an obstacle appears at the end of the second segment of the new
+  // path, out of reach of the first segment
+  const std::vector<Eigen::Vector3f> second_path =
+      star_planner.path_node_positions_;
+  ASSERT_GT(second_path.size(), 3u);
+  const Eigen::Vector3f blocked =
+      0.2f * second_path[second_path.size() - 2] +
+      0.8f * second_path[second_path.size() - 3];
+  pcl::PointCloud<pcl::PointXYZ>::Ptr cloud(
+      new pcl::PointCloud<pcl::PointXYZ>());
+  cloud->push_back(toXYZ(blocked));
+  star_planner.setCloud(cloud);
+  star_planner.buildLookAheadTree();
+
+  // THEN: the path should only be reused up to the obstacle
+  EXPECT_EQ(second_path[second_path.size() - 2],
+            star_planner.tree_.position[1]);
+  EXPECT_FALSE(isInTree(second_path[second_path.size() - 3]));
+}
+
+TEST_F(StarPlannerTests, buildTreeTimeBudget) {
+  // GIVEN: a planner which may expand 50 nodes within a time budget of 5ms and
+  // a clock which advances by 1ms every time it is read
+  avoidance::LocalPlannerNodeConfig config =
+      avoidance::LocalPlannerNodeConfig::__getDefault__();
+  config.children_per_node_ = 2;
+  config.n_expanded_nodes_ = 50;
+  config.tree_time_budget_ms_ = 5.0;
+  star_planner.dynamicReconfigureSetStarParams(config, 1);
+  star_planner.setClock(std::make_shared<SteppingClock>(
+      std::chrono::duration_cast<MonotonicClock::duration>(
+          std::chrono::milliseconds(1))));
+
+  // WHEN: we build the tree
+  const int n_expanded = star_planner.buildLookAheadTree();
+
+  // THEN: the clock is read once per expanded node after the start, the
+  // expansion should stop once the budget is used up
+  EXPECT_EQ(5, n_expanded);
+  EXPECT_EQ(5u, star_planner.closed_set_.size());
+  Tree budget_tree = star_planner.tree_;
+  const std::vector<Eigen::Vector3f> budget_path =
+      star_planner.path_node_positions_;
+  EXPECT_GT(budget_path.size(), 1u);
+
+  // WHEN: we build the tree of a planner which expands five nodes without a
+  // time budget
+  config.n_expanded_nodes_ = 5;
+  config.tree_time_budget_ms_ = 0.0;
+  star_planner.dynamicReconfigureSetStarParams(config, 1);
+  star_planner.setGoal(goal);
+  EXPECT_EQ(5, star_planner.buildLookAheadTree());
+
+  // THEN: the tree and the path found so far should be the same
+  ASSERT_EQ(budget_tree.size(), star_planner.tree_.size());
+  for (size_t i = 0; i < budget_tree.size(); i++) {
+    EXPECT_EQ(budget_tree.origin[i], star_planner.tree_.origin[i]);
+    EXPECT_EQ(budget_tree.position[i], star_planner.tree_.position[i]);
+  }
+  EXPECT_EQ(budget_path, star_planner.path_node_positions_);
+
+  // WHEN: the budget is larger than the time needed for all nodes
+  config.n_expanded_nodes_ = 10;
+  config.tree_time_budget_ms_ = 100.0;
+  star_planner.dynamicReconfigureSetStarParams(config, 1);
+  star_planner.setGoal(goal);
+
+  // THEN: n_expanded_nodes_ should limit the expansion
+  EXPECT_EQ(10, star_planner.buildLookAheadTree());
+}
+
+TEST(Tree, addNode) {
+  // GIVEN: a tree reserved for three nodes
+  Tree tree;
+  tree.reserve(3);
+  const Eigen::Vector3f* positions = tree.position.data();
+
+  // WHEN: we add a root and two children
+  const Eigen::Vector3f root(1.f, 2.f, 3.f);
+  const Eigen::Vector3f child(2.f, 2.f, 3.f);
+  EXPECT_EQ(0, tree.addNode(0, 0, root));
+  EXPECT_EQ(1, tree.addNode(0, 1, child));
+  EXPECT_EQ(2, tree.addNode(1, 2, child + child - root));
+
+  // THEN: every array should hold one entry per node and the arrays should
+  // not be reallocated
+  ASSERT_EQ(3u, tree.size());
+  EXPECT_EQ(positions, tree.position.data());
+  EXPECT_EQ(child, tree.position[1]);
+  EXPECT_EQ(1, tree.origin[2]);
+  EXPECT_EQ(2, tree.depth[2]);
+  for (size_t i = 0; i < tree.size(); i++) {
+    EXPECT_FLOAT_EQ(0.f, tree.total_cost[i]);
+    EXPECT_FLOAT_EQ(0.f, tree.heuristic[i]);
+    EXPECT_FLOAT_EQ(0.f, tree.last_e[i]);
+    EXPECT_FLOAT_EQ(0.f, tree.last_z[i]);
+    EXPECT_FLOAT_EQ(0.f, tree.yaw[i]);
+  }
+
+  // WHEN: we clear the tree
+  tree.clear();
+
+  // THEN: it should be empty and keep its storage
+  EXPECT_EQ(0u, tree.size());
+  EXPECT_LE(3u, tree.capacity());
+  EXPECT_EQ(positions, tree.position.data());
+}
+
+TEST(TreeNodeGrid, hasNodeWithin) {
+  // GIVEN: a grid with nodes on both sides of cell borders
+  TreeNodeGrid grid;
+  const Eigen::Vector3f origin(1.f, 2.f, 3.f);
+  grid.reset(origin, 0.2f, 3);
+  grid.insert(origin + Eigen::Vector3f(0.19f, 0.f, 0.f));
+  grid.insert(origin + Eigen::Vector3f(-0.5f, -0.5f, -0.5f));
+  grid.insert(origin + Eigen::Vector3f(1.f, 1.f, 1.f));
+
+  // WHEN: we query positions close to and far from the nodes
+  // THEN: only nodes within the radius should be found, also across cells
+  EXPECT_TRUE(grid.hasNodeWithin(origin + Eigen::Vector3f(0.21f, 0.f, 0.f),
+                                 0.2f));
+  EXPECT_TRUE(grid.hasNodeWithin(
+      origin + Eigen::Vector3f(-0.41f, -0.41f, -0.41f), 0.2f));
+  EXPECT_FALSE(grid.hasNodeWithin(origin + Eigen::Vector3f(0.4f, 0.f, 0.f),
+                                  0.2f));
+  EXPECT_FALSE(grid.hasNodeWithin(origin + Eigen::Vector3f(0.19f, 0.f, 0.f),
+                                  0.f));
+  EXPECT_TRUE(grid.hasNodeWithin(origin + Eigen::Vector3f(1.f, 1.1f, 1.f),
+                                 0.2f));
+
+  // WHEN: we reset the grid
+  grid.reset(origin, 0.2f, 3);
+
+  // THEN: no node should be left
+  EXPECT_FALSE(grid.hasNodeWithin(origin + Eigen::Vector3f(1.f, 1.f, 1.f),
+                                  0.2f));
+}
+
 TEST_F(StarPlannerBasicTests, treeCostFunctionTargetCost) {
   // GIVEN: a tree, the last path and two different goal locations
   Eigen::Vector3f goal1(5.f, 1.f, 0.f);
@@ -101,15 +468,15 @@ TEST_F(StarPlannerBasicTests, treeCostFunctionTargetCost) {
 
   // insert tree root
   Eigen::Vector3f tree_root(0.f, 0.f, 0.f);
-  tree_.push_back(TreeNode(0, 0, tree_root));
-  tree_.back().yaw_ = 90.0;  // drone looks straight ahead
-  tree_.back().last_z_ = tree_.back().yaw_;
+  tree_.addNode(0, 0, tree_root);
+  tree_.yaw.back() = 90.0;  // drone looks straight ahead
+  tree_.last_z.back() = tree_.yaw.back();
 
   // insert first Node
   Eigen::Vector3f node1(1.f, 0.f, 0.f);
-  tree_.push_back(TreeNode(0, 1, node1));
-  tree_.back().last_e_ = 0.f;
-  tree_.back().last_z_ = 90.f;
+  tree_.addNode(0, 1, node1);
+  tree_.last_e.back() = 0.f;
+  tree_.last_z.back() = 90.f;
 
   // last path equal to the given nodes
   std::vector<Eigen::Vector3f> path_node_positions_;
@@ -138,15 +505,15 @@ TEST_F(StarPlannerBasicTests, treeCostFunctionOldPathCost) {
 
   // insert tree root
   Eigen::Vector3f tree_root(0.f, 0.f, 0.f);
-  tree_.push_back(TreeNode(0, 0, tree_root));
-  tree_.back().yaw_ = 90.0;  // drone looks straight ahead
-  tree_.back().last_z_ = tree_.back().yaw_;
+  tree_.addNode(0, 0, tree_root);
+  tree_.yaw.back() = 90.0;  // drone looks straight ahead
+  tree_.last_z.back() = tree_.yaw.back();
 
   // insert first Node
   Eigen::Vector3f node1(1.f, 0.f, 0.f);
-  tree_.push_back(TreeNode(0, 1, node1));
-  tree_.back().last_e_ = 0.f;
-  tree_.back().last_z_ = 90.f;
+  tree_.addNode(0, 1, node1);
+  tree_.last_e.back() = 0.f;
+  tree_.last_z.back() = 90.f;
 
   // last path case 1: equal to the current nodes
   std::vector<Eigen::Vector3f> path_node_positions1;
@@ -179,9 +546,9 @@ TEST_F(StarPlannerBasicTests, treeCostFunctionYawCost) {
 
   // insert tree root
   Eigen::Vector3f tree_root(0.f, 0.f, 0.f);
-  tree_.push_back(TreeNode(0, 0, tree_root));
-  tree_.back().yaw_ = 90;  // drone looks straight ahead
-  tree_.back().last_z_ = tree_.back().yaw_;
+  tree_.addNode(0, 0, tree_root);
+  tree_.yaw.back() = 90;  // drone looks straight ahead
+  tree_.last_z.back() = tree_.yaw.back();
 
   // insert two nodes to both sides
   PolarPoint node1_pol(0, 110, 1);  // to the right
@@ -189,13 +556,13 @@ TEST_F(StarPlannerBasicTests, treeCostFunctionYawCost) {
   Eigen::Vector3f node1 = polarToCartesian(node1_pol, tree_root);
   Eigen::Vector3f node2 = polarToCartesian(node2_pol, tree_root);
 
-  tree_.push_back(TreeNode(0, 1, node1));
-  tree_.back().last_e_ = node1_pol.e;
-  tree_.back().last_z_ = node1_pol.z;
+  tree_.addNode(0, 1, node1);
+  tree_.last_e.back() = node1_pol.e;
+  tree_.last_z.back() = node1_pol.z;
 
-  tree_.push_back(TreeNode(0, 1, node2));
-  tree_.back().last_e_ = node2_pol.e;
-  tree_.back().last_z_ = node2_pol.z;
+  tree_.addNode(0, 1, node2);
+  tree_.last_e.back() = node2_pol.e;
+  tree_.last_z.back() = node2_pol.z;
 
   // last path straight ahead
   Eigen::Vector3f node_old(1.f, 0.f, 0.f);
@@ -209,14 +576,14 @@ TEST_F(StarPlannerBasicTests, treeCostFunctionYawCost) {
   float cost2_straight = treeCostFunction(2);
 
   // WHEN: we calculate the cost for both nodes as the drone looks to the right
-  tree_[0].yaw_ = 100;  // drone looks 10 degrees to the right
-  tree_[0].last_z_ = tree_[0].yaw_;
+  tree_.yaw[0] = 100;  // drone looks 10 degrees to the right
+  tree_.last_z[0] = tree_.yaw[0];
   float cost1_right = treeCostFunction(1);
   float cost2_right = treeCostFunction(2);
 
   // WHEN: we calculate the cost for both nodes as the drone looks to the left
-  tree_[0].yaw_ = 80;  // drone looks 10 degrees to the right
-  tree_[0].last_z_ = tree_[0].yaw_;
+  tree_.yaw[0] = 80;  // drone looks 10 degrees to the right
+  tree_.last_z[0] = tree_.yaw[0];
   float cost1_left = treeCostFunction(1);
   float cost2_left = treeCostFunction(2);
 
@@ -239,14 +606,14 @@ TEST_F(StarPlannerBasicTests, treeCostFunctionSmoothingCost) {
 
   // insert tree root
   Eigen::Vector3f tree_root(0.f, 0.f, 0.f);
-  tree_.push_back(TreeNode(0, 0, tree_root));
-  tree_.back().last_z_ = 90;
+  tree_.addNode(0, 0, tree_root);
+  tree_.last_z.back() = 90;
 
   // insert first node (straight ahead)
   Eigen::Vector3f node1(1.f, 0.f, 0.f);
-  tree_.push_back(TreeNode(0, 1, node1));
-  tree_.back().last_e_ = 0.f;
-  tree_.back().last_z_ = 90.f;
+  tree_.addNode(0, 1, node1);
+  tree_.last_e.back() = 0.f;
+  tree_.last_z.back() = 90.f;
 
   // insert two more nodes with node 1 as origin
   PolarPoint node2_pol(0, 100, 1);
@@ -254,13 +621,13 @@ TEST_F(StarPlannerBasicTests, treeCostFunctionSmoothingCost) {
   Eigen::Vector3f node2 = polarToCartesian(node2_pol, node1);
   Eigen::Vector3f node3 = polarToCartesian(node3_pol, node1);
 
-  tree_.push_back(TreeNode(1, 2, node2));
-  tree_.back().last_e_ = node2_pol.e;
-  tree_.back().last_z_ = node2_pol.z;
+  tree_.addNode(1, 2, node2);
+  tree_.last_e.back() = node2_pol.e;
+  tree_.last_z.back() = node2_pol.z;
 
-  tree_.push_back(TreeNode(1, 2, node3));
-  tree_.back().last_e_ = node3_pol.e;
-  tree_.back().last_z_ = node3_pol.z;
+  tree_.addNode(1, 2, node3);
+  tree_.last_e.back() = node3_pol.e;
+  tree_.last_z.back() = node3_pol.z;
 
   // calculate two goal positions in direction of the nodes 2, 3
   PolarPoint goal2_pol(0, 100, 5);
@@ -270,10 +637,10 @@ TEST_F(StarPlannerBasicTests, treeCostFunctionSmoothingCost) {
 
   // WHEN: we calculate the cost for nodes 2, 3
   setGoal(goal2);
-  tree_[0].yaw_ = 100;
+  tree_.yaw[0] = 100;
   float cost2 = treeCostFunction(2);
   setGoal(goal3);
-  tree_[0].yaw_ = 110;
+  tree_.yaw[0] = 110;
   float cost3 = treeCostFunction(3);
 
   // THEN: the path node with the more curved path (node 3) should be more
@@ -0,0 +1,62 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "../include/local_planner/thread_pool.h"
+
+using namespace avoidance;
+
+TEST(ThreadPool, parallelForVisitsEveryIndexOnce) {
+  // GIVEN: a pool with two workers
+  ThreadPool pool(2);
+  EXPECT_EQ(3, pool.concurrency());
+
+  for (size_t n : {0, 1, 3, 17, 1000}) {
+    // WHEN: we run a loop over n iterations
+    std::vector<int> visits(n, 0);
+    pool.parallelFor(n, [&visits](size_t i) { visits[i]++; });
+
+    // THEN: every iteration should have been executed exactly once
+    for (size_t i = 0; i < n; i++) {
+      EXPECT_EQ(1, visits[i]) << "n = " << n << ", i = " << i;
+    }
+  }
+}
+
+TEST(ThreadPool, parallelForRunsOnWorkers) {
+  // GIVEN: a pool with two workers and a loop body which blocks until all
+  // three threads are inside of it
+  ThreadPool pool(2);
+  std::atomic<int> n_waiting(0);
+  std::vector<std::thread::id> thread_ids(3);
+
+  // WHEN: we run a loop with three iterations
+  pool.parallelFor(3, [&](size_t i) {
+    thread_ids[i] = std::this_thread::get_id();
+    n_waiting++;
+    while (n_waiting < 3) std::this_thread::yield();
+  });
+
+  // THEN: the iterations should have run on three different threads, one of
+  // them the calling thread
+  std::set<std::thread::id> unique_ids(thread_ids.begin(), thread_ids.end());
+  EXPECT_EQ(3, unique_ids.size());
+  EXPECT_EQ(1, unique_ids.count(std::this_thread::get_id()));
+}
+
+TEST(ThreadPool, noWorkersRunsSequentially) {
+  // GIVEN: a pool without workers
+  ThreadPool pool(0);
+  EXPECT_EQ(1, pool.concurrency());
+
+  // WHEN: we run a loop
+  std::vector<size_t> order;
+  pool.parallelFor(5, [&order](size_t i) { order.push_back(i); });
+
+  // THEN: the iterations should have run in order on the calling thread
+  std::vector<size_t> expected = {0, 1, 2, 3, 4};
+  EXPECT_EQ(expected, order);
+}